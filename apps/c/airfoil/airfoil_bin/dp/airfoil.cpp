@@ -0,0 +1,242 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+//     Nonlinear airfoil lift calculation
+//
+//     Written by Mike Giles, 2010-2011, based on FORTRAN code
+//     by Devendra Ghate and Mike Giles, 2005
+//
+//     This version maps the mesh written by
+//     ../../airfoil_hdf5/dp/convert_mesh_bin into memory with op_bin_open
+//
+
+//
+// standard headers
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// global constants
+
+double gam, gm1, cfl, eps, mach, alpha, qinf[4];
+
+//
+// OP header file
+//
+
+#include "op_seq.h"
+
+#include "op_bin.h"
+
+//
+// kernel routines for parallel loops, shared with airfoil_plain
+//
+
+#include "../../airfoil_plain/dp/adt_calc.h"
+#include "../../airfoil_plain/dp/bres_calc.h"
+#include "../../airfoil_plain/dp/res_calc.h"
+#include "../../airfoil_plain/dp/save_soln.h"
+#include "../../airfoil_plain/dp/update.h"
+
+// main program
+
+int main(int argc, char **argv) {
+  // OP initialisation
+  op_init(argc, argv, 2);
+
+  int niter;
+  double rms;
+
+  // timer
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+
+  // map the grid into memory
+
+  op_printf("reading in grid \n");
+
+  op_bin_file file = op_bin_open("new_grid.bin");
+
+  // declare sets, pointers and datasets
+
+  op_set nodes = op_bin_decl_set(file, "nodes");
+  op_set edges = op_bin_decl_set(file, "edges");
+  op_set bedges = op_bin_decl_set(file, "bedges");
+  op_set cells = op_bin_decl_set(file, "cells");
+
+  op_map pedge = op_bin_decl_map(file, edges, nodes, 2, "pedge");
+  op_map pecell = op_bin_decl_map(file, edges, cells, 2, "pecell");
+  op_map pbedge = op_bin_decl_map(file, bedges, nodes, 2, "pbedge");
+  op_map pbecell = op_bin_decl_map(file, bedges, cells, 1, "pbecell");
+  op_map pcell = op_bin_decl_map(file, cells, nodes, 4, "pcell");
+
+  op_dat p_bound = op_bin_decl_dat(file, bedges, 1, "int", "p_bound");
+  op_dat p_x = op_bin_decl_dat(file, nodes, 2, "double", "p_x");
+  op_dat p_q = op_bin_decl_dat(file, cells, 4, "double", "p_q");
+  op_dat p_qold = op_bin_decl_dat(file, cells, 4, "double", "p_qold");
+  op_dat p_adt = op_bin_decl_dat(file, cells, 1, "double", "p_adt");
+  op_dat p_res = op_bin_decl_dat(file, cells, 4, "double", "p_res");
+
+  op_bin_close(file);
+
+  // the binary mesh holds no constants, so set them here
+
+  op_printf("initialising flow field \n");
+
+  gam = 1.4f;
+  gm1 = gam - 1.0f;
+  cfl = 0.9f;
+  eps = 0.05f;
+
+  mach = 0.4f;
+  alpha = 3.0f * atan(1.0f) / 45.0f;
+  double p = 1.0f;
+  double r = 1.0f;
+  double u = sqrt(gam * p / r) * mach;
+  double e = p / (r * gm1) + 0.5f * u * u;
+
+  qinf[0] = r;
+  qinf[1] = r * u;
+  qinf[2] = 0.0f;
+  qinf[3] = r * e;
+
+  op_decl_const(1, "double", &gam);
+  op_decl_const(1, "double", &gm1);
+  op_decl_const(1, "double", &cfl);
+  op_decl_const(1, "double", &eps);
+  op_decl_const(1, "double", &mach);
+  op_decl_const(1, "double", &alpha);
+  op_decl_const(4, "double", qinf);
+
+  op_diagnostic_output();
+
+  // initialise timers for total execution wall time
+  op_timers(&cpu_t1, &wall_t1);
+
+  // main time-marching loop
+
+  niter = 1000;
+
+  for (int iter = 1; iter <= niter; iter++) {
+
+    // save old flow solution
+
+    op_par_loop(save_soln, "save_soln", cells,
+                op_arg_dat(p_q, -1, OP_ID, 4, "double", OP_READ),
+                op_arg_dat(p_qold, -1, OP_ID, 4, "double", OP_WRITE));
+
+    // predictor/corrector update loop
+
+    for (int k = 0; k < 2; k++) {
+
+      // calculate area/timstep
+
+      op_par_loop(adt_calc, "adt_calc", cells,
+                  op_arg_dat(p_x, 0, pcell, 2, "double", OP_READ),
+                  op_arg_dat(p_x, 1, pcell, 2, "double", OP_READ),
+                  op_arg_dat(p_x, 2, pcell, 2, "double", OP_READ),
+                  op_arg_dat(p_x, 3, pcell, 2, "double", OP_READ),
+                  op_arg_dat(p_q, -1, OP_ID, 4, "double", OP_READ),
+                  op_arg_dat(p_adt, -1, OP_ID, 1, "double", OP_WRITE));
+
+      // calculate flux residual
+
+      op_par_loop(res_calc, "res_calc", edges,
+                  op_arg_dat(p_x, 0, pedge, 2, "double", OP_READ),
+                  op_arg_dat(p_x, 1, pedge, 2, "double", OP_READ),
+                  op_arg_dat(p_q, 0, pecell, 4, "double", OP_READ),
+                  op_arg_dat(p_q, 1, pecell, 4, "double", OP_READ),
+                  op_arg_dat(p_adt, 0, pecell, 1, "double", OP_READ),
+                  op_arg_dat(p_adt, 1, pecell, 1, "double", OP_READ),
+                  op_arg_dat(p_res, 0, pecell, 4, "double", OP_INC),
+                  op_arg_dat(p_res, 1, pecell, 4, "double", OP_INC));
+
+      op_par_loop(bres_calc, "bres_calc", bedges,
+                  op_arg_dat(p_x, 0, pbedge, 2, "double", OP_READ),
+                  op_arg_dat(p_x, 1, pbedge, 2, "double", OP_READ),
+                  op_arg_dat(p_q, 0, pbecell, 4, "double", OP_READ),
+                  op_arg_dat(p_adt, 0, pbecell, 1, "double", OP_READ),
+                  op_arg_dat(p_res, 0, pbecell, 4, "double", OP_INC),
+                  op_arg_dat(p_bound, -1, OP_ID, 1, "int", OP_READ));
+
+      // update flow field
+
+      rms = 0.0;
+
+      op_par_loop(update, "update", cells,
+                  op_arg_dat(p_qold, -1, OP_ID, 4, "double", OP_READ),
+                  op_arg_dat(p_q, -1, OP_ID, 4, "double", OP_WRITE),
+                  op_arg_dat(p_res, -1, OP_ID, 4, "double", OP_RW),
+                  op_arg_dat(p_adt, -1, OP_ID, 1, "double", OP_READ),
+                  op_arg_gbl(&rms, 1, "double", OP_INC));
+    }
+
+    // print iteration history
+    rms = sqrt(rms / (double)op_get_size(cells));
+    if (iter % 100 == 0)
+      op_printf(" %d  %10.5e \n", iter, rms);
+    if (iter % 1000 == 0 &&
+        op_get_size(cells) == 720000) { // default mesh -- for validation
+      // op_printf(" %d  %3.16lf \n",iter,rms);
+      float diff = fabs((100.0 * (rms / 0.0001060114637578)) - 100.0);
+      op_printf("\n\nTest problem with %d cells is within %3.15E %% of the "
+                "expected solution\n",
+                720000, diff);
+      if (diff < 0.00001) {
+        op_printf("This test is considered PASSED\n");
+      } else {
+        op_printf("This test is considered FAILED\n");
+      }
+    }
+  }
+
+  op_timers(&cpu_t2, &wall_t2);
+
+  // output the result dat array to files
+  op_print_dat_to_txtfile(p_q, "out_grid_seq.dat"); // ASCI
+  op_print_dat_to_binfile(p_q, "out_grid_seq.bin"); // Binary
+
+  // write given op_dat's indicated segment of data to a memory block in the
+  // order it was originally
+  // arranged (i.e. before partitioning and reordering)
+  double *q_part = (double *)op_malloc(sizeof(double) * op_get_size(cells) * 4);
+  op_fetch_data_idx(p_q, q_part, 0, op_get_size(cells) - 1);
+  free(q_part);
+
+  op_timing_output();
+  op_printf("Max total runtime = %f\n", wall_t2 - wall_t1);
+
+  op_exit();
+}
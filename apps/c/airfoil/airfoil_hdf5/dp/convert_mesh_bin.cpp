@@ -0,0 +1,223 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// Converts the airfoil mesh, either new_grid.dat or an HDF5 file written by
+// convert_mesh, to OP2's binary mesh format (see op_bin.h), which the
+// sequential and OpenMP back-ends map into memory with op_bin_open:
+//
+//   ./convert_mesh_bin [new_grid.dat | new_grid.h5] [new_grid.bin]
+//
+// The binary format holds the sets, maps and dats only; constants have to be
+// set by the application.
+//
+
+//
+// standard headers
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// op_par_loop declarations
+//
+
+#include "op_seq.h"
+
+#include "op_bin.h"
+#include "op_hdf5.h"
+
+static void check_scan(int items_received, int items_expected) {
+  if (items_received != items_expected) {
+    printf("error reading from new_grid.dat\n");
+    exit(-1);
+  }
+}
+
+static void convert_grid_dat(char const *file, char const *file_out) {
+  int *becell, *ecell, *bound, *bedge, *edge, *cell;
+  double *x, *q, *qold, *adt, *res;
+
+  int nnode, ncell, nedge, nbedge;
+
+  FILE *fp;
+
+  if ((fp = fopen(file, "r")) == NULL) {
+    op_printf("can't open file %s\n", file);
+    exit(-1);
+  }
+
+  check_scan(fscanf(fp, "%d %d %d %d \n", &nnode, &ncell, &nedge, &nbedge), 4);
+
+  op_printf("reading in grid \n");
+  op_printf("Global number of nodes, cells, edges, bedges = %d, %d, %d, %d\n",
+            nnode, ncell, nedge, nbedge);
+
+  cell = (int *)op_malloc(4 * ncell * sizeof(int));
+  edge = (int *)op_malloc(2 * nedge * sizeof(int));
+  ecell = (int *)op_malloc(2 * nedge * sizeof(int));
+  bedge = (int *)op_malloc(2 * nbedge * sizeof(int));
+  becell = (int *)op_malloc(nbedge * sizeof(int));
+  bound = (int *)op_malloc(nbedge * sizeof(int));
+
+  x = (double *)op_malloc(2 * nnode * sizeof(double));
+  q = (double *)op_malloc(4 * ncell * sizeof(double));
+  qold = (double *)op_malloc(4 * ncell * sizeof(double));
+  res = (double *)op_malloc(4 * ncell * sizeof(double));
+  adt = (double *)op_malloc(ncell * sizeof(double));
+
+  for (int n = 0; n < nnode; n++) {
+    check_scan(fscanf(fp, "%lf %lf \n", &x[2 * n], &x[2 * n + 1]), 2);
+  }
+
+  for (int n = 0; n < ncell; n++) {
+    check_scan(fscanf(fp, "%d %d %d %d \n", &cell[4 * n], &cell[4 * n + 1],
+                      &cell[4 * n + 2], &cell[4 * n + 3]),
+               4);
+  }
+
+  for (int n = 0; n < nedge; n++) {
+    check_scan(fscanf(fp, "%d %d %d %d \n", &edge[2 * n], &edge[2 * n + 1],
+                      &ecell[2 * n], &ecell[2 * n + 1]),
+               4);
+  }
+
+  for (int n = 0; n < nbedge; n++) {
+    check_scan(fscanf(fp, "%d %d %d %d \n", &bedge[2 * n], &bedge[2 * n + 1],
+                      &becell[n], &bound[n]),
+               4);
+  }
+
+  fclose(fp);
+
+  // initialise flow field and residual
+
+  double gam = 1.4f;
+  double gm1 = gam - 1.0f;
+  double mach = 0.4f;
+  double p = 1.0f;
+  double r = 1.0f;
+  double u = sqrt(gam * p / r) * mach;
+  double e = p / (r * gm1) + 0.5f * u * u;
+  double qinf[4] = {r, r * u, 0.0f, r * e};
+
+  for (int n = 0; n < ncell; n++) {
+    adt[n] = 0.0f;
+    for (int m = 0; m < 4; m++) {
+      q[4 * n + m] = qinf[m];
+      qold[4 * n + m] = 0.0f;
+      res[4 * n + m] = 0.0f;
+    }
+  }
+
+  op_set nodes = op_decl_set(nnode, "nodes");
+  op_set edges = op_decl_set(nedge, "edges");
+  op_set bedges = op_decl_set(nbedge, "bedges");
+  op_set cells = op_decl_set(ncell, "cells");
+
+  op_decl_map(edges, nodes, 2, edge, "pedge");
+  op_decl_map(edges, cells, 2, ecell, "pecell");
+  op_decl_map(bedges, nodes, 2, bedge, "pbedge");
+  op_decl_map(bedges, cells, 1, becell, "pbecell");
+  op_decl_map(cells, nodes, 4, cell, "pcell");
+
+  op_decl_dat(bedges, 1, "int", bound, "p_bound");
+  op_decl_dat(nodes, 2, "double", x, "p_x");
+  op_decl_dat(cells, 4, "double", q, "p_q");
+  op_decl_dat(cells, 4, "double", qold, "p_qold");
+  op_decl_dat(cells, 1, "double", adt, "p_adt");
+  op_decl_dat(cells, 4, "double", res, "p_res");
+
+  // without OP_realloc the op_maps and op_dats use these arrays directly
+  op_dump_to_bin(file_out);
+
+  op_free(cell);
+  op_free(edge);
+  op_free(ecell);
+  op_free(bedge);
+  op_free(becell);
+  op_free(bound);
+  op_free(x);
+  op_free(q);
+  op_free(qold);
+  op_free(res);
+  op_free(adt);
+}
+
+static void convert_grid_hdf5(char const *file, char const *file_out) {
+  op_hdf5_file f = op_hdf5_open(file);
+
+  op_set nodes = op_hdf5_decl_set(f, "nodes");
+  op_set edges = op_hdf5_decl_set(f, "edges");
+  op_set bedges = op_hdf5_decl_set(f, "bedges");
+  op_set cells = op_hdf5_decl_set(f, "cells");
+
+  op_hdf5_decl_map(f, edges, nodes, 2, "pedge");
+  op_hdf5_decl_map(f, edges, cells, 2, "pecell");
+  op_hdf5_decl_map(f, bedges, nodes, 2, "pbedge");
+  op_hdf5_decl_map(f, bedges, cells, 1, "pbecell");
+  op_hdf5_decl_map(f, cells, nodes, 4, "pcell");
+
+  op_hdf5_decl_dat(f, bedges, 1, "int", "p_bound");
+  op_hdf5_decl_dat(f, nodes, 2, "double", "p_x");
+  op_hdf5_decl_dat(f, cells, 4, "double", "p_q");
+  op_hdf5_decl_dat(f, cells, 4, "double", "p_qold");
+  op_hdf5_decl_dat(f, cells, 1, "double", "p_adt");
+  op_hdf5_decl_dat(f, cells, 4, "double", "p_res");
+
+  op_hdf5_close(f);
+
+  op_dump_to_bin(file_out);
+}
+
+//
+// main program
+//
+
+int main(int argc, char **argv) {
+  // OP initialisation
+  op_init(argc, argv, 2);
+
+  char const *file_in = argc > 1 ? argv[1] : "new_grid.dat";
+  char const *file_out = argc > 2 ? argv[2] : "new_grid.bin";
+
+  size_t len = strlen(file_in);
+  if (len > 3 && strcmp(file_in + len - 3, ".h5") == 0)
+    convert_grid_hdf5(file_in, file_out);
+  else
+    convert_grid_dat(file_in, file_out);
+
+  op_exit();
+}
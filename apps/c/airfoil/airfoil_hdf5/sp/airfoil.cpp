@@ -72,6 +72,13 @@ int main(int argc, char **argv) {
   // OP initialisation
   op_init(argc, argv, 2);
 
+  int checkpoint = 0;
+  for (int i = 1; i < argc; ++i)
+    if (strcmp(argv[i],"-checkpoint")==0) {
+      op_printf("Enabling checkpoints\n");
+      checkpoint = 1;
+    }
+
   int niter;
   float rms;
 
@@ -195,6 +202,12 @@ int main(int argc, char **argv) {
 
     if (iter % 100 == 0)
       op_printf(" %d  %10.5e \n", iter, rms);
+
+    // checkpoint the flow field while the next iterations run; the file is
+    // complete once the next checkpoint starts or op_exit returns
+    if (checkpoint && iter % 250 == 0)
+      op_dump_to_hdf5_async("airfoil_checkpoint.h5");
+
     if (iter % 1000 == 0 &&
         g_ncell == 720000) { // defailt mesh -- for validation testing
       op_printf(" %d  %3.16f \n", iter, rms);
@@ -0,0 +1,184 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// Benchmark of the HDF5 dataset layouts written by op_dump_to_hdf5
+//
+// Writes a structured quad mesh (nodes, cells, a cell to node map and one
+// op_dat on each set) with the contiguous layout, with chunks
+// (OP_hdf5_chunk) and with chunks and compressed maps (OP_hdf5_deflate),
+// then times op_decl_map_hdf5 and op_decl_dat_hdf5 reading each file back,
+// with the default chunk cache and with OP_hdf5_cache, and checks the data.
+//
+// usage: ./hdf5_layout_bench [nodes per side] [repeats] [chunk KiB]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <op_seq.h>
+#include <op_hdf5.h>
+
+#define NUM_LAYOUTS 3
+static const char *layout_names[NUM_LAYOUTS] = {"contiguous", "chunked",
+                                                "chunked+deflate"};
+static const char *layout_files[NUM_LAYOUTS] = {
+    "bench_contiguous.h5", "bench_chunked.h5", "bench_deflate.h5"};
+
+static double wall() {
+  double cpu, et;
+  op_timers_core(&cpu, &et);
+  return et;
+}
+
+// keep the fastest of the repeated runs
+static void lap(double *best, double start) {
+  double t = wall() - start;
+  if (t < *best)
+    *best = t;
+}
+
+static double file_mib(const char *file) {
+  struct stat st;
+  if (stat(file, &st) != 0)
+    return 0.0;
+  return st.st_size / (1024.0 * 1024.0);
+}
+
+int main(int argc, char **argv) {
+  int nx = argc > 1 ? atoi(argv[1]) : 1024;
+  int repeats = argc > 2 ? atoi(argv[2]) : 3;
+  int chunk_kib = argc > 3 ? atoi(argv[3]) : 1024;
+  const int cache_mib = 64;
+
+  op_init(argc, argv, 0);
+
+  int nnode = nx * nx, ncell = (nx - 1) * (nx - 1);
+  int *cell = (int *)malloc((size_t)4 * ncell * sizeof(int));
+  double *x = (double *)malloc((size_t)2 * nnode * sizeof(double));
+  double *q = (double *)malloc((size_t)4 * ncell * sizeof(double));
+  for (int j = 0; j < nx; j++)
+    for (int i = 0; i < nx; i++) {
+      x[2 * (j * nx + i)] = i / (double)(nx - 1);
+      x[2 * (j * nx + i) + 1] = j / (double)(nx - 1);
+    }
+  for (int j = 0; j < nx - 1; j++)
+    for (int i = 0; i < nx - 1; i++) {
+      int c = j * (nx - 1) + i;
+      cell[4 * c] = j * nx + i;
+      cell[4 * c + 1] = j * nx + i + 1;
+      cell[4 * c + 2] = (j + 1) * nx + i + 1;
+      cell[4 * c + 3] = (j + 1) * nx + i;
+      for (int d = 0; d < 4; d++)
+        q[4 * c + d] = 1.0 + 0.01 * d + 1e-6 * c;
+    }
+
+  op_set nodes = op_decl_set(nnode, "nodes");
+  op_set cells = op_decl_set(ncell, "cells");
+  op_decl_map(cells, nodes, 4, cell, "pcell");
+  op_decl_dat(nodes, 2, "double", x, "p_x");
+  op_decl_dat(cells, 4, "double", q, "p_q");
+
+  double t_write[NUM_LAYOUTS];
+  for (int l = 0; l < NUM_LAYOUTS; l++) {
+    OP_hdf5_chunk = l > 0 ? chunk_kib : 0;
+    OP_hdf5_deflate = l > 1 ? 4 : 0;
+    double t = wall();
+    op_dump_to_hdf5(layout_files[l]);
+    t_write[l] = wall() - t;
+  }
+  OP_hdf5_chunk = OP_hdf5_deflate = 0;
+
+  printf("\n%d nodes, %d cells, best of %d runs (sec)\n", nnode, ncell,
+         repeats);
+  printf("%-16s %9s %9s %10s %10s %10s %10s\n", "layout", "MiB", "write",
+         "map", "dat", "map+cache", "dat+cache");
+
+  int errors = 0;
+  for (int l = 0; l < NUM_LAYOUTS; l++) {
+    const char *file = layout_files[l];
+    double t_map[2] = {1e30, 1e30}, t_dat[2] = {1e30, 1e30};
+
+    for (int c = 0; c < 2; c++) {
+      OP_hdf5_cache = c ? cache_mib : 0;
+      for (int rep = 0; rep < repeats; rep++) {
+        op_set r_nodes = op_decl_set_hdf5(file, "nodes");
+        op_set r_cells = op_decl_set_hdf5(file, "cells");
+
+        double t = wall();
+        op_map r_cell = op_decl_map_hdf5(r_cells, r_nodes, 4, file, "pcell");
+        lap(&t_map[c], t);
+
+        t = wall();
+        op_dat r_x = op_decl_dat_hdf5(r_nodes, 2, "double", file, "p_x");
+        op_dat r_q = op_decl_dat_hdf5(r_cells, 4, "double", file, "p_q");
+        lap(&t_dat[c], t);
+
+        if (memcmp(r_cell->map, cell, (size_t)4 * ncell * sizeof(int)) != 0 ||
+            memcmp(r_x->data, x, (size_t)2 * nnode * sizeof(double)) != 0 ||
+            memcmp(r_q->data, q, (size_t)4 * ncell * sizeof(double)) != 0) {
+          printf("ERROR: %s read back differs\n", layout_names[l]);
+          errors++;
+        }
+
+        // release the copies read in, op_exit frees what is left
+        free(r_cell->map);
+        r_cell->map = NULL;
+        op_free(r_x->data);
+        r_x->data = NULL;
+        op_free(r_q->data);
+        r_q->data = NULL;
+      }
+    }
+    OP_hdf5_cache = 0;
+
+    printf("%-16s %9.1f %9.4f %10.4f %10.4f %10.4f %10.4f\n",
+           layout_names[l], file_mib(file), t_write[l], t_map[0], t_dat[0],
+           t_map[1], t_dat[1]);
+  }
+
+  for (int l = 0; l < NUM_LAYOUTS; l++)
+    remove(layout_files[l]);
+  free(cell);
+  free(x);
+  free(q);
+
+  if (errors)
+    printf("\nFAILED: %d mismatches\n", errors);
+  else
+    printf("\nAll layouts read back the data written\n");
+
+  op_exit();
+  return errors != 0;
+}
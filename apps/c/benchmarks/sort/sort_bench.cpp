@@ -0,0 +1,323 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//
+// Micro-benchmark of the sorting utilities in op_util.cpp
+//
+// Times quickSort, quickSort_2, quickSort_dat, quickSort_map and removeDups
+// against copies of the original recursive quicksorts on the key patterns
+// seen during partitioning and halo creation, and checks that both produce
+// the same result.
+//
+// usage: ./sort_bench [size] [repeats]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <op_lib_core.h>
+#include <op_util.h>
+
+//
+// reference implementations (the original recursive quicksorts)
+//
+
+static void ref_quickSort(int arr[], int left, int right) {
+  int i = left, j = right, tmp;
+  if (left == right)
+    return;
+  int pivot = arr[(left + right) / 2];
+  while (i <= j) {
+    while (arr[i] < pivot)
+      i++;
+    while (arr[j] > pivot)
+      j--;
+    if (i <= j) {
+      tmp = arr[i];
+      arr[i] = arr[j];
+      arr[j] = tmp;
+      i++;
+      j--;
+    }
+  }
+  if (left < j)
+    ref_quickSort(arr, left, j);
+  if (i < right)
+    ref_quickSort(arr, i, right);
+}
+
+static void ref_quickSort_2(int arr1[], int arr2[], int left, int right) {
+  int i = left, j = right, tmp;
+  if (left == right)
+    return;
+  int pivot = arr1[(left + right) / 2];
+  while (i <= j) {
+    while (arr1[i] < pivot)
+      i++;
+    while (arr1[j] > pivot)
+      j--;
+    if (i <= j) {
+      tmp = arr1[i];
+      arr1[i] = arr1[j];
+      arr1[j] = tmp;
+      tmp = arr2[i];
+      arr2[i] = arr2[j];
+      arr2[j] = tmp;
+      i++;
+      j--;
+    }
+  }
+  if (left < j)
+    ref_quickSort_2(arr1, arr2, left, j);
+  if (i < right)
+    ref_quickSort_2(arr1, arr2, i, right);
+}
+
+static void ref_quickSort_dat(int arr[], char dat[], int left, int right,
+                              size_t elem_size) {
+  if (left < 0 || right <= 0 || left == right)
+    return;
+  int i = left, j = right, tmp;
+  char *tmp_dat = (char *)malloc(elem_size);
+  int pivot = arr[(left + right) / 2];
+  while (i <= j) {
+    while (arr[i] < pivot)
+      i++;
+    while (arr[j] > pivot)
+      j--;
+    if (i < j) {
+      tmp = arr[i];
+      arr[i] = arr[j];
+      arr[j] = tmp;
+      memcpy(tmp_dat, &dat[i * elem_size], elem_size);
+      memcpy(&dat[i * elem_size], &dat[j * elem_size], elem_size);
+      memcpy(&dat[j * elem_size], tmp_dat, elem_size);
+      i++;
+      j--;
+    } else if (i == j) {
+      i++;
+      j--;
+    }
+  }
+  if (left < j)
+    ref_quickSort_dat(arr, dat, left, j, elem_size);
+  if (i < right)
+    ref_quickSort_dat(arr, dat, i, right, elem_size);
+  free(tmp_dat);
+}
+
+//
+// input patterns
+//
+
+enum { RANDOM, SORTED, REVERSE, FEW_UNIQUE, NEARLY_SORTED, NUM_PATTERNS };
+static const char *pattern_names[] = {"random", "sorted", "reverse",
+                                      "few unique", "nearly sorted"};
+
+static void fill(int *a, int n, int pattern) {
+  srand(12345);
+  for (int i = 0; i < n; i++) {
+    switch (pattern) {
+    case RANDOM:
+      a[i] = rand() % (4 * n);
+      break;
+    case SORTED:
+      a[i] = i;
+      break;
+    case REVERSE:
+      a[i] = n - i;
+      break;
+    case FEW_UNIQUE: // e.g. MPI ranks
+      a[i] = rand() % 64;
+      break;
+    case NEARLY_SORTED:
+      a[i] = i;
+      break;
+    }
+  }
+  if (pattern == NEARLY_SORTED)
+    for (int k = 0; k < n / 100; k++) {
+      int i = rand() % n, j = rand() % n;
+      int t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+}
+
+static double wall() {
+  double cpu, et;
+  op_timers_core(&cpu, &et);
+  return et;
+}
+
+// keep the fastest of the repeated runs
+static void lap(double *best, double start) {
+  double t = wall() - start;
+  if (t < *best)
+    *best = t;
+}
+
+static int check(const char *what, const int *a, const int *b, int n) {
+  if (memcmp(a, b, n * sizeof(int)) != 0) {
+    printf("ERROR: %s results differ from the reference\n", what);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  int repeats = argc > 2 ? atoi(argv[2]) : 5;
+  const int dim = 4;           // map arity
+  const size_t elem_size = 40; // dat element, e.g. 5 doubles
+
+  int *keys = (int *)malloc(n * sizeof(int));
+  int *a = (int *)malloc(n * sizeof(int));
+  int *b = (int *)malloc(n * sizeof(int));
+  int *a2 = (int *)malloc(n * sizeof(int));
+  int *b2 = (int *)malloc(n * sizeof(int));
+  int *map = (int *)malloc((size_t)n * dim * sizeof(int));
+  char *dat_a = (char *)malloc((size_t)n * elem_size);
+  char *dat_b = (char *)malloc((size_t)n * elem_size);
+  int errors = 0;
+
+  printf("Sorting %d keys, best of %d runs (sec)\n", n, repeats);
+  printf("%-14s %-13s %10s %10s %8s\n", "pattern", "routine", "reference",
+         "op_util", "speedup");
+
+  for (int p = 0; p < NUM_PATTERNS; p++) {
+    fill(keys, n, p);
+    double t_ref[5], t_new[5];
+    for (int r = 0; r < 5; r++)
+      t_ref[r] = t_new[r] = 1e30;
+
+    for (int rep = 0; rep < repeats; rep++) {
+      double t;
+
+      // quickSort + removeDups
+      memcpy(a, keys, n * sizeof(int));
+      memcpy(b, keys, n * sizeof(int));
+      t = wall();
+      ref_quickSort(a, 0, n - 1);
+      lap(&t_ref[0], t);
+      t = wall();
+      quickSort(b, 0, n - 1);
+      lap(&t_new[0], t);
+      errors += check("quickSort", a, b, n);
+
+      t = wall();
+      int na = removeDups(a, n);
+      lap(&t_ref[1], t);
+      t = wall();
+      int nb = removeDups(b, n);
+      lap(&t_new[1], t);
+      errors += na != nb || check("removeDups", a, b, na);
+
+      // quickSort_2, the payload is checked against its key
+      memcpy(a, keys, n * sizeof(int));
+      memcpy(b, keys, n * sizeof(int));
+      for (int i = 0; i < n; i++)
+        a2[i] = b2[i] = keys[i] % 7;
+      t = wall();
+      ref_quickSort_2(a, a2, 0, n - 1);
+      lap(&t_ref[2], t);
+      t = wall();
+      quickSort_2(b, b2, 0, n - 1);
+      lap(&t_new[2], t);
+      errors += check("quickSort_2", a, b, n);
+      for (int i = 0; i < n; i++)
+        if (b2[i] != b[i] % 7) {
+          printf("ERROR: quickSort_2 payload mismatch\n");
+          errors++;
+          break;
+        }
+
+      // quickSort_dat, every element is filled with its key
+      memcpy(a, keys, n * sizeof(int));
+      memcpy(b, keys, n * sizeof(int));
+      for (int i = 0; i < n; i++) {
+        memset(&dat_a[i * elem_size], keys[i] & 0xff, elem_size);
+        memset(&dat_b[i * elem_size], keys[i] & 0xff, elem_size);
+      }
+      t = wall();
+      ref_quickSort_dat(a, dat_a, 0, n - 1, elem_size);
+      lap(&t_ref[3], t);
+      t = wall();
+      quickSort_dat(b, dat_b, 0, n - 1, elem_size);
+      lap(&t_new[3], t);
+      errors += check("quickSort_dat", a, b, n);
+      errors += memcmp(dat_a, dat_b, (size_t)n * elem_size) != 0;
+
+      // quickSort_map, compared with the dat version of the same layout
+      memcpy(b, keys, n * sizeof(int));
+      for (int i = 0; i < n; i++)
+        for (int d = 0; d < dim; d++)
+          map[i * dim + d] = keys[i] + d;
+      t = wall();
+      quickSort_map(b, map, 0, n - 1, dim);
+      lap(&t_new[4], t);
+      for (int i = 0; i < n; i++)
+        if (map[i * dim + dim - 1] != b[i] + dim - 1) {
+          printf("ERROR: quickSort_map payload mismatch\n");
+          errors++;
+          break;
+        }
+    }
+
+    const char *routines[] = {"quickSort", "removeDups", "quickSort_2",
+                              "quickSort_dat", "quickSort_map"};
+    for (int r = 0; r < 5; r++) {
+      if (r == 4)
+        printf("%-14s %-13s %10s %10.5f %8s\n", pattern_names[p],
+               routines[r], "-", t_new[r], "-");
+      else
+        printf("%-14s %-13s %10.5f %10.5f %7.1fx\n", pattern_names[p],
+               routines[r], t_ref[r], t_new[r], t_ref[r] / t_new[r]);
+    }
+  }
+
+  free(keys);
+  free(a);
+  free(b);
+  free(a2);
+  free(b2);
+  free(map);
+  free(dat_a);
+  free(dat_b);
+
+  if (errors)
+    printf("\nFAILED: %d mismatches\n", errors);
+  else
+    printf("\nAll results match the reference implementation\n");
+  return errors != 0;
+}
@@ -189,12 +189,22 @@ endef
 OP2_LIB_EXTRA_MPI += $(PARMETIS_LIB) $(PTSCOTCH_LIB) $(KAHIP_LIB)
 OP2_LIB_FOR_EXTRA_MPI += $(PARMETIS_LIB) $(PTSCOTCH_LIB) $(KAHIP_LIB)
 
+# The MPI libraries use OpenMP threads during halo creation
+ifeq ($(CPP_HAS_OMP),true)
+  OP2_LIB_EXTRA_MPI += $(OMP_CPPFLAGS)
+endif
+
+ifeq ($(F_HAS_OMP),true)
+  OP2_LIB_FOR_EXTRA_MPI += $(OMP_FFLAGS)
+endif
+
+# The HDF5 libraries write snapshots and streams on std::threads
 ifeq ($(OP2_LIBS_WITH_HDF5),true)
-  OP2_LIB_EXTRA += -lop2_hdf5 $(HDF5_SEQ_LIB)
-  OP2_LIB_EXTRA_MPI += $(HDF5_PAR_LIB)
+  OP2_LIB_EXTRA += -lop2_hdf5 $(HDF5_SEQ_LIB) -pthread
+  OP2_LIB_EXTRA_MPI += $(HDF5_PAR_LIB) -pthread
 
-  OP2_LIB_FOR_EXTRA += -lop2_for_hdf5 $(HDF5_SEQ_LIB)
-  OP2_LIB_FOR_EXTRA_MPI += $(HDF5_PAR_LIB)
+  OP2_LIB_FOR_EXTRA += -lop2_for_hdf5 $(HDF5_SEQ_LIB) -pthread
+  OP2_LIB_FOR_EXTRA_MPI += $(HDF5_PAR_LIB) -pthread
 endif
 
 $(foreach lib,$(OP2_LIBS_SINGLE_NODE),$(eval $(call OP2_LIB_template,$(lib),\
@@ -0,0 +1,65 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __OP_BIN_H
+#define __OP_BIN_H
+
+/*
+ * op_bin.h
+ *
+ * Header file for the memory-mapped binary mesh I/O of the single node
+ * back-ends
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a binary mesh file mapped into memory to declare op_sets, op_maps and
+ * op_dats that use its pages directly */
+typedef struct op_bin_file_core *op_bin_file;
+
+op_bin_file op_bin_open(char const *file);
+op_set op_bin_decl_set(op_bin_file file, char const *name);
+op_map op_bin_decl_map(op_bin_file file, op_set from, op_set to, int dim,
+                       char const *name);
+op_dat op_bin_decl_dat(op_bin_file file, op_set set, int dim,
+                       char const *type, char const *name);
+void op_bin_close(op_bin_file file);
+
+void op_dump_to_bin(char const *file_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OP_BIN_H */
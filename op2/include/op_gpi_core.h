@@ -67,6 +67,7 @@ struct op_gpi_buffer_core{
   MPI_Request *pre_exchange_hndl_r; /* UNUSED - data pre exchange handles for receives */
   unsigned long *remote_exec_offsets; /* execute segment offset for each remote(import) rank */
   unsigned long *remote_nonexec_offsets; /* non-execute segment offset for each remote(import) rank */
+  int diff_synced; /* OP_diff_halo: export and remote import segments hold the last exchange */
 };
 
 typedef op_gpi_buffer_core *op_gpi_buffer;
@@ -52,10 +52,32 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
 op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
                         char const *name);
 
+/* an hdf5 file opened once to declare several op_sets, op_maps and op_dats */
+typedef struct op_hdf5_file_core *op_hdf5_file;
+
+op_hdf5_file op_hdf5_open(char const *file);
+op_set op_hdf5_decl_set(op_hdf5_file file, char const *name);
+op_map op_hdf5_decl_map(op_hdf5_file file, op_set from, op_set to, int dim,
+                        char const *name);
+op_dat op_hdf5_decl_dat(op_hdf5_file file, op_set set, int dim,
+                        char const *type, char const *name);
+void op_hdf5_use_partition(op_hdf5_file file, char const *part_file);
+void op_hdf5_close(op_hdf5_file file);
+void op_dump_partition_hdf5(char const *file_name);
+
 void op_get_const_hdf5(char const *name, int dim, char const *type,
                        char *const_data, char const *file_name);
 
 void op_dump_to_hdf5(char const *file_name);
+void op_dump_to_hdf5_async(char const *file_name);
+int op_dump_to_hdf5_test();
+void op_dump_to_hdf5_wait();
+
+void op_hdf5_stream_open(char const *file_name, int cadence);
+void op_hdf5_stream_dat(op_dat dat);
+void op_hdf5_stream_step(int step);
+void op_hdf5_stream_close();
+
 void op_write_const_hdf5(char const *name, int dim, char const *type,
                          char *const_data, char const *file_name);
 
@@ -62,6 +62,7 @@ extern Double_linked_list OP_dat_list;
 extern op_kernel *OP_kernels;
 extern double OP_plan_time;
 extern int OP_auto_soa;
+extern int OP_realloc;
 
 /*
  * declaration of C routines wrapping lower layer implementations (e.g. CUDA,
@@ -101,6 +102,10 @@ void op_upload_all();
 
 void op_fetch_data_idx_char(op_dat, char *, int, int);
 
+int op_fetch_data_owned_char(op_dat, char *, int *);
+
+void op_fetch_data_range_char(op_dat, char *, int, int);
+
 void op_exit();
 
 void op_timing_output();
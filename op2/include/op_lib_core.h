@@ -53,6 +53,21 @@
 #define OP2_ALIGNMENT 64
 #endif
 
+/* alignment of op_malloc'd blocks, including op_dat storage */
+#ifndef OP_DAT_ALIGN
+#define OP_DAT_ALIGN OP2_ALIGNMENT
+#endif
+
+/* blocks at least this large are huge page aligned when OP_huge_pages is set */
+#ifndef OP_HUGE_PAGE_SIZE
+#define OP_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+/* default size of the blocks an op_arena carves its allocations from */
+#ifndef OP_ARENA_BLOCK_SIZE
+#define OP_ARENA_BLOCK_SIZE (64 * 1024)
+#endif
+
 /*
  * essential typedefs
  */
@@ -83,6 +98,14 @@ extern int OP_hybrid_gpu;
 extern int OP_maps_base_index;
 extern int OP_mpi_test_frequency;
 extern int OP_partial_exchange;
+extern int OP_huge_pages;
+extern int OP_part_hierarchical;
+extern int OP_shm_halo;
+extern int OP_diff_halo;
+extern int OP_hdf5_chunk;
+extern int OP_hdf5_deflate;
+extern int OP_hdf5_cache;
+extern int OP_io_stream;
 
 /*
  * enum list for op_par_loop
@@ -201,6 +224,20 @@ struct op_dat_entry_core {
 
 typedef struct op_dat_entry_core op_dat_entry;
 
+/* bump allocator for long-lived runtime metadata (plans, halo lists) */
+typedef struct op_arena_block_core op_arena_block_core;
+
+typedef struct {
+  op_arena_block_core *blocks; /* chain of blocks, most recent first */
+  size_t block_size;           /* minimum size of a newly obtained block */
+  size_t used;                 /* bytes handed out */
+  size_t reserved;             /* bytes obtained from op_malloc */
+  int nallocs;                 /* number of allocations served */
+  int nblocks;                 /* number of blocks obtained */
+} op_arena_core;
+
+typedef op_arena_core *op_arena;
+
 typedef TAILQ_HEAD(, op_dat_entry_core) Double_linked_list;
 
 /*
@@ -233,14 +270,29 @@ extern "C" {
 
 void op_init_core(int, char **, int);
 
+/* OP_HDF5_ASYNC given as an argument or environment variable; read before
+   op_init_core, as the MPI back-ends need it to initialise MPI */
+int op_hdf5_async_requested(int, char **);
+
 void op_exit_core(void);
 
+/* hooks run at the start of op_exit, before any data is freed, latest
+   registered first; used by the I/O libraries to finish writes in flight */
+void op_register_exit_hook(void (*hook)(void));
+
+void op_exit_hooks_core(void);
+
 op_set op_decl_set_core(int, char const *);
 
 op_map op_decl_map_core(op_set, op_set, int, int *, char const *);
 
 op_dat op_decl_dat_core(op_set, int, char const *, int, char *, char const *);
 
+op_map op_decl_map_adopt_core(op_set, op_set, int, int *, char const *);
+
+op_dat op_decl_dat_adopt_core(op_set, int, char const *, int, char *,
+                              char const *);
+
 op_dat op_decl_dat_temp_core(op_set, int, char const *, int, char *,
                              char const *);
 
@@ -281,6 +333,10 @@ void op_timers_core(double *cpu, double *et);
 
 void op_dump_dat(op_dat data);
 
+int op_fetch_data_owned_core(op_dat dat, char *usr_ptr, int *g_index);
+
+void op_fetch_data_range_core(op_dat dat, char *usr_ptr, int low, int high);
+
 void op_print_dat_to_binfile_core(op_dat dat, const char *file_name);
 
 void op_print_dat_to_txtfile_core(op_dat dat, const char *file_name);
@@ -365,6 +421,19 @@ void op_gpi_reduce_bool(op_arg *args, bool *data);
 void op_partition(const char *lib_name, const char *lib_routine,
                   op_set prime_set, op_map prime_map, op_dat coords);
 
+void op_repartition(const char *lib_name, const char *lib_routine,
+                    op_set prime_set, op_map prime_map, op_dat coords);
+
+void op_partition_checkpoint(const char *file_name);
+
+void op_partition_restart(const char *file_name);
+
+void op_partition_report();
+
+void op_partition_weights(op_dat weights, op_map map);
+
+void op_partition_loop_weights(const char *kernel_name, op_map map);
+
 /*******************************************************************************
 * Other partitioning related routine prototypes
 *******************************************************************************/
@@ -400,6 +469,11 @@ void *op_realloc(void *ptr, size_t size);
 void op_free(void *ptr);
 void *op_calloc(size_t num, size_t size);
 
+op_arena op_arena_create(size_t block_size);
+void *op_arena_alloc(op_arena arena, size_t size);
+void *op_arena_calloc(op_arena arena, size_t num, size_t size);
+void op_arena_destroy(op_arena arena);
+
 void deviceSync();
 
 #ifdef __cplusplus
@@ -198,6 +198,16 @@ void op_fetch_data_idx(op_dat dat, T *usr_ptr, int low, int high) {
   op_fetch_data_idx_char(dat, (char *)usr_ptr, low, high);
 }
 
+template <class T>
+int op_fetch_data_owned(op_dat dat, T *usr_ptr, int *g_index) {
+  return op_fetch_data_owned_char(dat, (char *)usr_ptr, g_index);
+}
+
+template <class T>
+void op_fetch_data_range(op_dat dat, T *usr_ptr, int low, int high) {
+  op_fetch_data_range_char(dat, (char *)usr_ptr, low, high);
+}
+
 //
 // wrapper functions to handle MPI global reductions
 //
@@ -62,6 +62,8 @@
 /** extern variables for halo creation and exchange**/
 extern MPI_Comm OP_MPI_WORLD;
 extern MPI_Comm OP_MPI_GLOBAL;
+/** duplicate of OP_MPI_WORLD for the messages of op_fetch_data_range **/
+extern MPI_Comm OP_MPI_FETCH_WORLD;
 
 #endif /* OP_MPI_CORE_NOMPI */
 // Structs that don't need the MPI include
@@ -79,6 +81,9 @@ typedef struct {
   int *ranks;
   // number of MPI neighbors to be exported to or imported from
   int ranks_size;
+  // the first inter_size neighbors are on other nodes, the rest share this
+  // node (all of them are counted as remote unless OP_part_hierarchical)
+  int inter_size;
   // displacements for the starting point of each rank's element list
   int *disps;
   // number of elements exported to or imported from each ranks
@@ -155,6 +160,9 @@ typedef struct {
 * Buffer struct used in non-blocking mpi halo sends/receives
 *******************************************************************************/
 
+// number of halo elements compared and sent together by OP_diff_halo
+#define OP_DIFF_BLOCK 16
+
 typedef struct {
   // buffer holding exec halo to be exported;
   char *buf_exec;
@@ -168,6 +176,22 @@ typedef struct {
   int s_num_req;
   // number of receive MPI_Reqests in flight at a given time for this op_dat
   int r_num_req;
+  // shared memory window holding dat->data, see op_halo_shm_create
+  MPI_Win shm_win;
+  // dat->data of each rank on this node, NULL if not in a window
+  char **shm_peer;
+  // number of halo exchanges of this op_dat through the window so far, and
+  // how many of them op_wait_all has completed
+  long shm_epoch;
+  long shm_waited;
+  // OP_diff_halo: staging for messages of a block bitmap plus the changed
+  // blocks, the import halo as last received, whether buf_exec/buf_nonexec
+  // still hold what was last sent, and whether op_wait_all has to unpack
+  char *diff_send;
+  char *diff_recv;
+  char *diff_halo;
+  int diff_synced;
+  int diff_pending;
 } op_mpi_buffer_core;
 
 typedef op_mpi_buffer_core *op_mpi_buffer;
@@ -179,6 +203,7 @@ typedef op_mpi_buffer_core *op_mpi_buffer;
 extern int OP_part_index;
 extern part *OP_part_list;
 extern int **orig_part_range;
+extern int *OP_shm_node_rank;
 
 /** export list on the device **/
 
@@ -274,6 +299,8 @@ void get_part_range(int **part_range, int my_rank, int comm_size,
 int get_partition(int global_index, int *part_range, int *local_index,
                   int comm_size);
 
+void get_node_ids(int *node_id, int my_rank, int comm_size, MPI_Comm Comm);
+
 int get_global_index(int local_index, int partition, int *part_range,
                      int comm_size);
 
@@ -304,8 +331,26 @@ void op_halo_permap_create();
 
 void op_halo_destroy();
 
+void op_halo_permap_destroy();
+
+void op_halo_shm_create();
+
+void op_halo_shm_destroy();
+
+void op_halo_shm_begin(op_dat dat);
+
+void op_halo_shm_push(op_dat dat);
+
+void op_halo_shm_wait(op_dat dat);
+
+void op_dat_shm_detach(op_dat dat);
+
 op_dat op_mpi_get_data(op_dat dat);
 
+int op_mpi_fetch_data_owned(op_dat dat, char *usr_ptr, int *g_index);
+
+void op_mpi_fetch_data_range(op_dat dat, char *usr_ptr, int low, int high);
+
 void fetch_data_hdf5(op_dat dat, char *usr_ptr, int low, int high);
 
 void mpi_timing_output();
@@ -316,6 +361,8 @@ void print_dat_to_txtfile_mpi(op_dat dat, const char *file_name);
 
 void print_dat_to_binfile_mpi(op_dat dat, const char *file_name);
 
+void print_dat_to_binfile_mpi_stream(op_dat dat, const char *file_name);
+
 void op_mpi_put_data(op_dat dat);
 
 void op_mpi_init(int argc, char **argv, int diags, MPI_Fint global,
@@ -332,6 +379,8 @@ void op_mv_halo_list_device();
 void partition(const char *lib_name, const char *lib_routine, op_set prime_set,
                op_map prime_map, op_dat coords);
 
+void partition_restart(const char *file_name);
+
 /******************************************************************************
 * Custom partitioning wrapper prototypes
 *******************************************************************************/
@@ -340,8 +389,12 @@ void op_partition_random(op_set primary_set);
 
 void op_partition_external(op_set primary_set, op_dat partvec);
 
+void op_partition_preload(op_set set, int *g_index, int block_size);
+
 void op_partition_inertial(op_dat x);
 
+void op_partition_sfc(op_dat x, int hilbert);
+
 
 #ifdef HAVE_PARMETIS
 /*******************************************************************************
@@ -85,6 +85,7 @@ typedef struct {
   float transfer;    /* bytes of data transfer per kernel call */
   float transfer2;   /* bytes of cache line per kernel call */
   int count;         /* number of times called */
+  op_arena arena;    /* storage for the arrays above, freed in op_rt_exit */
 } op_plan;
 
 extern op_plan *OP_plans;
@@ -6,6 +6,7 @@
 
 #include "op_lib_cpp.h"
 #include <utility>
+#include <type_traits>
 
 #ifdef HAVE_GPI
 #include "op_lib_core.h"
@@ -35,6 +36,11 @@ template <size_t... Is> struct build_indices<0, Is...> : indices<Is...> {};
 static int blank_args_size = 512;
 static char *blank_args = (char *)op_malloc(blank_args_size);
 
+// scratch space for the pointer arrays handed to the kernel for vector
+// (idx < -1) arguments; only grows, so steady-state loops do not allocate
+static int vec_args_size = 0;
+static char **vec_args = NULL;
+
 inline void op_arg_set(int n, op_arg arg, char **p_arg, int halo) {
   *p_arg = arg.data;
 
@@ -52,8 +58,9 @@ inline void op_arg_set(int n, op_arg arg, char **p_arg, int halo) {
 }
 
 inline void op_arg_copy_in(int n, op_arg arg, char **p_arg) {
+  const int *map_row = arg.map->map + n * arg.map->dim;
   for (int i = 0; i < -1 * arg.idx; ++i)
-    p_arg[i] = arg.data + arg.map->map[i + n * arg.map->dim] * arg.size;
+    p_arg[i] = arg.data + map_row[i] * arg.size;
 }
 
 inline void op_args_check(op_set set, int nargs, op_arg *args, int *ninds,
@@ -62,7 +69,65 @@ inline void op_args_check(op_set set, int nargs, op_arg *args, int *ninds,
     op_arg_check(set, n, args[n], ninds, name);
 }
 
+// returns 1 if every op_dat argument is accessed through the identity mapping,
+// i.e. the loop touches no halo data and can run as a plain strided loop
+inline int op_args_direct(int nargs, op_arg *args) {
+  for (int n = 0; n < nargs; n++) {
+    if (args[n].argtype != OP_ARG_DAT)
+      continue;
+    if (args[n].idx < -1 || (args[n].opt && args[n].map != NULL))
+      return 0;
+  }
+  return 1;
+}
+
 #if __cplusplus >= 201103L
+//
+// kernels taking a pointer-to-pointer argument (OP_ALL vector args) can never
+// be run by the direct loop below, which lets the compiler drop that path
+//
+template <typename... T> struct op_kernel_has_vec_arg;
+template <> struct op_kernel_has_vec_arg<> {
+  static constexpr bool value = false;
+};
+template <typename T, typename... Ts> struct op_kernel_has_vec_arg<T, Ts...> {
+  static constexpr bool value =
+      std::is_pointer<T>::value || op_kernel_has_vec_arg<Ts...>::value;
+};
+
+//
+// direct loop execution: all op_dat arguments use the identity mapping, so
+// there is no halo to wait for and the argument pointers are simply advanced
+// by a fixed stride per element
+//
+template <typename... T, size_t... I>
+void op_par_loop_direct(indices<I...>, void (*kernel)(T *...), int n_upper,
+                        op_arg *args) {
+  char *p_a[sizeof...(T)] = {args[I].data...};
+  const int stride[sizeof...(T)] = {
+      (args[I].argtype == OP_ARG_DAT ? args[I].size : 0)...};
+
+  for (int n = 0; n < n_upper; n++) {
+    kernel(((T *)p_a[I])...);
+    (void)std::initializer_list<int>{(p_a[I] += stride[I], 0)...};
+  }
+}
+
+//
+// executes elements [n_start, n_end) of an indirect loop; halo switches global
+// reductions to the blank_args scratch space for redundantly executed elements
+//
+template <typename... T, size_t... I>
+void op_par_loop_range(indices<I...>, void (*kernel)(T *...), char **p_a,
+                       op_arg *args, int n_start, int n_end, int halo) {
+  for (int n = n_start; n < n_end; n++) {
+    (void)std::initializer_list<int>{
+        (args[I].idx < -1 ? (op_arg_copy_in(n, args[I], (char **)p_a[I]), 0)
+                          : (op_arg_set(n, args[I], &p_a[I], halo), 0))...};
+    kernel(((T *)p_a[I])...);
+  }
+}
+
 //
 // op_par_loop routine implementation with index sequence
 //
@@ -78,20 +143,32 @@ void op_par_loop_impl(indices<I...>, void (*kernel)(T *...), char const *name,
   //N is the number of arguments
   constexpr int N = sizeof...(OPARG);
 
-  // Create array for arguments 
-  char *p_a[N] = {((arguments.idx < -1)
-                       ? (char *)malloc(-1 * arguments.idx * sizeof(T))
-                       : nullptr)...};
-
   // Array of arguments
   op_arg args[N] = {arguments...};
-  
+
+  // number of kernel pointers needed by each vector argument
+  const int vec_dim[N] = {(arguments.idx < -1 ? -1 * arguments.idx : 0)...};
+  int vec_total = 0;
+  for (int i = 0; i < N; i++)
+    vec_total += vec_dim[i];
+  if (vec_total > vec_args_size) {
+    vec_args_size = vec_total;
+    op_free(vec_args);
+    vec_args = (char **)op_malloc(vec_args_size * sizeof(char *));
+  }
+
+  // Create array for arguments, vector arguments point into vec_args
+  char *p_a[N];
+  for (int i = 0, off = 0; i < N; off += vec_dim[i], i++)
+    p_a[i] = vec_dim[i] ? (char *)&vec_args[off] : nullptr;
+
   // allocate scratch mememory to do double counting in indirect reduction
-  (void)std::initializer_list<char *>{
-      ((arguments.argtype == OP_ARG_GBL && arguments.size > blank_args_size)
-           ? (blank_args_size = arguments.size,
-              blank_args = (char *)op_malloc(blank_args_size))
-           : nullptr)...};
+  for (int i = 0; i < N; i++)
+    if (args[i].argtype == OP_ARG_GBL && args[i].size > blank_args_size) {
+      blank_args_size = args[i].size;
+      op_free(blank_args);
+      blank_args = (char *)op_malloc(blank_args_size);
+    }
   // consistency checks
   int ninds = 0;
   if (OP_diags > 0)
@@ -114,33 +191,24 @@ void op_par_loop_impl(indices<I...>, void (*kernel)(T *...), char const *name,
   int n_upper = op_mpi_halo_exchanges(set, N, args);
 #endif /* HAVE_GPI */
 
-  // loop over set elements
-  int halo = 0;
-
-  for (int n = 0; n < n_upper; n++) {
-    if (n == set->core_size){
-#ifdef HAVE_GPI
-      op_gpi_waitall_args(20, args);
-#else
-      op_mpi_wait_all(20, args);
-#endif /* HAVE_GPI */
-    
-    } 
-    if (n == set->size)
-      halo = 1;
-    (void)std::initializer_list<int>{
-        (arguments.idx < -1 ? (op_arg_copy_in(n, arguments, (char **)p_a[I]), 0)
-                            : (op_arg_set(n, arguments, &p_a[I], halo), 0))...};
-    kernel(((T *)p_a[I])...);
-  }
-
-  if (n_upper == set->core_size || n_upper == 0)
+  if (!op_kernel_has_vec_arg<T...>::value && op_args_direct(N, args)) {
+    // direct loop, no halo exchange was started
+    op_par_loop_direct(indices<I...>{}, kernel, n_upper, args);
+  } else {
+    // core elements need no halo data, so run them while messages are in
+    // flight, then the owned non-core and finally the exec halo elements
+    op_par_loop_range(indices<I...>{}, kernel, p_a, args, 0, set->core_size,
+                      0);
 #ifdef HAVE_GPI
     op_gpi_waitall_args(N, args);
 #else
     op_mpi_wait_all(N, args);
 #endif /* HAVE_GPI */
-  
+    op_par_loop_range(indices<I...>{}, kernel, p_a, args, set->core_size,
+                      set->size, 0);
+    op_par_loop_range(indices<I...>{}, kernel, p_a, args, set->size, n_upper,
+                      1);
+  }
 
   // set dirty bit on datasets touched
   op_mpi_set_dirtybit(N, args); /* This IS_COMMON to both MPI/GPI */
@@ -163,11 +231,6 @@ void op_par_loop_impl(indices<I...>, void (*kernel)(T *...), char const *name,
 #else
   op_comm_perf_time(name, wall_t2 - wall_t1);
 #endif /* COMM_PERF*/
-
-  (void)std::initializer_list<int>{
-      (arguments.idx < -1 ? free(p_a[I]), 0 : 0)...};
-
-
 }
 //
 // op_par_loop routine wrapper to create index sequence
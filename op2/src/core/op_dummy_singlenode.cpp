@@ -196,6 +196,31 @@ void op_partition_ptr(const char *lib_name, const char *lib_routine,
   (void)prime_map;
   (void)coords;
 }
+
+void op_repartition(const char *lib_name, const char *lib_routine,
+                    op_set prime_set, op_map prime_map, op_dat coords) {
+  (void)lib_name;
+  (void)lib_routine;
+  (void)prime_set;
+  (void)prime_map;
+  (void)coords;
+}
+
+void op_partition_checkpoint(const char *file_name) { (void)file_name; }
+
+void op_partition_restart(const char *file_name) { (void)file_name; }
+
+void op_partition_report() {}
+
+void op_partition_weights(op_dat weights, op_map map) {
+  (void)weights;
+  (void)map;
+}
+
+void op_partition_loop_weights(const char *kernel_name, op_map map) {
+  (void)kernel_name;
+  (void)map;
+}
 void op_renumber(op_map base) { (void)base; }
 
 void op_renumber_ptr(int *ptr){};
@@ -37,7 +37,9 @@
 
 #include "op_lib_core.h"
 #include <malloc.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 
 /*
@@ -58,6 +60,12 @@ int OP_set_index = 0, OP_set_max = 0, OP_map_index = 0, OP_map_max = 0,
 
 int OP_mpi_test_frequency = 1<<30;
 int OP_partial_exchange = 0;
+int OP_huge_pages = 0;
+int OP_part_hierarchical = 0;
+int OP_shm_halo = 0;
+int OP_diff_halo = 0;
+int OP_hdf5_chunk = 0, OP_hdf5_deflate = 0, OP_hdf5_cache = 0;
+int OP_io_stream = 0;
 /*
  * Lists of sets, maps and dats declared in OP2 programs
  */
@@ -68,6 +76,13 @@ int **OP_map_ptr_list = NULL;
 Double_linked_list OP_dat_list; /*Head of the double linked list*/
 op_kernel *OP_kernels;
 
+/*
+ * Totals over all live op_arenas, reported by op_diagnostic_output
+ */
+
+static int OP_arena_count = 0, OP_arena_blocks = 0, OP_arena_allocs = 0;
+static size_t OP_arena_used = 0, OP_arena_reserved = 0;
+
 const char *doublestr = "double";
 const char *floatstr = "float";
 const char *intstr = "int";
@@ -186,6 +201,51 @@ void op_set_args(int argc, char *argv) {
     OP_partial_exchange = 1;
     op_printf("\n Enabling partial MPI halo exchanges\n");
   }
+  pch = strstr(argv, "OP_NODE_PARTITION");
+  if (pch != NULL) {
+    // OP_NODE_PARTITION=n takes n consecutive ranks as one node instead of
+    // asking the MPI library which ranks share memory
+    OP_part_hierarchical = pch[17] == '=' ? MAX(atoi(pch + 18), 1) : 1;
+    op_printf("\n Enabling node-aware hierarchical partitioning\n");
+  }
+  pch = strstr(argv, "OP_SHM_HALO");
+  if (pch != NULL) {
+    OP_shm_halo = 1;
+    op_printf("\n Enabling shared memory halo exchanges within a node\n");
+  }
+  pch = strstr(argv, "OP_DIFF_HALO");
+  if (pch != NULL) {
+    OP_diff_halo = 1;
+    op_printf("\n Enabling differential halo exchanges\n");
+  }
+  pch = strstr(argv, "OP_HDF5_CHUNK");
+  if (pch != NULL) {
+    // OP_HDF5_CHUNK=n asks for chunks of about n KiB, 1 MiB otherwise
+    OP_hdf5_chunk = pch[13] == '=' ? MAX(atoi(pch + 14), 1) : 1024;
+    op_printf("\n OP_hdf5_chunk  = %d KiB \n", OP_hdf5_chunk);
+  }
+  pch = strstr(argv, "OP_HDF5_DEFLATE");
+  if (pch != NULL) {
+    OP_hdf5_deflate = pch[15] == '=' ? MIN(MAX(atoi(pch + 16), 1), 9) : 4;
+    op_printf("\n OP_hdf5_deflate  = %d \n", OP_hdf5_deflate);
+  }
+  pch = strstr(argv, "OP_HDF5_CACHE=");
+  if (pch != NULL) {
+    OP_hdf5_cache = MAX(atoi(pch + 14), 0);
+    op_printf("\n OP_hdf5_cache  = %d MiB \n", OP_hdf5_cache);
+  }
+  pch = strstr(argv, "OP_IO_STREAM");
+  if (pch != NULL) {
+    // OP_IO_STREAM=n writes dats to files through buffers of n MiB, 64 MiB
+    // otherwise
+    OP_io_stream = pch[12] == '=' ? MAX(atoi(pch + 13), 1) : 64;
+    op_printf("\n OP_io_stream  = %d MiB \n", OP_io_stream);
+  }
+  pch = strstr(argv, "OP_HUGE_PAGES");
+  if (pch != NULL) {
+    OP_huge_pages = 1;
+    op_printf("\n Enabling transparent huge pages for large allocations\n");
+  }
   pch = strstr(argv, "OP_HYBRID_BALANCE=");
   if (pch != NULL) {
     strncpy(temp, pch, 25);
@@ -229,6 +289,49 @@ void op_init_core(int argc, char **argv, int diags) {
     op_printf("\n Enabling Automatic AoS->SoA Conversion\n");
   }
 
+  if (getenv("OP_NODE_PARTITION")) {
+    OP_part_hierarchical = MAX(atoi(getenv("OP_NODE_PARTITION")), 1);
+    op_printf("\n Enabling node-aware hierarchical partitioning\n");
+  }
+
+  if (getenv("OP_SHM_HALO")) {
+    OP_shm_halo = 1;
+    op_printf("\n Enabling shared memory halo exchanges within a node\n");
+  }
+
+  if (getenv("OP_DIFF_HALO")) {
+    OP_diff_halo = 1;
+    op_printf("\n Enabling differential halo exchanges\n");
+  }
+
+  if (getenv("OP_HDF5_CHUNK")) {
+    int kib = atoi(getenv("OP_HDF5_CHUNK"));
+    OP_hdf5_chunk = kib > 0 ? kib : 1024;
+    op_printf("\n OP_hdf5_chunk  = %d KiB \n", OP_hdf5_chunk);
+  }
+
+  if (getenv("OP_HDF5_DEFLATE")) {
+    int level = atoi(getenv("OP_HDF5_DEFLATE"));
+    OP_hdf5_deflate = level > 0 ? MIN(level, 9) : 4;
+    op_printf("\n OP_hdf5_deflate  = %d \n", OP_hdf5_deflate);
+  }
+
+  if (getenv("OP_HDF5_CACHE")) {
+    OP_hdf5_cache = MAX(atoi(getenv("OP_HDF5_CACHE")), 0);
+    op_printf("\n OP_hdf5_cache  = %d MiB \n", OP_hdf5_cache);
+  }
+
+  if (getenv("OP_IO_STREAM")) {
+    int mib = atoi(getenv("OP_IO_STREAM"));
+    OP_io_stream = mib > 0 ? mib : 64;
+    op_printf("\n OP_io_stream  = %d MiB \n", OP_io_stream);
+  }
+
+  if (getenv("OP_HUGE_PAGES")) {
+    OP_huge_pages = 1;
+    op_printf("\n Enabling transparent huge pages for large allocations\n");
+  }
+
 #ifdef OP_BLOCK_SIZE
   OP_block_size = OP_BLOCK_SIZE;
 #endif
@@ -308,8 +411,7 @@ op_set op_decl_set_core(int size, char const *name) {
   return set;
 }
 
-op_map op_decl_map_core(op_set from, op_set to, int dim, int *imap,
-                        char const *name) {
+static void check_map_decl(op_set from, op_set to, int dim, char const *name) {
   if (from == NULL) {
     printf(" op_decl_map error -- invalid 'from' set for map %s\n", name);
     exit(-1);
@@ -324,6 +426,11 @@ op_map op_decl_map_core(op_set from, op_set to, int dim, int *imap,
     printf("op_decl_map error -- negative/zero dimension for map %s\n", name);
     exit(-1);
   }
+}
+
+op_map op_decl_map_core(op_set from, op_set to, int dim, int *imap,
+                        char const *name) {
+  check_map_decl(from, to, dim, name);
 
   // check if map points to elements within set range
   // check_map(name, from, to, dim, imap);
@@ -347,6 +454,32 @@ op_map op_decl_map_core(op_set from, op_set to, int dim, int *imap,
   }
   memcpy(m, imap, sizeof(int) * from->size * dim);
 
+  if (OP_maps_base_index == 1) {
+    // convert imap to 0 based indexing -- i.e. reduce each imap value by 1
+    for (int i = 0; i < from->size * dim; i++)
+      // imap[i]--;
+      m[i]--; // modify op2's copy
+  }
+  // else OP_maps_base_index == 0
+  // do nothing -- aready in C style indexing
+
+  op_map map = op_decl_map_adopt_core(from, to, dim, m, name);
+  OP_map_ptr_list[map->index] = imap; // m;
+  // printf("MAP %s (idx %d) ptr %p data ptr %p\n", map->name, map->index, map,
+  // imap);
+
+  return map;
+}
+
+/*
+ * declare a map on storage that OP2 takes over as it is, without copying
+ * (e.g. pages of a memory-mapped mesh file); imap must already be 0 based
+ */
+
+op_map op_decl_map_adopt_core(op_set from, op_set to, int dim, int *imap,
+                              char const *name) {
+  check_map_decl(from, to, dim, name);
+
   if (OP_map_index == OP_map_max) {
     OP_map_max += 10;
     OP_map_list =
@@ -359,29 +492,18 @@ op_map op_decl_map_core(op_set from, op_set to, int dim, int *imap,
     }
   }
 
-  if (OP_maps_base_index == 1) {
-    // convert imap to 0 based indexing -- i.e. reduce each imap value by 1
-    for (int i = 0; i < from->size * dim; i++)
-      // imap[i]--;
-      m[i]--; // modify op2's copy
-  }
-  // else OP_maps_base_index == 0
-  // do nothing -- aready in C style indexing
-
   op_map map = (op_map)op_malloc(sizeof(op_map_core));
   map->index = OP_map_index;
   map->from = from;
   map->to = to;
   map->dim = dim;
-  map->map = m; // use op2's copy instead of imap;
+  map->map = imap;
   map->map_d = NULL;
   map->name = copy_str(name);
   map->user_managed = 1;
 
   OP_map_list[OP_map_index++] = map;
-  OP_map_ptr_list[OP_map_index - 1] = imap; // m;
-  // printf("MAP %s (idx %d) ptr %p data ptr %p\n", map->name, map->index, map,
-  // imap);
+  OP_map_ptr_list[OP_map_index - 1] = imap;
 
   return map;
 }
@@ -461,6 +583,20 @@ op_dat op_decl_dat_core(op_set set, int dim, char const *type, int size,
   return dat;
 }
 
+/*
+ * declare a dat on storage that OP2 takes over as it is, without copying,
+ * whatever OP_realloc is set to
+ */
+
+op_dat op_decl_dat_adopt_core(op_set set, int dim, char const *type, int size,
+                              char *data, char const *name) {
+  int realloc_flag = OP_realloc;
+  OP_realloc = 0;
+  op_dat dat = op_decl_dat_core(set, dim, type, size, data, name);
+  OP_realloc = realloc_flag;
+  return dat;
+}
+
 /*
  * temporary dats
  */
@@ -513,6 +649,37 @@ void op_decl_const_core(int dim, char const *type, int typeSize, char *data,
   (void)name;
 }
 
+int op_hdf5_async_requested(int argc, char **argv) {
+  if (getenv("OP_HDF5_ASYNC"))
+    return 1;
+  for (int n = 1; n < argc; n++)
+    if (strstr(argv[n], "OP_HDF5_ASYNC") != NULL)
+      return 1;
+  return 0;
+}
+
+#define OP_MAX_EXIT_HOOKS 8
+
+static void (*OP_exit_hooks[OP_MAX_EXIT_HOOKS])(void);
+static int OP_exit_hook_index = 0;
+
+void op_register_exit_hook(void (*hook)(void)) {
+  for (int i = 0; i < OP_exit_hook_index; i++)
+    if (OP_exit_hooks[i] == hook)
+      return;
+  if (OP_exit_hook_index == OP_MAX_EXIT_HOOKS) {
+    printf("op_register_exit_hook error -- more than %d hooks\n",
+           OP_MAX_EXIT_HOOKS);
+    exit(-1);
+  }
+  OP_exit_hooks[OP_exit_hook_index++] = hook;
+}
+
+void op_exit_hooks_core() {
+  while (OP_exit_hook_index > 0)
+    OP_exit_hooks[--OP_exit_hook_index]();
+}
+
 void op_exit_core() {
   // free storage and pointers for sets, maps and data
 
@@ -817,6 +984,14 @@ void op_diagnostic_output() {
       printf("%10s %10d %10s\n", (item->dat)->name, (item->dat)->dim,
              (item->dat)->set->name);
     }
+
+    if (OP_arena_count > 0) {
+      printf("\n    arenas     blocks     allocs   used(KB)  reserved(KB)\n");
+      printf("  -----------------------------------------------------\n");
+      printf("%10d %10d %10d %10.1f %13.1f\n", OP_arena_count,
+             OP_arena_blocks, OP_arena_allocs, OP_arena_used / 1024.0,
+             OP_arena_reserved / 1024.0);
+    }
     printf("\n");
   }
 }
@@ -997,6 +1172,33 @@ void op_dump_dat(op_dat data) {
   fflush(stdout);
 }
 
+/*
+ * fetch the elements of a dat held by this process with their global indices,
+ * and a range of elements by global index; on a single node these are the
+ * same as op_fetch_data and op_fetch_data_idx
+ */
+
+int op_fetch_data_owned_core(op_dat dat, char *usr_ptr, int *g_index) {
+  if (usr_ptr != NULL)
+    memcpy(usr_ptr, dat->data, (size_t)dat->set->size * dat->size);
+  if (g_index != NULL)
+    for (int i = 0; i < dat->set->size; i++)
+      g_index[i] = i;
+  return dat->set->size;
+}
+
+void op_fetch_data_range_core(op_dat dat, char *usr_ptr, int low, int high) {
+  if (high < low)
+    return;
+  if (low < 0 || high > dat->set->size - 1) {
+    printf("op_fetch_data: Indices not within range of elements held in %s\n",
+           dat->name);
+    exit(2);
+  }
+  memcpy(usr_ptr, &dat->data[(size_t)low * dat->size],
+         (size_t)(high - low + 1) * dat->size);
+}
+
 void op_print_dat_to_binfile_core(op_dat dat, const char *file_name) {
   size_t elem_size = dat->dim;
   int count = dat->set->size;
@@ -1101,55 +1303,167 @@ void set_maps_base(int base) {
   }
 }
 
-void *op_malloc(size_t size) {
-#ifdef __INTEL_COMPILER
-  // return _mm_malloc(size, OP2_ALIGNMENT);
-  return memalign(OP2_ALIGNMENT, size);
-#else
-  return malloc(size);
+/*
+ * Memory allocation: blocks are OP_DAT_ALIGN aligned, and with OP_huge_pages
+ * set, blocks of at least OP_HUGE_PAGE_SIZE are huge page aligned and advised
+ * for transparent huge pages. All blocks can be released with free().
+ */
+static size_t op_alloc_alignment(size_t size) {
+  if (OP_huge_pages && size >= OP_HUGE_PAGE_SIZE)
+    return OP_HUGE_PAGE_SIZE;
+  return OP_DAT_ALIGN;
+}
+
+static void *op_aligned_alloc(size_t size) {
+  size_t align = op_alloc_alignment(size);
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, align, size) != 0)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  if (align == OP_HUGE_PAGE_SIZE)
+    madvise(ptr, size, MADV_HUGEPAGE);
 #endif
+  return ptr;
 }
 
+void *op_malloc(size_t size) { return op_aligned_alloc(size); }
+
 // malloc to be exposed in Fortran API for use with Cray pointers
 void op_malloc2(void **data, int *size){
     *data =(void *) malloc(*size);
 }
 
 void *op_calloc(size_t num, size_t size) {
-#ifdef __INTEL_COMPILER
-  // void * ptr = _mm_malloc(num*size, OP2_ALIGNMENT);
-  void *ptr = memalign(OP2_ALIGNMENT, num * size);
-  memset(ptr, 0, num * size);
+  void *ptr = op_aligned_alloc(num * size);
+  if (ptr != NULL)
+    memset(ptr, 0, num * size);
   return ptr;
-#else
-  return calloc(num, size);
-#endif
 }
 
 void *op_realloc(void *ptr, size_t size) {
-#ifdef __INTEL_COMPILER
   void *newptr = realloc(ptr, size);
-  if (((unsigned long)newptr & (OP2_ALIGNMENT - 1)) != 0) {
-    void *newptr2 = memalign(OP2_ALIGNMENT, size);
-    // void *newptr2 = _mm_malloc(size, OP2_ALIGNMENT);
+  if (newptr == NULL || size == 0)
+    return newptr;
+  size_t align = op_alloc_alignment(size);
+  if (((uintptr_t)newptr & (align - 1)) != 0) {
+    // realloc has already moved the caller's data, so there is no block to
+    // hand back unchanged if it cannot be realigned
+    void *newptr2 = op_aligned_alloc(size);
+    if (newptr2 == NULL) {
+      printf("op_realloc error -- could not realign %zu bytes to %zu\n", size,
+             align);
+      exit(-1);
+    }
     memcpy(newptr2, newptr, size);
     free(newptr);
     return newptr2;
-  } else {
-    return newptr;
   }
-#else
-  return realloc(ptr, size);
+#ifdef MADV_HUGEPAGE
+  if (align == OP_HUGE_PAGE_SIZE)
+    madvise(newptr, size, MADV_HUGEPAGE);
 #endif
+  return newptr;
 }
 
-void op_free(void *ptr) {
-#ifdef __INTEL_COMPILER
-  //_mm_free(ptr);
-  free(ptr);
-#else
-  free(ptr);
-#endif
+void op_free(void *ptr) { free(ptr); }
+
+/*
+ * Arena allocation: requests are carved, cache line aligned, out of large
+ * op_malloc'd blocks, and are only given back all at once by
+ * op_arena_destroy. Used for metadata that lives until op_exit, such as
+ * execution plans and halo lists, to avoid many small scattered allocations.
+ */
+struct op_arena_block_core {
+  op_arena_block_core *next;
+  size_t size; /* usable bytes following the header */
+  size_t used; /* bytes handed out from this block */
+};
+
+#define OP_ARENA_HEADER ROUND_UP_64(sizeof(op_arena_block_core))
+
+op_arena op_arena_create(size_t block_size) {
+  op_arena arena = (op_arena)op_malloc(sizeof(op_arena_core));
+  if (arena == NULL) {
+    printf(" op_arena_create error -- error allocating memory\n");
+    exit(-1);
+  }
+  arena->blocks = NULL;
+  arena->block_size =
+      ROUND_UP_64(block_size > 0 ? block_size : OP_ARENA_BLOCK_SIZE);
+  arena->used = 0;
+  arena->reserved = 0;
+  arena->nallocs = 0;
+  arena->nblocks = 0;
+  OP_arena_count++;
+  return arena;
+}
+
+static op_arena_block_core *op_arena_new_block(op_arena arena, size_t size) {
+  op_arena_block_core *block =
+      (op_arena_block_core *)op_malloc(OP_ARENA_HEADER + size);
+  if (block == NULL) {
+    printf(" op_arena error -- error allocating block of %zu bytes\n", size);
+    exit(-1);
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  arena->reserved += OP_ARENA_HEADER + size;
+  arena->nblocks++;
+  OP_arena_reserved += OP_ARENA_HEADER + size;
+  OP_arena_blocks++;
+  return block;
+}
+
+void *op_arena_alloc(op_arena arena, size_t size) {
+  size = ROUND_UP_64(size);
+  op_arena_block_core *block = arena->blocks;
+  if (block == NULL || block->size - block->used < size) {
+    if (block != NULL && size > arena->block_size / 2) {
+      // large request: give it a block of its own behind the current one,
+      // whose remaining space is still usable by later small requests
+      op_arena_block_core *fresh = op_arena_new_block(arena, size);
+      fresh->next = block->next;
+      block->next = fresh;
+      block = fresh;
+    } else {
+      op_arena_block_core *fresh =
+          op_arena_new_block(arena, MAX(size, arena->block_size));
+      fresh->next = block;
+      arena->blocks = fresh;
+      block = fresh;
+    }
+  }
+  void *ptr = (char *)block + OP_ARENA_HEADER + block->used;
+  block->used += size;
+  arena->used += size;
+  arena->nallocs++;
+  OP_arena_used += size;
+  OP_arena_allocs++;
+  return ptr;
+}
+
+void *op_arena_calloc(op_arena arena, size_t num, size_t size) {
+  void *ptr = op_arena_alloc(arena, num * size);
+  memset(ptr, 0, num * size);
+  return ptr;
+}
+
+void op_arena_destroy(op_arena arena) {
+  if (arena == NULL)
+    return;
+  op_arena_block_core *block = arena->blocks;
+  while (block != NULL) {
+    op_arena_block_core *next = block->next;
+    op_free(block);
+    block = next;
+  }
+  OP_arena_count--;
+  OP_arena_blocks -= arena->nblocks;
+  OP_arena_allocs -= arena->nallocs;
+  OP_arena_used -= arena->used;
+  OP_arena_reserved -= arena->reserved;
+  op_free(arena);
 }
 
 op_arg op_arg_dat(op_dat, int, op_map, int, char const *, op_access);
@@ -52,33 +52,8 @@ extern int OP_kern_max;
 
 void op_rt_exit() {
   /* free storage for plans */
-  for (int ip = 0; ip < OP_plan_index; ip++) {
-    free(OP_plans[ip].dats);
-    free(OP_plans[ip].idxs);
-    free(OP_plans[ip].maps);
-    free(OP_plans[ip].accs);
-    free(OP_plans[ip].optflags);
-    free(OP_plans[ip].inds_staged);
-    free(OP_plans[ip].nthrcol);
-    free(OP_plans[ip].thrcol);
-    free(OP_plans[ip].offset);
-    free(OP_plans[ip].ind_offs);
-    free(OP_plans[ip].ind_sizes);
-    free(OP_plans[ip].nelems);
-    free(OP_plans[ip].blkmap);
-    free(OP_plans[ip].ind_map);
-    free(OP_plans[ip].ind_maps);
-    free(OP_plans[ip].nindirect);
-    free(OP_plans[ip].loc_map);
-    free(OP_plans[ip].loc_maps);
-    free(OP_plans[ip].ncolblk);
-    free(OP_plans[ip].nsharedCol);
-    op_free(OP_plans[ip].col_reord);
-    if (OP_plans[ip].col_offsets != NULL) {
-      op_free(OP_plans[ip].col_offsets[0]);
-      op_free(OP_plans[ip].col_offsets);
-    }
-  }
+  for (int ip = 0; ip < OP_plan_index; ip++)
+    op_arena_destroy(OP_plans[ip].arena);
 
   OP_plan_index = 0;
   OP_plan_max = 0;
@@ -461,31 +436,57 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
     }
   }
 
-  /* allocate memory for new execution plan and store input arguments */
+  /* allocate memory for new execution plan and store input arguments; all
+     plan arrays come from one arena, sized up front for everything except
+     the colour offsets and shared memory sizes worked out later */
 
-  OP_plans[ip].dats = (op_dat *)op_malloc(nargs * sizeof(op_dat));
-  OP_plans[ip].idxs = (int *)op_malloc(nargs * sizeof(int));
-  OP_plans[ip].optflags = (int *)op_malloc(nargs * sizeof(int));
-  OP_plans[ip].maps = (op_map *)op_malloc(nargs * sizeof(op_map));
-  OP_plans[ip].accs = (op_access *)op_malloc(nargs * sizeof(op_access));
-  OP_plans[ip].inds_staged = NULL;
-
-  OP_plans[ip].nthrcol = (int *)op_malloc(nblocks * sizeof(int));
-  OP_plans[ip].thrcol = (int *)op_malloc(exec_length * sizeof(int));
-  OP_plans[ip].col_reord = (int *)op_malloc((exec_length + 16) * sizeof(int));
+  int nargs_staged = 0;
+  for (int m = 0; m < nargs; m++)
+    if (inds_staged[m] >= 0)
+      nargs_staged++;
+
+  size_t plan_bytes =
+      (size_t)nargs * (sizeof(op_dat) + sizeof(op_map) + sizeof(op_access) +
+                       sizeof(short *) + 3 * sizeof(int)) +
+      (size_t)ninds_staged * sizeof(int *) + (size_t)ninds * sizeof(int) +
+      (size_t)nblocks * (4 + 2 * ninds_staged) * sizeof(int) +
+      (size_t)(3 * exec_length + 16) * sizeof(int) +
+      (size_t)nargs_staged * exec_length * (sizeof(int) + sizeof(short)) +
+      20 * 64; /* alignment of each array */
+  op_arena arena = op_arena_create(plan_bytes);
+  OP_plans[ip].arena = arena;
+
+  OP_plans[ip].dats = (op_dat *)op_arena_alloc(arena, nargs * sizeof(op_dat));
+  OP_plans[ip].idxs = (int *)op_arena_alloc(arena, nargs * sizeof(int));
+  OP_plans[ip].optflags = (int *)op_arena_alloc(arena, nargs * sizeof(int));
+  OP_plans[ip].maps = (op_map *)op_arena_alloc(arena, nargs * sizeof(op_map));
+  OP_plans[ip].accs =
+      (op_access *)op_arena_alloc(arena, nargs * sizeof(op_access));
+  OP_plans[ip].inds_staged = (int *)op_arena_alloc(arena, nargs * sizeof(int));
+  memcpy(OP_plans[ip].inds_staged, inds_staged, nargs * sizeof(int));
+  op_free(inds_staged);
+  inds_staged = OP_plans[ip].inds_staged;
+
+  OP_plans[ip].nthrcol = (int *)op_arena_alloc(arena, nblocks * sizeof(int));
+  OP_plans[ip].thrcol =
+      (int *)op_arena_alloc(arena, exec_length * sizeof(int));
+  OP_plans[ip].col_reord =
+      (int *)op_arena_alloc(arena, (exec_length + 16) * sizeof(int));
   OP_plans[ip].col_offsets = NULL;
-  OP_plans[ip].offset = (int *)op_malloc(nblocks * sizeof(int));
-  OP_plans[ip].ind_maps = (int **)op_malloc(ninds_staged * sizeof(int *));
+  OP_plans[ip].offset = (int *)op_arena_alloc(arena, nblocks * sizeof(int));
+  OP_plans[ip].ind_maps =
+      (int **)op_arena_alloc(arena, ninds_staged * sizeof(int *));
   OP_plans[ip].ind_offs =
-      (int *)op_malloc(nblocks * ninds_staged * sizeof(int));
+      (int *)op_arena_alloc(arena, nblocks * ninds_staged * sizeof(int));
   OP_plans[ip].ind_sizes =
-      (int *)op_malloc(nblocks * ninds_staged * sizeof(int));
-  OP_plans[ip].nindirect = (int *)op_calloc(ninds, sizeof(int));
-  OP_plans[ip].loc_maps = (short **)op_malloc(nargs * sizeof(short *));
-  OP_plans[ip].nelems = (int *)op_malloc(nblocks * sizeof(int));
-  OP_plans[ip].ncolblk =
-      (int *)op_calloc(exec_length, sizeof(int)); /* max possibly needed */
-  OP_plans[ip].blkmap = (int *)op_calloc(nblocks, sizeof(int));
+      (int *)op_arena_alloc(arena, nblocks * ninds_staged * sizeof(int));
+  OP_plans[ip].nindirect = (int *)op_arena_calloc(arena, ninds, sizeof(int));
+  OP_plans[ip].loc_maps =
+      (short **)op_arena_alloc(arena, nargs * sizeof(short *));
+  OP_plans[ip].nelems = (int *)op_arena_alloc(arena, nblocks * sizeof(int));
+  OP_plans[ip].ncolblk = (int *)op_arena_calloc(
+      arena, exec_length, sizeof(int)); /* max possibly needed */
+  OP_plans[ip].blkmap = (int *)op_arena_calloc(arena, nblocks, sizeof(int));
 
   int *offsets = (int *)op_malloc((ninds_staged + 1) * sizeof(int));
   offsets[0] = 0;
@@ -496,8 +497,8 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
         count++;
     offsets[m + 1] = offsets[m] + count;
   }
-  OP_plans[ip].ind_map =
-      (int *)op_malloc(offsets[ninds_staged] * exec_length * sizeof(int));
+  OP_plans[ip].ind_map = (int *)op_arena_alloc(
+      arena, offsets[ninds_staged] * exec_length * sizeof(int));
   for (int m = 0; m < ninds_staged; m++) {
     OP_plans[ip].ind_maps[m] = &OP_plans[ip].ind_map[exec_length * offsets[m]];
   }
@@ -518,7 +519,7 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
   }
 
   OP_plans[ip].loc_map =
-      (short *)op_malloc(counter * exec_length * sizeof(short));
+      (short *)op_arena_alloc(arena, counter * exec_length * sizeof(short));
   counter = 0;
   for (int m = 0; m < nargs; m++) {
     if (inds_staged[m] >= 0) {
@@ -537,7 +538,6 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
   OP_plans[ip].ncolors_core = 0;
   OP_plans[ip].ncolors_owned = 0;
   OP_plans[ip].count = 1;
-  OP_plans[ip].inds_staged = inds_staged;
 
   OP_plan_index++;
 
@@ -749,8 +749,10 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
       size_of_col_offsets += OP_plans[ip].nthrcol[b] + 1;
     }
     // allocate
-    OP_plans[ip].col_offsets = (int **)op_malloc(nblocks * sizeof(int *));
-    int *col_offsets = (int *)op_malloc(size_of_col_offsets * sizeof(int *));
+    OP_plans[ip].col_offsets =
+        (int **)op_arena_alloc(arena, nblocks * sizeof(int *));
+    int *col_offsets =
+        (int *)op_arena_alloc(arena, size_of_col_offsets * sizeof(int));
 
     size_of_col_offsets = 0;
     op_keyvalue *kv = (op_keyvalue *)op_malloc(bsize * sizeof(op_keyvalue));
@@ -913,7 +915,8 @@ op_plan *op_plan_core(char const *name, op_set set, int part_size, int nargs,
   /* reorder blocks by color? */
 
   /* work out shared memory requirements */
-  OP_plans[ip].nsharedCol = (int *)op_malloc(ncolors * sizeof(int));
+  OP_plans[ip].nsharedCol =
+      (int *)op_arena_alloc(arena, ncolors * sizeof(int));
   float total_shared = 0;
   for (int col = 0; col < ncolors; col++) {
     OP_plans[ip].nsharedCol[col] = 0;
@@ -249,6 +249,7 @@ void op_renumber_ptr(int *ptr){};
 int getHybridGPU() { return OP_hybrid_gpu; }
 
 void op_exit() {
+  op_exit_hooks_core(); // finishes I/O in flight
   op_cuda_exit(); // frees dat_d memory
   op_rt_exit();   // frees plan memory
   op_exit_core(); // frees lib core variables
@@ -358,6 +359,16 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
          (high + 1) * dat->size);
 }
 
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  op_cuda_get_data(dat);
+  return op_fetch_data_owned_core(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  op_cuda_get_data(dat);
+  op_fetch_data_range_core(dat, usr_ptr, low, high);
+}
+
 // Dummy for cuda compile
 
 typedef struct {
@@ -105,6 +105,18 @@ void op_mvHostToDevice(void **map, int size) {
   *map = tmp;
 }
 
+// plan arrays live in the plan's arena until op_rt_exit, so they are copied
+// to the device without releasing the host copy
+static void op_mvPlanToDevice(void **map, int size) {
+  if (!OP_hybrid_gpu || size == 0)
+    return;
+  void *tmp;
+  cutilSafeCall(cudaMalloc(&tmp, size));
+  cutilSafeCall(cudaMemcpy(tmp, *map, size, cudaMemcpyHostToDevice));
+  cutilSafeCall(cudaDeviceSynchronize());
+  *map = tmp;
+}
+
 void op_cpHostToDevice(void **data_d, void **data_h, int size) {
   if (!OP_hybrid_gpu)
     return;
@@ -153,7 +165,7 @@ op_plan *op_plan_get_stage_upload(char const *name, op_set set, int part_size,
           count++;
       offsets[m + 1] = offsets[m] + count;
     }
-    op_mvHostToDevice((void **)&(plan->ind_map),
+    op_mvPlanToDevice((void **)&(plan->ind_map),
                       offsets[plan->ninds_staged] * set_size * sizeof(int));
     for (int m = 0; m < plan->ninds_staged; m++) {
       plan->ind_maps[m] = &plan->ind_map[set_size * offsets[m]];
@@ -164,7 +176,7 @@ op_plan *op_plan_get_stage_upload(char const *name, op_set set, int part_size,
     for (int m = 0; m < nargs; m++)
       if (plan->loc_maps[m] != NULL)
         counter++;
-    op_mvHostToDevice((void **)&(plan->loc_map),
+    op_mvPlanToDevice((void **)&(plan->loc_map),
                       sizeof(short) * counter * set_size);
     counter = 0;
     for (int m = 0; m < nargs; m++)
@@ -173,18 +185,18 @@ op_plan *op_plan_get_stage_upload(char const *name, op_set set, int part_size,
         counter++;
       }
 
-    op_mvHostToDevice((void **)&(plan->ind_sizes),
+    op_mvPlanToDevice((void **)&(plan->ind_sizes),
                       sizeof(int) * plan->nblocks * plan->ninds_staged);
-    op_mvHostToDevice((void **)&(plan->ind_offs),
+    op_mvPlanToDevice((void **)&(plan->ind_offs),
                       sizeof(int) * plan->nblocks * plan->ninds_staged);
-    op_mvHostToDevice((void **)&(plan->nthrcol), sizeof(int) * plan->nblocks);
-    op_mvHostToDevice((void **)&(plan->thrcol), sizeof(int) * set_size);
-    op_mvHostToDevice((void **)&(plan->col_reord), sizeof(int) * set_size);
-    op_mvHostToDevice((void **)&(plan->offset), sizeof(int) * plan->nblocks);
+    op_mvPlanToDevice((void **)&(plan->nthrcol), sizeof(int) * plan->nblocks);
+    op_mvPlanToDevice((void **)&(plan->thrcol), sizeof(int) * set_size);
+    op_mvPlanToDevice((void **)&(plan->col_reord), sizeof(int) * set_size);
+    op_mvPlanToDevice((void **)&(plan->offset), sizeof(int) * plan->nblocks);
     plan->offset_d = plan->offset;
-    op_mvHostToDevice((void **)&(plan->nelems), sizeof(int) * plan->nblocks);
+    op_mvPlanToDevice((void **)&(plan->nelems), sizeof(int) * plan->nblocks);
     plan->nelems_d = plan->nelems;
-    op_mvHostToDevice((void **)&(plan->blkmap), sizeof(int) * plan->nblocks);
+    op_mvPlanToDevice((void **)&(plan->blkmap), sizeof(int) * plan->nblocks);
     plan->blkmap_d = plan->blkmap;
   }
 
@@ -523,6 +535,31 @@ void op_partition_ptr(const char *lib_name, const char *lib_routine,
   (void)coords;
 }
 
+void op_repartition(const char *lib_name, const char *lib_routine,
+                    op_set prime_set, op_map prime_map, op_dat coords) {
+  (void)lib_name;
+  (void)lib_routine;
+  (void)prime_set;
+  (void)prime_map;
+  (void)coords;
+}
+
+void op_partition_checkpoint(const char *file_name) { (void)file_name; }
+
+void op_partition_restart(const char *file_name) { (void)file_name; }
+
+void op_partition_report() {}
+
+void op_partition_weights(op_dat weights, op_map map) {
+  (void)weights;
+  (void)map;
+}
+
+void op_partition_loop_weights(const char *kernel_name, op_map map) {
+  (void)kernel_name;
+  (void)map;
+}
+
 void op_partition_reverse() {}
 
 void op_compute_moment(double t, double *first, double *second) {
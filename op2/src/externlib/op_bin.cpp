@@ -0,0 +1,295 @@
+/*
+ * Open source copyright declaration based on BSD open source template:
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * This file is part of the OP2 distribution.
+ *
+ * Copyright (c) 2011, Mike Giles and others. Please see the AUTHORS file in
+ * the main source directory for a full list of copyright holders.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of Mike Giles may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Mike Giles ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Mike Giles BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * op_bin.cpp
+ *
+ * Implements a native binary mesh format for the OP2 single node back-ends.
+ * The file is mapped into memory and the op_maps and op_dats declared from
+ * it use the mapped pages as their storage, so nothing is read or copied
+ * until a loop touches it.
+ *
+ * Layout: an op_bin_header, a table of op_bin_entry (one per op_set, op_map
+ * and op_dat), then the data of each op_map and op_dat starting on a page
+ * boundary (OP_BIN_ALIGN). Maps are stored 0 based, dats in OP2's element
+ * (AoS) order.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <op_lib_c.h>
+#include <op_lib_core.h>
+#include <op_bin.h>
+
+#define OP_BIN_MAGIC "OP2BIN"
+#define OP_BIN_VERSION 1
+#define OP_BIN_ALIGN 4096
+#define OP_BIN_NAME_LEN 64
+#define OP_BIN_TYPE_LEN 16
+
+typedef struct {
+  char magic[8];
+  int version;
+  int n; // number of entries
+} op_bin_header;
+
+typedef struct {
+  char name[OP_BIN_NAME_LEN];
+  char type[OP_BIN_TYPE_LEN]; // "set" for op_sets
+  long long rows;             // size of the set (the from set for maps)
+  int dim;
+  int elem_bytes;   // bytes per component
+  long long offset; // of the data from the start of the file
+} op_bin_entry;
+
+struct op_bin_file_core {
+  char *name;
+  char *base;
+  size_t bytes;
+  int n;
+  op_bin_entry *entries;
+  int adopted; // pages in use by op_maps or op_dats, keep the mapping
+};
+
+static long long bin_align(long long offset) {
+  return (offset + OP_BIN_ALIGN - 1) / OP_BIN_ALIGN * OP_BIN_ALIGN;
+}
+
+static void bin_fill_entry(op_bin_entry *e, char const *name,
+                           char const *type, long long rows, int dim,
+                           int elem_bytes) {
+  if (strlen(name) >= OP_BIN_NAME_LEN || strlen(type) >= OP_BIN_TYPE_LEN) {
+    printf("op_dump_to_bin error -- name or type of %s too long\n", name);
+    exit(-1);
+  }
+  memset(e, 0, sizeof(op_bin_entry));
+  strcpy(e->name, name);
+  strcpy(e->type, type);
+  e->rows = rows;
+  e->dim = dim;
+  e->elem_bytes = elem_bytes;
+}
+
+static op_bin_entry *bin_find(op_bin_file f, char const *name,
+                              char const *what) {
+  for (int i = 0; i < f->n; i++) {
+    if (strcmp(f->entries[i].name, name) == 0) {
+      op_bin_entry *e = &f->entries[i];
+      if (strcmp(what, "set") != 0 &&
+          (e->offset % OP_BIN_ALIGN != 0 ||
+           (size_t)(e->offset + e->rows * e->dim * e->elem_bytes) >
+               f->bytes)) {
+        printf("op_bin_decl_%s error -- data of %s outside of file %s\n",
+               what, name, f->name);
+        exit(-1);
+      }
+      return e;
+    }
+  }
+  printf("op_bin_decl_%s error -- %s not found in file %s\n", what, name,
+         f->name);
+  exit(-1);
+}
+
+op_bin_file op_bin_open(char const *file) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    printf("op_bin_open error -- could not open file %s\n", file);
+    exit(-1);
+  }
+  struct stat st;
+  fstat(fd, &st);
+  size_t bytes = (size_t)st.st_size;
+  if (bytes < sizeof(op_bin_header)) {
+    printf("op_bin_open error -- %s is not an OP2 binary mesh file\n", file);
+    exit(-1);
+  }
+
+  // private writable mapping: pages stay shared with the page cache until an
+  // op_par_loop writes to a dat, which then gets its own copy of the page
+  char *base = (char *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                            fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("op_bin_open error -- could not map file %s\n", file);
+    exit(-1);
+  }
+
+  op_bin_header *h = (op_bin_header *)base;
+  if (strncmp(h->magic, OP_BIN_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != OP_BIN_VERSION ||
+      sizeof(op_bin_header) + (size_t)h->n * sizeof(op_bin_entry) > bytes) {
+    printf("op_bin_open error -- %s is not an OP2 binary mesh file of "
+           "version %d\n", file, OP_BIN_VERSION);
+    exit(-1);
+  }
+
+  op_bin_file f = (op_bin_file)op_malloc(sizeof(struct op_bin_file_core));
+  f->name = strdup(file);
+  f->base = base;
+  f->bytes = bytes;
+  f->n = h->n;
+  f->entries = (op_bin_entry *)(base + sizeof(op_bin_header));
+  f->adopted = 0;
+  return f;
+}
+
+op_set op_bin_decl_set(op_bin_file f, char const *name) {
+  op_bin_entry *e = bin_find(f, name, "set");
+  if (strcmp(e->type, "set") != 0) {
+    printf("op_bin_decl_set error -- %s in file %s is not a set\n", name,
+           f->name);
+    exit(-1);
+  }
+  return op_decl_set((int)e->rows, name);
+}
+
+op_map op_bin_decl_map(op_bin_file f, op_set from, op_set to, int dim,
+                       char const *name) {
+  op_bin_entry *e = bin_find(f, name, "map");
+  if (strcmp(e->type, "int") != 0 || e->elem_bytes != sizeof(int)) {
+    printf("op_bin_decl_map error -- map %s in file %s is of type %s\n", name,
+           f->name, e->type);
+    exit(-1);
+  }
+  if (from == NULL || e->rows != from->size || e->dim != dim) {
+    printf("op_bin_decl_map error -- map %s in file %s has %lld elements of "
+           "dim %d\n", name, f->name, e->rows, e->dim);
+    exit(-1);
+  }
+  f->adopted = 1;
+  return op_decl_map_adopt_core(from, to, dim, (int *)(f->base + e->offset),
+                                name);
+}
+
+op_dat op_bin_decl_dat(op_bin_file f, op_set set, int dim, char const *type,
+                       char const *name) {
+  op_bin_entry *e = bin_find(f, name, "dat");
+  if (strcmp(e->type, type) != 0) {
+    printf("op_bin_decl_dat error -- dat %s in file %s is of type %s, not "
+           "%s\n", name, f->name, e->type, type);
+    exit(-1);
+  }
+  if (set == NULL || e->rows != set->size || e->dim != dim) {
+    printf("op_bin_decl_dat error -- dat %s in file %s has %lld elements of "
+           "dim %d\n", name, f->name, e->rows, e->dim);
+    exit(-1);
+  }
+  f->adopted = 1;
+  return op_decl_dat_adopt_core(set, dim, type, e->elem_bytes,
+                                f->base + e->offset, name);
+}
+
+void op_bin_close(op_bin_file f) {
+  // the mapping lives on until the process exits if any of it was declared
+  if (!f->adopted)
+    munmap(f->base, f->bytes);
+  free(f->name);
+  free(f);
+}
+
+void op_dump_to_bin(char const *file_name) {
+  op_printf("Writing to %s\n", file_name);
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  op_timers(&cpu_t1, &wall_t1);
+
+  int n_dats = 0;
+  op_dat_entry *item;
+  TAILQ_FOREACH(item, &OP_dat_list, entries) { n_dats++; }
+
+  op_bin_header h;
+  memset(&h, 0, sizeof(op_bin_header));
+  strcpy(h.magic, OP_BIN_MAGIC);
+  h.version = OP_BIN_VERSION;
+  h.n = OP_set_index + OP_map_index + n_dats;
+
+  op_bin_entry *entries =
+      (op_bin_entry *)op_malloc((size_t)h.n * sizeof(op_bin_entry));
+  char **data = (char **)op_malloc((size_t)h.n * sizeof(char *));
+
+  int n = 0;
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    bin_fill_entry(&entries[n], set->name, "set", set->size, 0, 0);
+    data[n++] = NULL;
+  }
+  for (int m = 0; m < OP_map_index; m++) {
+    op_map map = OP_map_list[m];
+    bin_fill_entry(&entries[n], map->name, "int", map->from->size, map->dim,
+                   sizeof(int));
+    data[n++] = (char *)map->map;
+  }
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    op_dat dat = item->dat;
+    bin_fill_entry(&entries[n], dat->name, dat->type, dat->set->size,
+                   dat->dim, dat->size / dat->dim);
+    data[n++] = dat->data;
+  }
+
+  long long offset =
+      bin_align(sizeof(op_bin_header) + (long long)h.n * sizeof(op_bin_entry));
+  for (int i = 0; i < h.n; i++) {
+    if (data[i] == NULL)
+      continue;
+    entries[i].offset = offset;
+    offset = bin_align(offset + entries[i].rows * entries[i].dim *
+                                    entries[i].elem_bytes);
+  }
+
+  FILE *fp = fopen(file_name, "wb");
+  if (fp == NULL) {
+    printf("op_dump_to_bin error -- can't open file %s\n", file_name);
+    exit(-1);
+  }
+  int ok = fwrite(&h, sizeof(op_bin_header), 1, fp) == 1 &&
+           fwrite(entries, sizeof(op_bin_entry), h.n, fp) == (size_t)h.n;
+  for (int i = 0; ok && i < h.n; i++) {
+    if (data[i] == NULL)
+      continue;
+    size_t bytes = (size_t)entries[i].rows * entries[i].dim *
+                   entries[i].elem_bytes;
+    ok = fseeko(fp, entries[i].offset, SEEK_SET) == 0 &&
+         fwrite(data[i], 1, bytes, fp) == bytes;
+  }
+  if (fclose(fp) != 0 || !ok) {
+    printf("op_dump_to_bin error -- error writing to file %s\n", file_name);
+    exit(-1);
+  }
+  free(entries);
+  free(data);
+
+  op_timers(&cpu_t2, &wall_t2);
+  op_printf("Max binary mesh write time = %lf\n\n", wall_t2 - wall_t1);
+}
@@ -42,6 +42,13 @@
 // hdf5 header
 #include <hdf5.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
 #include <op_lib_c.h>
 #include <op_lib_core.h>
 #include <op_rt_support.h>
@@ -55,41 +62,290 @@
 
 #include "op_hdf5_common.cpp"
 
-/*******************************************************************************
-* Routine to read an op_set from an hdf5 file
-*******************************************************************************/
-
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-op_set op_decl_set_hdf5(char const *file, char const *name) {
-  // HDF5 APIs definitions
-  hid_t file_id; // file identifier
-  hid_t dset_id; // dataset identifier
+/*******************************************************************************
+* Routines to open an hdf5 file once for reading several op_sets, op_maps and
+* op_dats, sharing the property lists between the reads
+*******************************************************************************/
+
+struct op_hdf5_file_core {
+  char *name;
+  hid_t file_id;
+  hid_t dapl; // chunk cache, see op_hdf5_access_plist
+};
 
+op_hdf5_file op_hdf5_open(char const *file) {
+  op_dump_to_hdf5_wait();
   if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_set_hdf5()\n",
-              file);
+    op_printf("File %s does not exist .... aborting op_hdf5_open()\n", file);
     exit(2);
   }
 
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, H5P_DEFAULT);
+  op_hdf5_file f = (op_hdf5_file)xmalloc(sizeof(struct op_hdf5_file_core));
+  f->file_id = H5Fopen(file, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (f->file_id < 0) {
+    op_printf("Could not obtain read access to file '%s'\n", file);
+    exit(2);
+  }
+  f->dapl = op_hdf5_access_plist();
+  f->name = strdup(file);
+  return f;
+}
+
+/* with a single process the sets are always read whole */
+void op_hdf5_use_partition(op_hdf5_file f, char const *part_file) {
+  (void)f;
+  (void)part_file;
+}
+
+void op_hdf5_close(op_hdf5_file f) {
+  op_dump_to_hdf5_wait();
+  op_hdf5_close_plist(f->dapl);
+  H5Fclose(f->file_id);
+  free(f->name);
+  op_free(f);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/*******************************************************************************
+* Routines to read a whole dataset with several threads, converting it from
+* the type it is stored in to the type of the op_map or op_dat
+*******************************************************************************/
+
+enum {
+  OP_HDF5_T_DOUBLE,
+  OP_HDF5_T_FLOAT,
+  OP_HDF5_T_INT,
+  OP_HDF5_T_LONG,
+  OP_HDF5_T_LLONG,
+  OP_HDF5_T_OTHER
+};
+
+// bytes read by each thread from the file before converting them
+#define OP_HDF5_READ_BLOCK (1 << 20)
+
+static int op_hdf5_type_code(hid_t type) {
+  if (H5Tequal(type, H5T_NATIVE_DOUBLE) > 0)
+    return OP_HDF5_T_DOUBLE;
+  if (H5Tequal(type, H5T_NATIVE_FLOAT) > 0)
+    return OP_HDF5_T_FLOAT;
+  if (H5Tequal(type, H5T_NATIVE_INT) > 0)
+    return OP_HDF5_T_INT;
+  if (H5Tequal(type, H5T_NATIVE_LONG) > 0)
+    return OP_HDF5_T_LONG;
+  if (H5Tequal(type, H5T_NATIVE_LLONG) > 0)
+    return OP_HDF5_T_LLONG;
+  return OP_HDF5_T_OTHER;
+}
+
+typedef void (*op_hdf5_convert_fn)(const char *, char *, size_t);
+
+/* a plain loop over distinct types, which the compiler vectorises */
+template <typename S, typename D>
+static void op_hdf5_convert(const char *src, char *dst, size_t n) {
+  const S *__restrict__ s = (const S *)src;
+  D *__restrict__ d = (D *)dst;
+  for (size_t i = 0; i < n; i++)
+    d[i] = (D)s[i];
+}
+
+template <typename S> static op_hdf5_convert_fn op_hdf5_converter_from(int to) {
+  switch (to) {
+  case OP_HDF5_T_DOUBLE: return op_hdf5_convert<S, double>;
+  case OP_HDF5_T_FLOAT:  return op_hdf5_convert<S, float>;
+  case OP_HDF5_T_INT:    return op_hdf5_convert<S, int>;
+  case OP_HDF5_T_LONG:   return op_hdf5_convert<S, long>;
+  case OP_HDF5_T_LLONG:  return op_hdf5_convert<S, long long>;
+  }
+  return NULL;
+}
+
+static op_hdf5_convert_fn op_hdf5_converter(int from, int to) {
+  switch (from) {
+  case OP_HDF5_T_DOUBLE: return op_hdf5_converter_from<double>(to);
+  case OP_HDF5_T_FLOAT:  return op_hdf5_converter_from<float>(to);
+  case OP_HDF5_T_INT:    return op_hdf5_converter_from<int>(to);
+  case OP_HDF5_T_LONG:   return op_hdf5_converter_from<long>(to);
+  case OP_HDF5_T_LLONG:  return op_hdf5_converter_from<long long>(to);
+  }
+  return NULL;
+}
+
+/* OMP_NUM_THREADS threads (or one per core), but at least 4 MiB each */
+static int op_hdf5_read_threads(size_t bytes) {
+  int nthreads = std::thread::hardware_concurrency();
+  char *env = getenv("OMP_NUM_THREADS");
+  if (env != NULL && atoi(env) > 0)
+    nthreads = atoi(env);
+  size_t max_threads = bytes / (4 << 20);
+  if ((size_t)nthreads > max_threads)
+    nthreads = (int)max_threads;
+  return nthreads < 1 ? 1 : nthreads;
+}
+
+/* calls body(begin, end) on nthreads blocks of [0, n), the first one on the
+   calling thread */
+template <typename F>
+static void op_hdf5_parallel(size_t n, int nthreads, F body) {
+  std::vector<std::thread> threads;
+  for (int t = 1; t < nthreads; t++)
+    threads.emplace_back(body, n * t / nthreads, n * (t + 1) / nthreads);
+  body(0, n / nthreads);
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+}
+
+static int op_hdf5_pread(int fd, char *buf, size_t bytes, off_t offset) {
+  while (bytes > 0) {
+    ssize_t r = pread(fd, buf, bytes, offset);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+    buf += r;
+    bytes -= r;
+    offset += r;
+  }
+  return 0;
+}
+
+/* file offset of a dataset stored contiguously in the file, or -1 if it has
+   to be read through HDF5 (chunked, compressed, external or not written) */
+static off_t op_hdf5_contiguous_offset(op_hdf5_file f, hid_t dset_id) {
+  off_t offset = -1;
+  hid_t dcpl = H5Dget_create_plist(dset_id);
+  hid_t fcpl = H5Fget_create_plist(f->file_id);
+  hsize_t userblock = 0;
+  H5Pget_userblock(fcpl, &userblock);
+  if (H5Pget_layout(dcpl) == H5D_CONTIGUOUS && H5Pget_external_count(dcpl) == 0 &&
+      userblock == 0) {
+    haddr_t addr = H5Dget_offset(dset_id);
+    if (addr != HADDR_UNDEF)
+      offset = (off_t)addr;
+  }
+  H5Pclose(fcpl);
+  H5Pclose(dcpl);
+  return offset;
+}
+
+/* reads all n elements of a dataset into buf as mem_type.
+ * Datasets stored contiguously are read straight from the file by several
+ * threads, each reading and converting its own block of elements. Other
+ * layouts are read by HDF5 in the type they are stored in, and converted by
+ * several threads afterwards. Types other than the native ones OP2 uses are
+ * left to HDF5's conversion */
+static void op_hdf5_read_all(op_hdf5_file f, hid_t dset_id, size_t n,
+                             hid_t mem_type, char *buf) {
+  if (n == 0)
+    return;
+  int to = op_hdf5_type_code(mem_type);
+  size_t to_bytes = H5Tget_size(mem_type);
+
+  hid_t file_type = H5Dget_type(dset_id);
+  hid_t native_type = H5Tget_native_type(file_type, H5T_DIR_ASCEND);
+  int from = H5Tequal(file_type, native_type) > 0 ? op_hdf5_type_code(native_type)
+                                                  : OP_HDF5_T_OTHER;
+  size_t from_bytes = H5Tget_size(native_type);
+  H5Tclose(native_type);
+  H5Tclose(file_type);
+
+  op_hdf5_convert_fn convert = from == to ? NULL : op_hdf5_converter(from, to);
+  if (from == OP_HDF5_T_OTHER || to == OP_HDF5_T_OTHER ||
+      (from != to && convert == NULL)) {
+    H5Dread(dset_id, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+    return;
+  }
+
+  int nthreads = op_hdf5_read_threads(n * std::max(from_bytes, to_bytes));
+  off_t offset = op_hdf5_contiguous_offset(f, dset_id);
+  int fd = offset < 0 ? -1 : open(f->name, O_RDONLY);
+
+  if (fd >= 0) {
+    std::atomic<int> failed(0);
+    op_hdf5_parallel(n, nthreads, [&](size_t begin, size_t end) {
+      if (convert == NULL) {
+        if (op_hdf5_pread(fd, buf + begin * to_bytes, (end - begin) * to_bytes,
+                          offset + begin * from_bytes) != 0)
+          failed = 1;
+        return;
+      }
+      size_t block = OP_HDF5_READ_BLOCK / from_bytes;
+      char *scratch = (char *)xmalloc(block * from_bytes);
+      for (size_t i = begin; i < end && !failed; i += block) {
+        size_t m = std::min(block, end - i);
+        if (op_hdf5_pread(fd, scratch, m * from_bytes,
+                          offset + i * from_bytes) != 0) {
+          failed = 1;
+          break;
+        }
+        convert(scratch, buf + i * to_bytes, m);
+      }
+      free(scratch);
+    });
+    close(fd);
+    if (failed) {
+      op_printf("Could not read dataset from file '%s'\n", f->name);
+      exit(2);
+    }
+    return;
+  }
+
+  if (convert == NULL) {
+    H5Dread(dset_id, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+    return;
+  }
+  hid_t read_type = H5Dget_type(dset_id);
+  char *scratch = (char *)xmalloc(n * from_bytes);
+  H5Dread(dset_id, read_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, scratch);
+  H5Tclose(read_type);
+  op_hdf5_parallel(n, nthreads, [&](size_t begin, size_t end) {
+    convert(scratch + begin * from_bytes, buf + begin * to_bytes, end - begin);
+  });
+  free(scratch);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+* Routine to read an op_set from an hdf5 file
+*******************************************************************************/
+
+op_set op_hdf5_decl_set(op_hdf5_file f, char const *name) {
+  op_dump_to_hdf5_wait();
 
   // Create the dataset with default properties and close dataspace.
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  hid_t dset_id = H5Dopen(f->file_id, name, H5P_DEFAULT);
+  if (dset_id < 0) {
+    op_printf("Could not open dataset '%s' in file '%s'\n", name, f->name);
+    return NULL;
+  }
 
   int l_size = 0;
   // read data
   H5Dread(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &l_size);
 
   H5Dclose(dset_id);
-  H5Fclose(file_id);
 
   return op_decl_set(l_size, name);
 }
 
+op_set op_decl_set_hdf5(char const *file, char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_set set = op_hdf5_decl_set(f, name);
+  op_hdf5_close(f);
+  return set;
+}
+
 op_set op_decl_set_hdf5_infer_size(char const *file, char const *name, char const *set_dataset_name) {
+  op_dump_to_hdf5_wait();
   // HDF5 APIs definitions
   hid_t file_id; // file identifier
   hid_t dset_id; // dataset identifier
@@ -142,31 +398,25 @@ op_set op_decl_set_hdf5_infer_size(char const *file, char const *name, char cons
 * Routine to read an op_map from an hdf5 file
 *******************************************************************************/
 
-op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
+op_map op_hdf5_decl_map(op_hdf5_file f, op_set from, op_set to, int dim,
                         char const *name) {
+  op_dump_to_hdf5_wait();
+  char const *file = f->name;
   // HDF5 APIs definitions
-  hid_t file_id;   // file identifier
   hid_t dset_id;   // dataset identifier
   hid_t dataspace; // data space identifier
   herr_t status;
 
-  if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_map_hdf5()\n",
-              file);
-    exit(2);
-  }
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, H5P_DEFAULT);
-
   /* Save old error handler */
   H5E_auto_t old_func;
   void *old_client_data;
   H5error_off(&old_func, &old_client_data);
 
   /*open data set*/
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  dset_id = H5Dopen(f->file_id, name, f->dapl);
   if (dset_id < 0) {
     op_printf("op_map with name : %s not found in file : %s \n", name, file);
-    H5Fclose(file_id);
+    H5error_on(old_func, old_client_data);
     return NULL;
   }
 
@@ -197,29 +447,20 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   // Restore previous error handler .. report hdf5 error stack automatically
   H5error_on(old_func, old_client_data);
 
-  // Create the dataset with default properties and close dataspace.
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
   dataspace = H5Dget_space(dset_id);
 
-  // initialize data buffer and read data
-  int *map;
-  if (strcmp(typ, "int") == 0) {
-    map = (int *)xmalloc(sizeof(int) * g_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, map);
-  } else if (strcmp(typ, "long") == 0) {
-    map = (int *)xmalloc(sizeof(long) * g_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_LONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, map);
-  } else if (strcmp(typ, "long long") == 0) {
-    map = (int *)xmalloc(sizeof(long long) * g_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_LONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, map);
-  } else {
+  // initialize data buffer and read data, converting to int
+  if (strcmp(typ, "int") != 0 && strcmp(typ, "long") != 0 &&
+      strcmp(typ, "long long") != 0) {
     op_printf("Unknown type in file %s for map %s\n", file, name);
     exit(2);
   }
+  int *map = (int *)xmalloc(sizeof(int) * g_size * dim);
+  op_hdf5_read_all(f, dset_id, (size_t)g_size * dim, H5T_NATIVE_INT,
+                   (char *)map);
 
   H5Sclose(dataspace);
   H5Dclose(dset_id);
-  H5Fclose(file_id);
 
   free((char*)dset_props.type_str);
 
@@ -228,36 +469,37 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   return new_map;
 }
 
+op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
+                        char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_map map = op_hdf5_decl_map(f, from, to, dim, name);
+  op_hdf5_close(f);
+  return map;
+}
+
 /*******************************************************************************
 * Routine to read an op_dat from an hdf5 file
 *******************************************************************************/
 
-op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
+op_dat op_hdf5_decl_dat(op_hdf5_file f, op_set set, int dim, char const *type,
                         char const *name) {
+  op_dump_to_hdf5_wait();
+  char const *file = f->name;
   // HDF5 APIs definitions
-  hid_t file_id;   // file identifier
   hid_t dset_id;   // dataset identifier
   hid_t dataspace; // data space identifier
-  hid_t attr;      // attribute identifier
   herr_t status;
 
-  if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_dat_hdf5()\n",
-              file);
-    exit(2);
-  }
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, H5P_DEFAULT);
-
   /* Save old error handler */
   H5E_auto_t old_func;
   void *old_client_data;
   H5error_off(&old_func, &old_client_data);
 
   /*open data set*/
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  dset_id = H5Dopen(f->file_id, name, f->dapl);
   if (dset_id < 0) {
     op_printf("op_dat with name : %s not found in file : %s \n", name, file);
-    H5Fclose(file_id);
+    H5error_on(old_func, old_client_data);
     return NULL;
   }
 
@@ -268,6 +510,13 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
     exit(2);
   }
 
+  int g_size = dset_props.size;
+  if (set->size != g_size) {
+    op_printf("dat set size %d in file %s and size %d do not match \n",
+              g_size, file, set->size);
+    exit(2);
+  }
+
   int dat_dim = dset_props.dim;
   if (dat_dim != dim) {
     op_printf("dat.dim %d in file %s and dim %d do not match\n", dat_dim, file,
@@ -290,41 +539,17 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   dataspace = H5Dget_space(dset_id);
 
   // initialize data buffer and read in data
-  char *data;
-  if (strcmp(type, "double") == 0 || strcmp(type, "double:soa") == 0 ||
-      strcmp(type, "double precision") == 0 || strcmp(type, "real(8)") == 0) {
-    data = (char *)xmalloc(set->size * dim * sizeof(double));
-    H5Dread(dset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-    type_size = sizeof(double);
-
-  } else if (strcmp(type, "float") == 0 || strcmp(type, "float:soa") == 0 ||
-             strcmp(type, "real(4)") == 0 || strcmp(type, "real") == 0) {
-    data = (char *)xmalloc(set->size * dim * sizeof(float));
-    H5Dread(dset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-    type_size = sizeof(float);
-  } else if (strcmp(type, "int") == 0 || strcmp(type, "int:soa") == 0 ||
-             strcmp(type, "int(4)") == 0 || strcmp(type, "integer") == 0 ||
-             strcmp(type, "integer(4)") == 0) {
-    data = (char *)xmalloc(set->size * dim * sizeof(int));
-    H5Dread(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-    type_size = sizeof(int);
-  } else if (strcmp(type, "long") == 0 || strcmp(type, "long:soa") == 0) {
-    data = (char *)xmalloc(set->size * dim * sizeof(long));
-    H5Dread(dset_id, H5T_NATIVE_LONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-    type_size = sizeof(long);
-  } else if (strcmp(type, "long long") == 0 ||
-             strcmp(type, "long long:soa") == 0) {
-    data = (char *)xmalloc(set->size * dim * sizeof(long long));
-    H5Dread(dset_id, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-    type_size = sizeof(long long);
-  } else {
+  hid_t mem_type = op_hdf5_dat_type(type);
+  if (mem_type < 0) {
     op_printf("unknown type for dat\n");
     exit(2);
   }
+  type_size = H5Tget_size(mem_type);
+  char *data = (char *)xmalloc(set->size * dim * type_size);
+  op_hdf5_read_all(f, dset_id, (size_t)set->size * dim, mem_type, data);
 
   H5Sclose(dataspace);
   H5Dclose(dset_id);
-  H5Fclose(file_id);
 
   free((char*)dset_props.type_str);
 
@@ -333,11 +558,20 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   return new_dat;
 }
 
+op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
+                        char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_dat dat = op_hdf5_decl_dat(f, set, dim, type, name);
+  op_hdf5_close(f);
+  return dat;
+}
+
 /*******************************************************************************
 * Routine to write all to a named hdf5 file
 *******************************************************************************/
 
 void op_dump_to_hdf5(char const *file_name) {
+  op_dump_to_hdf5_wait();
   op_printf("Writing to %s\n", file_name);
 
   // declare timers
@@ -385,23 +619,26 @@ void op_dump_to_hdf5(char const *file_name) {
     dimsf[1] = map->dim;
     dataspace = H5Screate_simple(2, dimsf, NULL);
 
+    hid_t dcpl =
+        op_hdf5_create_plist(g_size, map->dim, sizeof(map->map[0]), 1, 1);
+
     // create map path
     create_path(map->name, file_id);
 
     // Create the dataset with default properties and write data
     if (sizeof(map->map[0]) == sizeof(int)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_INT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_INT, H5S_ALL, dataspace, H5P_DEFAULT,
                map->map);
     } else if (sizeof(map->map[0]) == sizeof(long)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_LONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LONG, H5S_ALL, dataspace, H5P_DEFAULT,
                map->map);
     } else if (sizeof(map->map[0]) == sizeof(long long)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_LLONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LLONG, H5S_ALL, dataspace, H5P_DEFAULT,
                map->map);
     } else {
@@ -410,6 +647,7 @@ void op_dump_to_hdf5(char const *file_name) {
     }
 
     H5Sclose(dataspace);
+    op_hdf5_close_plist(dcpl);
     H5Dclose(dset_id);
 
     /*attach attributes to map*/
@@ -476,6 +714,9 @@ void op_dump_to_hdf5(char const *file_name) {
     dimsf[1] = dat->dim;
     dataspace = H5Screate_simple(2, dimsf, NULL);
 
+    hid_t dcpl =
+        op_hdf5_create_plist(g_size, dat->dim, dat->size / dat->dim, 1, 0);
+
     // create dateset path
     create_path(dat->name, file_id);
 
@@ -485,7 +726,7 @@ void op_dump_to_hdf5(char const *file_name) {
         strcmp(dat->type, "double precision") == 0 ||
         strcmp(dat->type, "real(8)") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_DOUBLE, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, H5S_ALL, dataspace, H5P_DEFAULT,
                dat->data);
     } else if (strcmp(dat->type, "float") == 0 ||
@@ -493,7 +734,7 @@ void op_dump_to_hdf5(char const *file_name) {
                strcmp(dat->type, "real(4)") == 0 ||
                strcmp(dat->type, "real") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_FLOAT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_FLOAT, H5S_ALL, dataspace, H5P_DEFAULT,
                dat->data);
     } else if (strcmp(dat->type, "int") == 0 ||
@@ -502,19 +743,19 @@ void op_dump_to_hdf5(char const *file_name) {
                strcmp(dat->type, "integer") == 0 ||
                strcmp(dat->type, "integer(4)") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_INT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_INT, H5S_ALL, dataspace, H5P_DEFAULT,
                dat->data);
     } else if ((strcmp(dat->type, "long") == 0) ||
                (strcmp(dat->type, "long:soa") == 0)) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_LONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LONG, H5S_ALL, dataspace, H5P_DEFAULT,
                dat->data);
     } else if ((strcmp(dat->type, "long long") == 0) ||
                (strcmp(dat->type, "long long:soa") == 0)) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_LLONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LLONG, H5S_ALL, dataspace, H5P_DEFAULT,
                dat->data);
     } else {
@@ -523,6 +764,7 @@ void op_dump_to_hdf5(char const *file_name) {
     }
 
     H5Sclose(dataspace);
+    op_hdf5_close_plist(dcpl);
     H5Dclose(dset_id);
 
     /*attach attributes to dat*/
@@ -568,12 +810,117 @@ void op_dump_to_hdf5(char const *file_name) {
   op_timers(&cpu_t2, &wall_t2); // timer stop for hdf5 file write
 }
 
+/*******************************************************************************
+* Routine to write all to a named hdf5 file on a helper thread, the data is
+* copied first so the caller can carry on and change it
+*******************************************************************************/
+
+void op_dump_to_hdf5_async(char const *file_name) {
+  // only one dump is in flight at a time
+  op_dump_to_hdf5_wait();
+  op_printf("Writing to %s in the background\n", file_name);
+
+  op_hdf5_dump *dump = new op_hdf5_dump;
+  dump->file_name = strdup(file_name);
+  dump->fapl = H5Pcreate(H5P_FILE_ACCESS);
+  dump->dxpl = H5Pcreate(H5P_DATASET_XFER);
+  dump->nparts = 1;
+  dump->n = 0;
+  dump->entries = (op_hdf5_dump_entry *)xmalloc(
+      (OP_set_index + OP_map_index + OP_dat_index) * sizeof(op_hdf5_dump_entry));
+
+  for (int s = 0; s < OP_set_index; s++) {
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    memset(entry, 0, sizeof(op_hdf5_dump_entry));
+    entry->name = strdup(OP_set_list[s]->name);
+    entry->g_size = OP_set_list[s]->size;
+  }
+
+  for (int m = 0; m < OP_map_index; m++) {
+    op_map map = OP_map_list[m];
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    entry->name = strdup(map->name);
+    entry->type = strdup("int");
+    entry->type_len = 10;
+    entry->h5type = H5T_NATIVE_INT;
+    entry->dim = map->dim;
+    entry->is_map = 1;
+    entry->size = map->from->size;
+    entry->g_size = entry->count = map->from->size;
+    entry->offset = 0;
+    size_t bytes = (size_t)map->from->size * map->dim * sizeof(int);
+    entry->data = (char *)xmalloc(bytes);
+    memcpy(entry->data, map->map, bytes);
+  }
+
+  op_dat_entry *item;
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    op_dat dat = item->dat;
+    if (dat->size == 0 || dat->data == NULL)
+      continue;
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    entry->h5type = op_hdf5_dat_type(dat->type);
+    if (entry->h5type < 0) {
+      op_printf("Unknown type for data elements %s\n", dat->type);
+      exit(2);
+    }
+    entry->name = strdup(dat->name);
+    entry->type = strdup(dat->type);
+    entry->type_len = strlen(dat->type);
+    entry->dim = dat->dim;
+    entry->is_map = 0;
+    entry->size = dat->size;
+    entry->g_size = entry->count = dat->set->size;
+    entry->offset = 0;
+    size_t bytes = (size_t)dat->set->size * dat->size;
+    entry->data = (char *)xmalloc(bytes);
+    memcpy(entry->data, dat->data, bytes);
+  }
+
+  op_hdf5_dump_start(dump, 1);
+}
+
+/*******************************************************************************
+* Routines to open a stream of snapshots of selected op_dats in a named hdf5
+* file and register the op_dats, see op_hdf5_stream_step
+*******************************************************************************/
+
+void op_hdf5_stream_open(char const *file_name, int cadence) {
+  op_dump_to_hdf5_wait();
+  if (OP_hdf5_stream != NULL) {
+    op_printf("op_hdf5_stream_open error -- a stream is already open\n");
+    exit(2);
+  }
+  op_printf("Streaming to %s every %d steps\n", file_name, cadence);
+
+  op_hdf5_stream_core *s =
+      (op_hdf5_stream_core *)xcalloc(1, sizeof(op_hdf5_stream_core));
+  s->file_id = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (s->file_id < 0) {
+    op_printf("Could not create file '%s'\n", file_name);
+    exit(2);
+  }
+  s->dxpl = H5Pcreate(H5P_DATASET_XFER);
+  s->nparts = 1;
+  s->rank = 0;
+  s->cadence = MAX(cadence, 1);
+  s->background = 1;
+  s->step_dset = -1;
+  OP_hdf5_stream = s;
+  op_register_exit_hook(op_hdf5_exit);
+}
+
+void op_hdf5_stream_dat(op_dat dat) {
+  op_hdf5_stream_add(dat, dat->set->size, NULL);
+}
+
 /*******************************************************************************
 * Routine to read in a constant from a named hdf5 file
 *******************************************************************************/
 
 void op_get_const_hdf5(char const *name, int dim, char const *type,
                        char *const_data, char const *file_name) {
+  op_dump_to_hdf5_wait();
   // HDF5 APIs definitions
   hid_t file_id;   // file identifier
   hid_t dset_id;   // dataset identifier
@@ -680,6 +1027,7 @@ void op_get_const_hdf5(char const *name, int dim, char const *type,
 
 void op_write_const_hdf5(char const *name, int dim, char const *type,
                          char *const_data, char const *file_name) {
+  op_dump_to_hdf5_wait();
   // letting know that writing is happening ...
   op_printf("Writing '%s' to file '%s'\n", name, file_name);
 
@@ -813,6 +1161,7 @@ void op_write_const_hdf5(char const *name, int dim, char const *type,
 
 void op_fetch_data_hdf5(op_dat dat, char const *file_name,
                         char const *path_name) {
+  op_dump_to_hdf5_wait();
   // letting know that writing is happening ...
   op_printf("Writing '%s' to file '%s'\n", path_name, file_name);
 
@@ -979,6 +1328,9 @@ void op_fetch_data_hdf5(op_dat dat, char const *file_name,
   dimsf[1] = dat->dim;
   dataspace = H5Screate_simple(2, dimsf, NULL);
 
+  hid_t dcpl = op_hdf5_create_plist(dimsf[0], dat->dim, dat->size / dat->dim,
+                                    1, 0);
+
   // create dataset path
   create_path(path_name, file_id);
 
@@ -988,7 +1340,7 @@ void op_fetch_data_hdf5(op_dat dat, char const *file_name,
       (strcmp(dat->type, "double precision") == 0) ||      
       (strcmp(dat->type, "real(8)") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_DOUBLE, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, H5S_ALL, dataspace, H5P_DEFAULT,
              dat->data);
   } else if ((strcmp(dat->type, "float") == 0) ||
@@ -996,7 +1348,7 @@ void op_fetch_data_hdf5(op_dat dat, char const *file_name,
              (strcmp(dat->type, "real(4)") == 0) ||
              (strcmp(dat->type, "real") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_FLOAT, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_FLOAT, H5S_ALL, dataspace, H5P_DEFAULT,
              dat->data);
   } else if ((strcmp(dat->type, "int") == 0) ||
@@ -1005,19 +1357,19 @@ void op_fetch_data_hdf5(op_dat dat, char const *file_name,
              (strcmp(dat->type, "integer") == 0) ||
              (strcmp(dat->type, "integer(4)") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_INT, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_INT, H5S_ALL, dataspace, H5P_DEFAULT,
              dat->data);
   } else if ((strcmp(dat->type, "long") == 0) ||
              (strcmp(dat->type, "long:soa") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_LONG, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_LONG, H5S_ALL, dataspace, H5P_DEFAULT,
              dat->data);
   } else if ((strcmp(dat->type, "long long") == 0) ||
              (strcmp(dat->type, "long long:soa") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_LLONG, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_LLONG, H5S_ALL, dataspace, H5P_DEFAULT,
              dat->data);
   } else {
@@ -1026,6 +1378,7 @@ void op_fetch_data_hdf5(op_dat dat, char const *file_name,
   }
 
   H5Sclose(dataspace);
+  op_hdf5_close_plist(dcpl);
   H5Dclose(dset_id);
 
   /*attach attributes to dat*/
@@ -1077,6 +1430,7 @@ void op_fetch_data_hdf5_file(op_dat dat, char const *file_name) {
 }
 
 void op_fetch_data_hdf5_file_ptr(char *data, const char *file_name) {
+  op_dump_to_hdf5_wait();
   op_dat_entry *item;
   op_dat_entry *tmp_item;
   op_dat item_dat = NULL;
@@ -1111,6 +1465,33 @@ void op_fetch_data_hdf5_file_path(op_dat dat, char const *file_name,
   op_fetch_data_hdf5(dat, file_name, path_name);
 }
 
+/*******************************************************************************
+* Routine to write the partition of each op_set to a named hdf5 file, as the
+* rank of each element under partition/<set name>, all 0 here
+*******************************************************************************/
+
+void op_dump_partition_hdf5(char const *file_name) {
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    char *path = (char *)xmalloc(strlen(set->name) + 11);
+    sprintf(path, "partition/%s", set->name);
+    int *owner = (int *)xcalloc(set->size + 1, sizeof(int));
+
+    op_dat_core temp;
+    memset(&temp, 0, sizeof(op_dat_core));
+    temp.set = set;
+    temp.dim = 1;
+    temp.size = sizeof(int);
+    temp.type = "int";
+    temp.name = path;
+    temp.data = (char *)owner;
+    op_fetch_data_hdf5(&temp, file_name, path);
+
+    op_free(owner);
+    op_free(path);
+  }
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,6 +41,9 @@
 
 #include <assert.h>
 
+#include <atomic>
+#include <thread>
+
 // hdf5 header
 #include <hdf5.h>
 
@@ -201,3 +204,520 @@ void create_path(const char *name, hid_t file_id) {
   }
   free(buffer);
 }
+
+/*******************************************************************************
+* Dataset layout: contiguous unless OP_hdf5_chunk or OP_hdf5_deflate is set,
+* then chunked in whole elements, with shuffle+deflate on maps for the latter.
+* OP_hdf5_cache sizes the chunk cache used when reading
+*******************************************************************************/
+
+// number of chunk cache hash slots, a prime as HDF5 recommends
+#define OP_HDF5_CACHE_SLOTS 12421
+
+/* elements per chunk for a dataset written in nparts blocks, so that the
+   block of each process is made up of chunks of the same size */
+static hsize_t op_hdf5_chunk_elems(hsize_t g_size, size_t elem_bytes,
+                                   int nparts) {
+  size_t chunk_bytes = (size_t)(OP_hdf5_chunk > 0 ? OP_hdf5_chunk : 1024) << 10;
+  hsize_t part = (g_size + nparts - 1) / nparts;
+  hsize_t elems = MAX(chunk_bytes / elem_bytes, 1);
+  if (elems >= part)
+    return MAX(part, 1);
+  hsize_t n = (part + elems - 1) / elems;
+  return (part + n - 1) / n;
+}
+
+/* dataset creation property list for a g_size x dim dataset, H5P_DEFAULT for
+   the contiguous layout */
+static hid_t op_hdf5_create_plist(hsize_t g_size, int dim, size_t type_bytes,
+                                  int nparts, int is_map) {
+  int deflate = is_map ? OP_hdf5_deflate : 0;
+  if ((OP_hdf5_chunk == 0 && deflate == 0) || g_size == 0 || dim == 0)
+    return H5P_DEFAULT;
+
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  hsize_t chunk[2] = {op_hdf5_chunk_elems(g_size, type_bytes * dim, nparts),
+                      (hsize_t)dim};
+  H5Pset_chunk(dcpl, 2, chunk);
+  if (deflate > 0) {
+    if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+      H5Pset_shuffle(dcpl);
+      H5Pset_deflate(dcpl, deflate);
+    } else {
+      op_printf("HDF5 deflate filter not available, writing maps uncompressed\n");
+    }
+  }
+  return dcpl;
+}
+
+/* dataset access property list with the chunk cache of OP_hdf5_cache */
+static hid_t op_hdf5_access_plist() {
+  if (OP_hdf5_cache == 0)
+    return H5P_DEFAULT;
+  hid_t dapl = H5Pcreate(H5P_DATASET_ACCESS);
+  H5Pset_chunk_cache(dapl, OP_HDF5_CACHE_SLOTS, (size_t)OP_hdf5_cache << 20,
+                     H5D_CHUNK_CACHE_W0_DEFAULT);
+  return dapl;
+}
+
+static void op_hdf5_close_plist(hid_t plist) {
+  if (plist != H5P_DEFAULT)
+    H5Pclose(plist);
+}
+
+/*******************************************************************************
+* Asynchronous dumps: op_dump_to_hdf5_async copies what op_dump_to_hdf5 would
+* write into a snapshot, which is then written to file on a helper thread
+*******************************************************************************/
+
+typedef struct {
+  char *name;     // name of the set, map or dat
+  char *type;     // "type" attribute, NULL for a set
+  int type_len;   // length of the "type" attribute string
+  hid_t h5type;   // HDF5 native type of the elements
+  int dim;        // dimension
+  int is_map;     // 1 for an op_map, written with the map layout
+  int size;       // "size" attribute
+  hsize_t g_size; // global number of elements
+  hsize_t offset; // first element written by this process
+  hsize_t count;  // number of elements written by this process
+  char *data;     // copy of the elements written by this process
+} op_hdf5_dump_entry;
+
+typedef struct {
+  char *file_name;
+  hid_t fapl; // file access property list
+  hid_t dxpl; // dataset transfer property list
+  int nparts; // number of processes writing a block of each dataset
+  int n;      // number of entries
+  op_hdf5_dump_entry *entries;
+  std::thread *thread; // NULL if written in the foreground
+  std::atomic<int> done;
+} op_hdf5_dump;
+
+static op_hdf5_dump *OP_hdf5_dump_in_flight = NULL;
+
+/* HDF5 native type of the elements of an op_dat, -1 if unknown */
+static hid_t op_hdf5_dat_type(const char *type) {
+  if (strcmp(type, "double") == 0 || strcmp(type, "double:soa") == 0 ||
+      strcmp(type, "double precision") == 0 || strcmp(type, "real(8)") == 0)
+    return H5T_NATIVE_DOUBLE;
+  if (strcmp(type, "float") == 0 || strcmp(type, "float:soa") == 0 ||
+      strcmp(type, "real(4)") == 0 || strcmp(type, "real") == 0)
+    return H5T_NATIVE_FLOAT;
+  if (strcmp(type, "int") == 0 || strcmp(type, "int:soa") == 0 ||
+      strcmp(type, "int(4)") == 0 || strcmp(type, "integer") == 0 ||
+      strcmp(type, "integer(4)") == 0)
+    return H5T_NATIVE_INT;
+  if (strcmp(type, "long") == 0 || strcmp(type, "long:soa") == 0)
+    return H5T_NATIVE_LONG;
+  if (strcmp(type, "long long") == 0 || strcmp(type, "long long:soa") == 0)
+    return H5T_NATIVE_LLONG;
+  return -1;
+}
+
+/* writes a snapshot in the same layout as op_dump_to_hdf5 */
+static void op_hdf5_dump_write(op_hdf5_dump *dump) {
+  hid_t file_id =
+      H5Fcreate(dump->file_name, H5F_ACC_TRUNC, H5P_DEFAULT, dump->fapl);
+
+  for (int e = 0; e < dump->n; e++) {
+    op_hdf5_dump_entry *entry = &dump->entries[e];
+    hid_t dataspace, dset_id;
+
+    if (entry->type == NULL) {
+      // a set is stored as its size
+      hsize_t dimsf_set[] = {1};
+      int size = (int)entry->g_size;
+      dataspace = H5Screate_simple(1, dimsf_set, NULL);
+      dset_id = H5Dcreate(file_id, entry->name, H5T_NATIVE_INT, dataspace,
+                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+      H5Dwrite(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, dump->dxpl, &size);
+      H5Sclose(dataspace);
+      H5Dclose(dset_id);
+      continue;
+    }
+
+    hsize_t dimsf[2] = {entry->g_size, (hsize_t)entry->dim};
+    hsize_t count[2] = {entry->count, (hsize_t)entry->dim};
+    hsize_t offset[2] = {entry->offset, 0};
+    dataspace = H5Screate_simple(2, dimsf, NULL);
+    hid_t memspace = H5Screate_simple(2, count, NULL);
+    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+
+    create_path(entry->name, file_id);
+    hid_t dcpl = op_hdf5_create_plist(entry->g_size, entry->dim,
+                                      H5Tget_size(entry->h5type), dump->nparts,
+                                      entry->is_map);
+    dset_id = H5Dcreate(file_id, entry->name, entry->h5type, dataspace,
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    op_hdf5_close_plist(dcpl);
+    H5Dwrite(dset_id, entry->h5type, memspace, dataspace, dump->dxpl,
+             entry->data);
+    H5Sclose(memspace);
+    H5Sclose(dataspace);
+
+    // attributes: size, dim and type
+    hsize_t dims = 1;
+    dataspace = H5Screate_simple(1, &dims, NULL);
+    hid_t attribute = H5Acreate(dset_id, "size", H5T_NATIVE_INT, dataspace,
+                                H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attribute, H5T_NATIVE_INT, &entry->size);
+    H5Aclose(attribute);
+    attribute = H5Acreate(dset_id, "dim", H5T_NATIVE_INT, dataspace,
+                          H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attribute, H5T_NATIVE_INT, &entry->dim);
+    H5Aclose(attribute);
+    H5Sclose(dataspace);
+
+    dataspace = H5Screate(H5S_SCALAR);
+    hid_t atype = H5Tcopy(H5T_C_S1);
+    H5Tset_size(atype, entry->type_len);
+    attribute =
+        H5Acreate(dset_id, "type", atype, dataspace, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attribute, atype, entry->type);
+    H5Aclose(attribute);
+    H5Tclose(atype);
+    H5Sclose(dataspace);
+    H5Dclose(dset_id);
+  }
+  H5Fclose(file_id);
+  dump->done = 1;
+}
+
+static void op_hdf5_exit();
+
+/* writes the snapshot on a helper thread if background, else right away */
+static void op_hdf5_dump_start(op_hdf5_dump *dump, int background) {
+  op_register_exit_hook(op_hdf5_exit);
+  dump->done = 0;
+  dump->thread = NULL;
+  OP_hdf5_dump_in_flight = dump;
+  if (background)
+    dump->thread = new std::thread(op_hdf5_dump_write, dump);
+  else
+    op_hdf5_dump_write(dump);
+}
+
+/*******************************************************************************
+* Streaming output: the op_dats registered with op_hdf5_stream_dat are copied
+* into one of two snapshots every cadence steps, and the snapshot is appended
+* on a helper thread as a new slice of a {steps, set size, dim} dataset with
+* an unlimited first dimension, while the other snapshot is free to take the
+* next copy. Each process writes its own elements at their original indices
+*******************************************************************************/
+
+typedef struct {
+  op_dat dat;
+  hid_t h5type;      // HDF5 native type of the elements
+  hsize_t g_size;    // global number of elements
+  int count;         // number of elements of this process
+  int *order;        // element written at each row, NULL if in order
+  int nruns;         // runs of consecutive original indices of this process
+  hsize_t *run_start;
+  hsize_t *run_len;
+  hid_t dset_id;     // created with the first slice
+  char *buf[2];      // double-buffered snapshots
+} op_hdf5_stream_entry;
+
+typedef struct {
+  hid_t file_id;
+  hid_t dxpl;        // dataset transfer property list
+  int nparts;        // number of processes writing
+  int rank;          // of this process, only rank 0 writes the step numbers
+  int cadence;       // a slice every cadence steps
+  int background;    // write on a helper thread
+  int n;             // number of entries
+  op_hdf5_stream_entry *entries;
+  hid_t step_dset;   // the step number of each slice, created with the first
+  hsize_t n_steps;   // slices written so far
+  int steps[2];      // step number of each snapshot
+  int next;          // snapshot to copy into next
+  char *stage;       // local copy of a dat before it is put in original order
+  size_t stage_bytes;
+  std::thread *thread; // NULL if no slice is being written
+} op_hdf5_stream_core;
+
+static op_hdf5_stream_core *OP_hdf5_stream = NULL;
+
+/* registers a dat of g_size elements, g_index gives the original index of
+   each element of this process (NULL if they are 0 to g_size-1 in order) */
+static void op_hdf5_stream_add(op_dat dat, hsize_t g_size, int *g_index) {
+  op_hdf5_stream_core *s = OP_hdf5_stream;
+  if (s == NULL) {
+    op_printf("op_hdf5_stream_dat error -- no stream is open for %s\n",
+              dat->name);
+    exit(2);
+  }
+  if (s->n_steps > 0 || s->thread != NULL) {
+    op_printf("op_hdf5_stream_dat error -- %s must be registered before the "
+              "first step is written\n", dat->name);
+    exit(2);
+  }
+  hid_t h5type = op_hdf5_dat_type(dat->type);
+  if (h5type < 0) {
+    op_printf("Unknown type for data elements %s\n", dat->type);
+    exit(2);
+  }
+  if (g_size == 0)
+    return;
+
+  s->entries = (op_hdf5_stream_entry *)xrealloc(
+      s->entries, (s->n + 1) * sizeof(op_hdf5_stream_entry));
+  op_hdf5_stream_entry *e = &s->entries[s->n++];
+  e->dat = dat;
+  e->h5type = h5type;
+  e->g_size = g_size;
+  e->count = dat->set->size;
+  e->order = NULL;
+  e->dset_id = -1;
+  size_t bytes = (size_t)e->count * dat->size;
+  e->buf[0] = (char *)xmalloc(MAX(bytes, 1));
+  e->buf[1] = (char *)xmalloc(MAX(bytes, 1));
+
+  if (g_index == NULL) {
+    e->nruns = 1;
+    e->run_start = (hsize_t *)xmalloc(sizeof(hsize_t));
+    e->run_len = (hsize_t *)xmalloc(sizeof(hsize_t));
+    e->run_start[0] = 0;
+    e->run_len[0] = e->count;
+    return;
+  }
+
+  // sort the local elements by original index, and find the runs of
+  // consecutive indices they make up in the file
+  int *sorted = (int *)xmalloc(MAX(e->count, 1) * sizeof(int));
+  e->order = (int *)xmalloc(MAX(e->count, 1) * sizeof(int));
+  for (int i = 0; i < e->count; i++) {
+    sorted[i] = g_index[i];
+    e->order[i] = i;
+  }
+  quickSort_2(sorted, e->order, 0, e->count - 1);
+  e->nruns = 0;
+  e->run_start = (hsize_t *)xmalloc(MAX(e->count, 1) * sizeof(hsize_t));
+  e->run_len = (hsize_t *)xmalloc(MAX(e->count, 1) * sizeof(hsize_t));
+  for (int i = 0; i < e->count; i++) {
+    if (e->nruns > 0 && e->run_start[e->nruns - 1] + e->run_len[e->nruns - 1] ==
+                            (hsize_t)sorted[i]) {
+      e->run_len[e->nruns - 1]++;
+    } else {
+      e->run_start[e->nruns] = sorted[i];
+      e->run_len[e->nruns++] = 1;
+    }
+  }
+  free(sorted);
+  if (bytes > s->stage_bytes) {
+    s->stage_bytes = bytes;
+    s->stage = (char *)xrealloc(s->stage, bytes);
+  }
+}
+
+/* creates the extendible datasets, collectively on all processes */
+static void op_hdf5_stream_create(op_hdf5_stream_core *s) {
+  for (int i = 0; i < s->n; i++) {
+    op_hdf5_stream_entry *e = &s->entries[i];
+    op_dat dat = e->dat;
+    hsize_t dims[3] = {0, e->g_size, (hsize_t)dat->dim};
+    hsize_t maxdims[3] = {H5S_UNLIMITED, e->g_size, (hsize_t)dat->dim};
+    hsize_t chunk[3] = {1,
+                        op_hdf5_chunk_elems(e->g_size,
+                                            H5Tget_size(e->h5type) * dat->dim,
+                                            s->nparts),
+                        (hsize_t)dat->dim};
+    hid_t dataspace = H5Screate_simple(3, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 3, chunk);
+    create_path(dat->name, s->file_id);
+    e->dset_id = H5Dcreate(s->file_id, dat->name, e->h5type, dataspace,
+                           H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(dataspace);
+
+    // attributes: dim and type
+    hsize_t one = 1;
+    dataspace = H5Screate_simple(1, &one, NULL);
+    hid_t attribute = H5Acreate(e->dset_id, "dim", H5T_NATIVE_INT, dataspace,
+                                H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attribute, H5T_NATIVE_INT, &dat->dim);
+    H5Aclose(attribute);
+    H5Sclose(dataspace);
+    dataspace = H5Screate(H5S_SCALAR);
+    hid_t atype = H5Tcopy(H5T_C_S1);
+    H5Tset_size(atype, strlen(dat->type));
+    attribute = H5Acreate(e->dset_id, "type", atype, dataspace, H5P_DEFAULT,
+                          H5P_DEFAULT);
+    H5Awrite(attribute, atype, dat->type);
+    H5Aclose(attribute);
+    H5Tclose(atype);
+    H5Sclose(dataspace);
+  }
+
+  hsize_t dims = 0, maxdims = H5S_UNLIMITED, chunk = 1024;
+  hid_t dataspace = H5Screate_simple(1, &dims, &maxdims);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, 1, &chunk);
+  s->step_dset = H5Dcreate(s->file_id, "step", H5T_NATIVE_INT, dataspace,
+                           H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Pclose(dcpl);
+  H5Sclose(dataspace);
+}
+
+/* appends snapshot b as the next slice of every dataset */
+static void op_hdf5_stream_write(op_hdf5_stream_core *s, int b) {
+  if (s->step_dset < 0)
+    op_hdf5_stream_create(s);
+  hsize_t t = s->n_steps;
+
+  for (int i = 0; i < s->n; i++) {
+    op_hdf5_stream_entry *e = &s->entries[i];
+    hsize_t dims[3] = {t + 1, e->g_size, (hsize_t)e->dat->dim};
+    H5Dset_extent(e->dset_id, dims);
+    hid_t filespace = H5Dget_space(e->dset_id);
+    if (e->nruns == 0)
+      H5Sselect_none(filespace);
+    for (int r = 0; r < e->nruns; r++) {
+      hsize_t offset[3] = {t, e->run_start[r], 0};
+      hsize_t count[3] = {1, e->run_len[r], (hsize_t)e->dat->dim};
+      H5Sselect_hyperslab(filespace, r == 0 ? H5S_SELECT_SET : H5S_SELECT_OR,
+                          offset, NULL, count, NULL);
+    }
+    hsize_t mdims[2] = {(hsize_t)MAX(e->count, 1), (hsize_t)e->dat->dim};
+    hid_t memspace = H5Screate_simple(2, mdims, NULL);
+    if (e->count == 0)
+      H5Sselect_none(memspace);
+    H5Dwrite(e->dset_id, e->h5type, memspace, filespace, s->dxpl, e->buf[b]);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+  }
+
+  hsize_t steps = t + 1, one = 1;
+  H5Dset_extent(s->step_dset, &steps);
+  hid_t filespace = H5Dget_space(s->step_dset);
+  hid_t memspace = H5Screate_simple(1, &one, NULL);
+  if (s->rank == 0) {
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &t, NULL, &one, NULL);
+  } else {
+    H5Sselect_none(filespace);
+    H5Sselect_none(memspace);
+  }
+  H5Dwrite(s->step_dset, H5T_NATIVE_INT, memspace, filespace, s->dxpl,
+           &s->steps[b]);
+  H5Sclose(memspace);
+  H5Sclose(filespace);
+
+  // readers can follow the run
+  H5Fflush(s->file_id, H5F_SCOPE_LOCAL);
+  s->n_steps++;
+}
+
+static void op_hdf5_stream_join() {
+  op_hdf5_stream_core *s = OP_hdf5_stream;
+  if (s == NULL || s->thread == NULL)
+    return;
+  s->thread->join();
+  delete s->thread;
+  s->thread = NULL;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns 1 once the last op_dump_to_hdf5_async has been written */
+int op_dump_to_hdf5_test() {
+  return OP_hdf5_dump_in_flight == NULL || OP_hdf5_dump_in_flight->done;
+}
+
+/* waits for the last op_dump_to_hdf5_async and releases its snapshot, and
+   for the slice being appended by op_hdf5_stream_step */
+void op_dump_to_hdf5_wait() {
+  op_hdf5_stream_join();
+  op_hdf5_dump *dump = OP_hdf5_dump_in_flight;
+  if (dump == NULL)
+    return;
+  if (dump->thread != NULL) {
+    dump->thread->join();
+    delete dump->thread;
+  }
+  for (int e = 0; e < dump->n; e++) {
+    free(dump->entries[e].name);
+    free(dump->entries[e].type);
+    free(dump->entries[e].data);
+  }
+  free(dump->entries);
+  free(dump->file_name);
+  H5Pclose(dump->fapl);
+  H5Pclose(dump->dxpl);
+  delete dump;
+  OP_hdf5_dump_in_flight = NULL;
+}
+
+/* copies the registered dats into a snapshot every cadence steps and
+   appends it to the file in the background */
+void op_hdf5_stream_step(int step) {
+  op_hdf5_stream_core *s = OP_hdf5_stream;
+  if (s == NULL || step % s->cadence != 0)
+    return;
+
+  // the other snapshot may still be being written meanwhile
+  int b = s->next;
+  for (int i = 0; i < s->n; i++) {
+    op_hdf5_stream_entry *e = &s->entries[i];
+    size_t size = e->dat->size;
+    if (e->order == NULL) {
+      op_fetch_data_owned_char(e->dat, e->buf[b], NULL);
+      continue;
+    }
+    op_fetch_data_owned_char(e->dat, s->stage, NULL);
+    for (int j = 0; j < e->count; j++)
+      memcpy(&e->buf[b][j * size], &s->stage[(size_t)e->order[j] * size],
+             size);
+  }
+  s->steps[b] = step;
+  s->next = 1 - b;
+
+  op_dump_to_hdf5_wait();
+  if (s->background)
+    s->thread = new std::thread(op_hdf5_stream_write, s, b);
+  else
+    op_hdf5_stream_write(s, b);
+}
+
+/* waits for the last slice and closes the stream */
+void op_hdf5_stream_close() {
+  op_hdf5_stream_core *s = OP_hdf5_stream;
+  if (s == NULL)
+    return;
+  op_dump_to_hdf5_wait();
+  for (int i = 0; i < s->n; i++) {
+    op_hdf5_stream_entry *e = &s->entries[i];
+    if (e->dset_id >= 0)
+      H5Dclose(e->dset_id);
+    free(e->order);
+    free(e->run_start);
+    free(e->run_len);
+    free(e->buf[0]);
+    free(e->buf[1]);
+  }
+  if (s->step_dset >= 0)
+    H5Dclose(s->step_dset);
+  op_printf("Closed stream after %llu slices\n",
+            (unsigned long long)s->n_steps);
+  H5Pclose(s->dxpl);
+  H5Fclose(s->file_id);
+  free(s->entries);
+  free(s->stage);
+  free(s);
+  OP_hdf5_stream = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/* run by op_exit before the op_dats are freed, so that the last snapshot is
+ * complete on disk and a stream left open is closed */
+static void op_hdf5_exit() {
+  op_hdf5_stream_close();
+  op_dump_to_hdf5_wait();
+}
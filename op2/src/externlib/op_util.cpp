@@ -47,9 +47,15 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <op_lib_core.h>
 #include <op_util.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*******************************************************************************
 * compute local size from global size
 *******************************************************************************/
@@ -167,164 +173,333 @@ int linear_search(int a[], int value, int low, int high) {
 }
 
 /*******************************************************************************
-* Quicksort an array
+* Sorting of integer keys
+*
+* The routines below keep the interface of the original recursive quicksorts
+* but use a stable LSD radix sort on the keys. Keys are offset by their
+* minimum so only the digits that differ are sorted, i.e. a set of global
+* indices below 2^22 needs two passes. A first scan counts the descents
+* between neighbours: input that is already in order is left untouched,
+* non-increasing input is reversed in place, and in input with few descents
+* (e.g. a sorted list with some entries swapped) only the keys out of place
+* are sorted and merged back. The radix passes cost the same whatever the
+* order of the keys, so on such input they would be slower than the
+* quicksorts they replace. Satellite data (dat elements, map entries) is not
+* moved during the sort: a permutation is sorted along with the keys and the
+* data is gathered once at the end. When compiled with OpenMP, large sorts
+* compute the digit histograms and scatter in parallel.
 *******************************************************************************/
 
-void quickSort(int arr[], int left, int right) {
-  int i = left;
-  int j = right;
-  int tmp;
-  if (left==right) return;
-  int pivot = arr[(left + right) / 2];
-
-  // partition
-  while (i <= j) {
-    while (arr[i] < pivot)
-      i++;
-    while (arr[j] > pivot)
-      j--;
-    if (i <= j) {
-      tmp = arr[i];
-      arr[i] = arr[j];
-      arr[j] = tmp;
-      i++;
+#define OP_SORT_RADIX_BITS 11
+#define OP_SORT_RADIX_SIZE (1 << OP_SORT_RADIX_BITS)
+#define OP_SORT_INSERTION_MAX 64   // below this use insertion sort
+#define OP_SORT_PARALLEL_MIN 65536 // below this sort serially
+#define OP_SORT_FEW_DESCENTS 16    // merge up to n/16 keys out of place
+
+static int sort_num_threads(size_t n) {
+#ifdef _OPENMP
+  if (n >= OP_SORT_PARALLEL_MIN && !omp_in_parallel())
+    return omp_get_max_threads();
+#else
+  (void)n;
+#endif
+  return 1;
+}
+
+static int sort_thread_num() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// stable insertion sort of arr[0..n-1], moving val[] (if not NULL) along
+static void insertion_sort(int *arr, int *val, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    int key = arr[i];
+    int v = val ? val[i] : 0;
+    size_t j = i;
+    while (j > 0 && arr[j - 1] > key) {
+      arr[j] = arr[j - 1];
+      if (val)
+        val[j] = val[j - 1];
       j--;
     }
-  };
-  // recursion
-  if (left < j)
-    quickSort(arr, left, j);
-  if (i < right)
-    quickSort(arr, i, right);
+    arr[j] = key;
+    if (val)
+      val[j] = v;
+  }
+}
+
+// stable LSD radix sort of key[0..n-1] (all <= max_key), moving val[] (if
+// not NULL) along
+static void radix_sort(unsigned *key, int *val, size_t n, unsigned max_key) {
+  int bits = 0;
+  while (bits < 32 && (max_key >> bits) != 0)
+    bits++;
+  if (bits == 0)
+    return; // all keys equal
+
+  int nthreads = sort_num_threads(n);
+  unsigned *key_tmp = (unsigned *)xmalloc(n * sizeof(unsigned));
+  int *val_tmp = val ? (int *)xmalloc(n * sizeof(int)) : NULL;
+  size_t *offset =
+      (size_t *)xmalloc(nthreads * OP_SORT_RADIX_SIZE * sizeof(size_t));
+
+  unsigned *src_k = key, *dst_k = key_tmp;
+  int *src_v = val, *dst_v = val_tmp;
+  for (int shift = 0; shift < bits; shift += OP_SORT_RADIX_BITS) {
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads) if (nthreads > 1)
+#endif
+    {
+      int t = sort_thread_num();
+      size_t begin = n * t / nthreads;
+      size_t end = n * (t + 1) / nthreads;
+      size_t *off = &offset[t * OP_SORT_RADIX_SIZE];
+
+      memset(off, 0, OP_SORT_RADIX_SIZE * sizeof(size_t));
+      for (size_t i = begin; i < end; i++)
+        off[(src_k[i] >> shift) & (OP_SORT_RADIX_SIZE - 1)]++;
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+      {
+        // digit-major, thread-minor exclusive scan keeps the sort stable
+        size_t sum = 0;
+        for (int d = 0; d < OP_SORT_RADIX_SIZE; d++) {
+          for (int t2 = 0; t2 < nthreads; t2++) {
+            size_t c = offset[t2 * OP_SORT_RADIX_SIZE + d];
+            offset[t2 * OP_SORT_RADIX_SIZE + d] = sum;
+            sum += c;
+          }
+        }
+      }
+
+      for (size_t i = begin; i < end; i++) {
+        size_t p = off[(src_k[i] >> shift) & (OP_SORT_RADIX_SIZE - 1)]++;
+        dst_k[p] = src_k[i];
+        if (src_v)
+          dst_v[p] = src_v[i];
+      }
+    }
+    unsigned *tk = src_k;
+    src_k = dst_k;
+    dst_k = tk;
+    int *tv = src_v;
+    src_v = dst_v;
+    dst_v = tv;
+  }
+
+  if (src_k != key) {
+    memcpy(key, src_k, n * sizeof(unsigned));
+    if (val)
+      memcpy(val, src_v, n * sizeof(int));
+  }
+
+  op_free(offset);
+  op_free(key_tmp);
+  op_free(val_tmp);
+}
+
+static bool is_sorted(const int *arr, size_t n) {
+  for (size_t i = 1; i < n; i++)
+    if (arr[i] < arr[i - 1])
+      return false;
+  return true;
+}
+
+// reverse the non-increasing arr[0..n-1] and val[] (if not NULL) in place,
+// then each run of equal keys back so that they keep their order
+static void reverse_keys(int *arr, int *val, size_t n) {
+  std::reverse(arr, arr + n);
+  if (val)
+    std::reverse(val, val + n);
+  for (size_t i = 0, j; i < n; i = j) {
+    for (j = i + 1; j < n && arr[j] == arr[i]; j++)
+      ;
+    if (val && j - i > 1)
+      std::reverse(val + i, val + j);
+  }
+}
+
+static void sort_keys(int *arr, int *val, size_t n);
+
+// stable sort of arr[0..n-1] with few descents, moving val[] (if not NULL)
+// along: the keys out of place are moved aside in one pass, sorted on their
+// own and merged back with the rest, which is in order. Returns false with
+// arr[] and val[] untouched if more than n/OP_SORT_FEW_DESCENTS keys have to
+// be moved aside.
+static bool sort_few_descents(int *arr, int *val, size_t n) {
+  size_t max_out = n / OP_SORT_FEW_DESCENTS;
+  int *in_pos = (int *)xmalloc(n * sizeof(int));
+  int *out_pos = (int *)xmalloc(max_out * sizeof(int));
+  int *out_key = (int *)xmalloc(max_out * sizeof(int));
+
+  // keep a non-decreasing subsequence: a key below the last one kept moves
+  // that one aside, and itself too unless it fits after the one before
+  size_t k = 0, m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (k > 0 && arr[i] < arr[in_pos[k - 1]]) {
+      if (m + 2 > max_out)
+        break;
+      out_pos[m++] = in_pos[--k];
+      if (k > 0 && arr[i] < arr[in_pos[k - 1]]) {
+        out_pos[m++] = (int)i;
+        continue;
+      }
+    }
+    in_pos[k++] = (int)i;
+  }
+  if (k + m < n) {
+    op_free(out_key);
+    op_free(out_pos);
+    op_free(in_pos);
+    return false;
+  }
+
+  // order the keys moved aside by position, then stably by key
+  sort_keys(out_pos, NULL, m);
+  for (size_t j = 0; j < m; j++)
+    out_key[j] = arr[out_pos[j]];
+  sort_keys(out_key, out_pos, m);
+
+  // merge, taking the earlier position first among equal keys
+  int *key_tmp = (int *)xmalloc(n * sizeof(int));
+  int *val_tmp = val ? (int *)xmalloc(n * sizeof(int)) : NULL;
+  size_t a = 0, b = 0;
+  for (size_t i = 0; i < n; i++) {
+    int p;
+    if (b == m || (a < k && (arr[in_pos[a]] < out_key[b] ||
+                             (arr[in_pos[a]] == out_key[b] &&
+                              in_pos[a] < out_pos[b]))))
+      p = in_pos[a++];
+    else
+      p = out_pos[b++];
+    key_tmp[i] = arr[p];
+    if (val)
+      val_tmp[i] = val[p];
+  }
+  memcpy(arr, key_tmp, n * sizeof(int));
+  if (val)
+    memcpy(val, val_tmp, n * sizeof(int));
+
+  op_free(val_tmp);
+  op_free(key_tmp);
+  op_free(out_key);
+  op_free(out_pos);
+  op_free(in_pos);
+  return true;
+}
+
+// stable sort of arr[0..n-1] in ascending order, moving val[] (if not NULL)
+// along
+static void sort_keys(int *arr, int *val, size_t n) {
+  if (n < 2)
+    return;
+  size_t down = 0, up = 0;
+  for (size_t i = 1; i < n; i++) {
+    down += arr[i] < arr[i - 1];
+    up += arr[i] > arr[i - 1];
+  }
+  if (down == 0)
+    return;
+  if (up == 0) {
+    reverse_keys(arr, val, n);
+    return;
+  }
+  if (n <= OP_SORT_INSERTION_MAX) {
+    insertion_sort(arr, val, n);
+    return;
+  }
+  if (down <= n / OP_SORT_FEW_DESCENTS && sort_few_descents(arr, val, n))
+    return;
+
+  int lo = arr[0], hi = arr[0];
+  for (size_t i = 1; i < n; i++) {
+    lo = arr[i] < lo ? arr[i] : lo;
+    hi = arr[i] > hi ? arr[i] : hi;
+  }
+
+  // sort the offsets from the minimum in place as unsigned keys
+  unsigned *key = (unsigned *)arr;
+  unsigned base = (unsigned)lo;
+  for (size_t i = 0; i < n; i++)
+    key[i] = (unsigned)arr[i] - base;
+
+  radix_sort(key, val, n, (unsigned)hi - base);
+
+  for (size_t i = 0; i < n; i++)
+    arr[i] = (int)(key[i] + base);
+}
+
+// sort arr[0..n-1] and reorder the n elements of elem_size bytes in data[]
+// accordingly, with a single gather
+static void sort_gather(int *arr, char *data, size_t n, size_t elem_size) {
+  if (n < 2 || is_sorted(arr, n))
+    return;
+
+  int *perm = (int *)xmalloc(n * sizeof(int));
+  for (size_t i = 0; i < n; i++)
+    perm[i] = (int)i;
+  sort_keys(arr, perm, n);
+
+  char *tmp = (char *)xmalloc(n * elem_size);
+#ifdef _OPENMP
+#pragma omp parallel for if (sort_num_threads(n) > 1)
+#endif
+  for (long i = 0; i < (long)n; i++)
+    memcpy(&tmp[i * elem_size], &data[(size_t)perm[i] * elem_size],
+           elem_size);
+  memcpy(data, tmp, n * elem_size);
+
+  op_free(tmp);
+  op_free(perm);
 }
 
 /*******************************************************************************
-* Quick sort arr1 and organise arr2 elements according to the sorted arr1 order
+* Sort an array
+*******************************************************************************/
+
+void quickSort(int arr[], int left, int right) {
+  if (right <= left)
+    return;
+  sort_keys(&arr[left], NULL, right - left + 1);
+}
+
+/*******************************************************************************
+* Sort arr1 and organise arr2 elements according to the sorted arr1 order
 *******************************************************************************/
 
 void quickSort_2(int arr1[], int arr2[], int left, int right) {
-  int i = left;
-  int j = right;
-  int tmp1, tmp2;
-  if (left==right) return;
-  int pivot = arr1[(left + right) / 2];
-
-  // partition
-  while (i <= j) {
-    while (arr1[i] < pivot)
-      i++;
-    while (arr1[j] > pivot)
-      j--;
-    if (i <= j) {
-      tmp1 = arr1[i];
-      arr1[i] = arr1[j];
-      arr1[j] = tmp1;
-
-      tmp2 = arr2[i];
-      arr2[i] = arr2[j];
-      arr2[j] = tmp2;
-      i++;
-      j--;
-    }
-  };
-  // recursion
-  if (left < j)
-    quickSort_2(arr1, arr2, left, j);
-  if (i < right)
-    quickSort_2(arr1, arr2, i, right);
+  if (right <= left)
+    return;
+  sort_keys(&arr1[left], &arr2[left], right - left + 1);
 }
 
 /*******************************************************************************
-* Quick sort arr and organise dat[] elements according to the sorted arr order
+* Sort arr and organise dat[] elements according to the sorted arr order
 *******************************************************************************/
 
-void quickSort_dat(int arr[], char dat[], int left, int right, int elem_size2) {
-  if (left < 0 || right <= 0)
+void quickSort_dat(int arr[], char dat[], int left, int right, int elem_size) {
+  if (left < 0 || right <= left)
     return;
-  if (left==right) return;
-  size_t elem_size = elem_size2;
-  int i = left, j = right;
-  int tmp;
-  char *tmp_dat = (char *)xmalloc(sizeof(char) * elem_size);
-  int pivot = arr[(left + right) / 2];
-
-  // partition
-  while (i <= j) {
-    while (arr[i] < pivot)
-      i++;
-    while (arr[j] > pivot)
-      j--;
-    //    if (i <= j) {
-    if (i < j) {
-      tmp = arr[i];
-      arr[i] = arr[j];
-      arr[j] = tmp;
-
-      // tmp_dat = dat[i];
-      memcpy(tmp_dat, (void *)&dat[i * elem_size], elem_size);
-      // dat[i] = dat[j];
-      memcpy(&dat[i * elem_size], (void *)&dat[j * elem_size], elem_size);
-      // dat[j] = tmp_dat;
-      memcpy(&dat[j * elem_size], (void *)tmp_dat, elem_size);
-      i++;
-      j--;
-    } else if (i == j) {
-      i++;
-      j--;
-    }
-  };
-
-  // recursion
-  if (left < j)
-    quickSort_dat(arr, dat, left, j, elem_size);
-  if (i < right)
-    quickSort_dat(arr, dat, i, right, elem_size);
-  op_free(tmp_dat);
+  sort_gather(&arr[left], &dat[(size_t)left * elem_size], right - left + 1,
+              elem_size);
 }
 
 /*******************************************************************************
-* Quick sort arr and organise map[] elements according to the sorted arr order
+* Sort arr and organise map[] elements according to the sorted arr order
 *******************************************************************************/
 
 void quickSort_map(int arr[], int map[], int left, int right, int dim) {
-  if (left==right) return;
-  int i = left, j = right;
-  int tmp;
-  int *tmp_map = (int *)xmalloc(sizeof(int) * dim);
-  int pivot = arr[(left + right) / 2];
-
-  // partition
-  while (i <= j) {
-    while (arr[i] < pivot)
-      i++;
-    while (arr[j] > pivot)
-      j--;
-    //    if (i <= j) {
-    if (i < j) {
-      tmp = arr[i];
-      arr[i] = arr[j];
-      arr[j] = tmp;
-
-      // tmp_dat = dat[i];
-      memcpy(tmp_map, (void *)&map[i * dim], dim * sizeof(int));
-      // dat[i] = dat[j];
-      memcpy(&map[i * dim], (void *)&map[j * dim], dim * sizeof(int));
-      // dat[j] = tmp_dat;
-      memcpy(&map[j * dim], (void *)tmp_map, dim * sizeof(int));
-      i++;
-      j--;
-    } else if (i == j) {
-      i++;
-      j--;
-    }
-  };
-
-  // recursion
-  if (left < j)
-    quickSort_map(arr, map, left, j, dim);
-  if (i < right)
-    quickSort_map(arr, map, i, right, dim);
-  op_free(tmp_map);
+  if (right <= left)
+    return;
+  sort_gather(&arr[left], (char *)&map[(size_t)left * dim], right - left + 1,
+              dim * sizeof(int));
 }
 
 /*******************************************************************************
@@ -83,6 +83,7 @@ int op_gpi_buffer_setup(op_dat dat, int flags){
     
     memset(gpi_buf->exec_sent_acks,0,sizeof(char)*exp_exec_list->ranks_size);
     memset(gpi_buf->nonexec_sent_acks,0,sizeof(char)*exp_nonexec_list->ranks_size);
+    gpi_buf->diff_synced = 0;
 
     dat->gpi_buffer = (void *)gpi_buf;
 
@@ -16,6 +16,47 @@
 #include "gpi_utils.h"
 
 
+/* OP_diff_halo: the export segment still holds what was last written to each
+ * neighbour, and the neighbour's import segment what it last received, as
+ * op_gpi_waitall copies the whole of it into the halo. So once both are in
+ * step only the runs of OP_DIFF_BLOCK element blocks that changed are packed
+ * and written, followed by the notification on the same queue.
+ */
+static void op_gpi_diff_write(op_dat dat, halo_list list, int i, char *seg_addr,
+                              gaspi_segment_id_t local_seg, gaspi_offset_t local_offset,
+                              gaspi_segment_id_t remote_seg, gaspi_offset_t remote_offset,
+                              gaspi_notification_id_t notif_id){
+    int n = list->sizes[i];
+    int blocks = (n + OP_DIFF_BLOCK - 1) / OP_DIFF_BLOCK;
+    int run = -1; /* first block of the run of changed blocks, if any */
+
+    for (int b = 0; b <= blocks; b++) {
+        int changed = 0;
+        for (int j = b * OP_DIFF_BLOCK; b < blocks && j < MIN(n, (b + 1) * OP_DIFF_BLOCK); j++) {
+            char *cur = &dat->data[(size_t)dat->size * list->list[list->disps[i] + j]];
+            char *old = seg_addr + (size_t)j * dat->size;
+            if (memcmp(cur, old, dat->size) != 0) {
+                memcpy(old, cur, dat->size);
+                changed = 1;
+            }
+        }
+        if (changed && run < 0)
+            run = b;
+        if (!changed && run >= 0) {
+            gaspi_offset_t lo = (gaspi_offset_t)run * OP_DIFF_BLOCK * dat->size;
+            gaspi_size_t bytes = (gaspi_size_t)(MIN(n, b * OP_DIFF_BLOCK) - run * OP_DIFF_BLOCK) * dat->size;
+            GPI_QUEUE_SAFE( gaspi_write(local_seg, local_offset + lo, list->ranks[i],
+                                        remote_seg, remote_offset + lo, bytes,
+                                        OP2_GPI_QUEUE_ID, GPI_TIMEOUT), OP2_GPI_QUEUE_ID )
+            run = -1;
+        }
+    }
+
+    GPI_QUEUE_SAFE( gaspi_notify(remote_seg, list->ranks[i], notif_id, 1,
+                                 OP2_GPI_QUEUE_ID, GPI_TIMEOUT), OP2_GPI_QUEUE_ID )
+}
+
+
 /* GPI reimplementation of op_exchange_halo originally found in op_mpi_rt_support.cpp 
  * IS_COMMON 
  * Lots of this is common, so can be put there. 
@@ -79,9 +120,12 @@ void op_gpi_exchange_halo(op_arg *arg, int exec_flag){
         dat_offset_addr = (void*)(eeh_segment_ptr + dat->loc_eeh_seg_off);
     }
 
+    /* only changed blocks are written once the segments are in step */
+    int diff = OP_diff_halo && gpi_buf->diff_synced;
+
     int set_elem_index;
     for (int i = 0; i < exp_exec_list->ranks_size; i++) {
-      for (int j = 0; j < exp_exec_list->sizes[i]; j++) {
+      for (int j = 0; !diff && j < exp_exec_list->sizes[i]; j++) {
 
         set_elem_index = exp_exec_list->list[exp_exec_list->disps[i] + j];
         //Can reuse the exp_exec_list->disps[i] as this gives the per rank displacement into the dat buffer.
@@ -130,6 +174,13 @@ void op_gpi_exchange_halo(op_arg *arg, int exec_flag){
         }
 
 
+      if (diff)
+        op_gpi_diff_write(dat, exp_exec_list, i,
+                          (char *)dat_offset_addr + exp_exec_list->disps[i] * dat->size,
+                          EEH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET, local_offset,
+                          IEH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET, remote_exec_offset,
+                          dat->index << NOTIF_SHIFT | gpi_rank);
+      else
       GPI_QUEUE_SAFE( gaspi_write_notify(
                         EEH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET, /* local segment id*/
                         local_offset, /* local segment offset*/
@@ -168,7 +219,7 @@ void op_gpi_exchange_halo(op_arg *arg, int exec_flag){
     }
 
     for (int i =0; i < exp_nonexec_list->ranks_size; i++){
-        for (int j=0;j<exp_nonexec_list->sizes[i];j++){
+        for (int j=0;!diff && j<exp_nonexec_list->sizes[i];j++){
             set_elem_index = exp_nonexec_list->list[exp_nonexec_list->disps[i] + j];
 
             memcpy((void*)dat_offset_addr+exp_nonexec_list->disps[i]* dat->size + j *dat->size,
@@ -212,6 +263,14 @@ void op_gpi_exchange_halo(op_arg *arg, int exec_flag){
         }
 
 
+        if (diff)
+          op_gpi_diff_write(dat, exp_nonexec_list, i,
+                            (char *)dat_offset_addr + exp_nonexec_list->disps[i] * dat->size,
+                            ENH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET,
+                            (gaspi_offset_t) dat->loc_enh_seg_off + exp_nonexec_list->disps[i]*dat->size,
+                            INH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET, remote_nonexec_offset,
+                            dat->index << NOTIF_SHIFT | gpi_rank);
+        else
         GPI_QUEUE_SAFE( gaspi_write_notify(
                            ENH_SEGMENT_ID + gpi_buf->is_dynamic*DYNAMIC_SEG_ID_OFFSET, /* local segment */
                            (gaspi_offset_t) dat->loc_enh_seg_off + exp_nonexec_list->disps[i]*dat->size, /* local segment offset*/
@@ -235,6 +294,8 @@ void op_gpi_exchange_halo(op_arg *arg, int exec_flag){
     }
 
     //Finish up
+    if (OP_diff_halo)
+        gpi_buf->diff_synced = 1;
     dat->dirtybit =0;
     arg->sent=1;
 }
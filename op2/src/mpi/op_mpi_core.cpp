@@ -49,6 +49,12 @@
 
 #include <op_mpi_core.h>
 
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /* IS_COMMON */
 #ifdef HAVE_GPI
 #include <op_gpi_core.h>
@@ -65,6 +71,9 @@ halo_list *OP_import_exec_list; // IEH list
 halo_list *OP_import_nonexec_list; // INH list
 halo_list *OP_export_nonexec_list; // ENH list
 
+// storage for the four lists above, released in one go by op_halo_destroy
+static op_arena OP_halo_arena = NULL;
+
 //
 // Partial halo exchange lists
 //
@@ -73,6 +82,26 @@ int *OP_map_partial_exchange; // flag for each map
 halo_list *OP_import_nonexec_permap;
 halo_list *OP_export_nonexec_permap;
 int *set_import_buffer_size;
+
+//
+// Shared memory halo exchange between the ranks of a node (OP_shm_halo)
+//
+
+// communicator of the ranks sharing memory with this one, or MPI_COMM_NULL
+static MPI_Comm OP_shm_comm = MPI_COMM_NULL;
+static int OP_shm_size = 0, OP_shm_rank = 0;
+// node rank of each rank in OP_MPI_WORLD, -1 for ranks on other nodes
+int *OP_shm_node_rank = NULL;
+// offset in the receiver's op_dat of each entry of the export lists,
+// -1 for receivers on other nodes
+static int **OP_shm_exec_dst = NULL;
+static int **OP_shm_nonexec_dst = NULL;
+// number of pushes from this node each set's halo receives per exchange
+static int *OP_shm_senders = NULL;
+// per rank of the node and dat: exchange the halo is ready for, pushes done
+static MPI_Win OP_shm_flag_win;
+static long **OP_shm_flags = NULL;
+static int OP_shm_ndat = 0;
 //
 // global array to hold dirty_bits for op_dats
 //
@@ -103,6 +132,121 @@ op_export_handle *OP_export_list = NULL;
 // Timing
 double t1, t2, c1, c2;
 
+//
+// wall time spent in each STEP of op_halo_create, see mpi_timing_output
+//
+
+#define OP_HALO_CREATE_STEPS 13
+static double OP_halo_step_time[OP_HALO_CREATE_STEPS] = {0};
+static double OP_halo_step_mark = 0;
+
+static void halo_step_start()
+{
+  double cpu;
+  op_timers(&cpu, &OP_halo_step_mark);
+}
+
+static void halo_step_end(int step)
+{
+  double cpu, wall;
+  op_timers(&cpu, &wall);
+  OP_halo_step_time[step - 1] += wall - OP_halo_step_mark;
+  OP_halo_step_mark = wall;
+}
+
+/*******************************************************************************
+ * Routine to append a thread's private list to a shared, growable list
+ *******************************************************************************/
+
+static void append_list(int **list, int *size, int *cap, int *part, int n)
+{
+  if (*size + n > *cap)
+  {
+    *cap = std::max(2 * *cap, *size + n);
+    *list = (int *)xrealloc(*list, *cap * sizeof(int));
+  }
+  memcpy(&(*list)[*size], part, n * sizeof(int));
+  *size += n;
+}
+
+/*******************************************************************************
+ * Open addressing hash table from the global index of an imported element to
+ * its position in the import exec + nonexec halo of a set. It is built once
+ * per set and shared by all the maps pointing to that set
+ *******************************************************************************/
+
+typedef struct
+{
+  int *slots; // (global index, position) pairs, global index -1 when empty
+  int cap;    // number of slots, a power of two
+  int size;
+} halo_index;
+
+static inline unsigned halo_index_hash(int key, int cap)
+{
+  return ((unsigned)key * 2654435761u) & (unsigned)(cap - 1);
+}
+
+static void halo_index_insert(halo_index *t, int key, int value)
+{
+  unsigned h = halo_index_hash(key, t->cap);
+  while (t->slots[2 * h] != -1 && t->slots[2 * h] != key)
+    h = (h + 1) & (t->cap - 1);
+  if (t->slots[2 * h] == -1)
+    t->size++;
+  t->slots[2 * h] = key;
+  t->slots[2 * h + 1] = value;
+}
+
+// make room for n more entries, keeping the load factor below one half
+static void halo_index_reserve(halo_index *t, int n)
+{
+  if (2 * (t->size + n) <= t->cap)
+    return;
+  int cap = 64;
+  while (cap < 2 * (t->size + n))
+    cap *= 2;
+
+  halo_index old = *t;
+  t->slots = (int *)xmalloc(2 * (size_t)cap * sizeof(int));
+  t->cap = cap;
+  t->size = 0;
+  for (size_t i = 0; i < 2 * (size_t)cap; i += 2)
+    t->slots[i] = -1;
+  for (int i = 0; i < old.cap; i++)
+    if (old.slots[2 * i] != -1)
+      halo_index_insert(t, old.slots[2 * i], old.slots[2 * i + 1]);
+  op_free(old.slots);
+}
+
+// add the elements of an import list, numbered from offset
+static void halo_index_add_list(halo_index *t, halo_list list,
+                                int *part_range, int offset)
+{
+  halo_index_reserve(t, list->size);
+  for (int r = 0; r < list->ranks_size; r++)
+  {
+    int base = part_range[2 * list->ranks[r]];
+    for (int i = list->disps[r]; i < list->disps[r] + list->sizes[r]; i++)
+      halo_index_insert(t, base + list->list[i], offset + i);
+  }
+}
+
+// position of global_index in the halo, or -1 if it has not been imported
+static inline int halo_index_find(const halo_index *t, int global_index)
+{
+  if (t->cap == 0)
+    return -1;
+  unsigned h = halo_index_hash(global_index, t->cap);
+  while (t->slots[2 * h] != -1)
+  {
+    if (t->slots[2 * h] == global_index)
+      return t->slots[2 * h + 1];
+    h = (h + 1) & (t->cap - 1);
+  }
+  return -1;
+}
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -158,6 +302,31 @@ extern "C"
     }
   }
 
+  /*******************************************************************************
+   * Routine to get the node of every mpi rank: ranks sharing memory get the
+   * same id, the lowest rank on the node. OP_part_hierarchical > 1 groups that
+   * many consecutive ranks into a node instead of asking the MPI library
+   *******************************************************************************/
+
+  void get_node_ids(int *node_id, int my_rank, int comm_size, MPI_Comm Comm)
+  {
+    if (OP_part_hierarchical > 1)
+    {
+      for (int i = 0; i < comm_size; i++)
+        node_id[i] = i - i % OP_part_hierarchical;
+      return;
+    }
+
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(Comm, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL,
+                        &node_comm);
+    // keyed by rank, so rank 0 of node_comm is the lowest rank on the node
+    int leader = my_rank;
+    MPI_Bcast(&leader, 1, MPI_INT, 0, node_comm);
+    MPI_Allgather(&leader, 1, MPI_INT, node_id, 1, MPI_INT, Comm);
+    MPI_Comm_free(&node_comm);
+  }
+
   /*******************************************************************************
    * Routine to get partition (i.e. mpi rank) where global_index is located and
    * its local index
@@ -166,14 +335,23 @@ extern "C"
   int get_partition(int global_index, int *part_range, int *local_index,
                     int comm_size)
   {
-    for (int i = 0; i < comm_size; i++)
+    // the ranges are contiguous and in rank order (see get_part_range), so
+    // the owner is the last rank starting at or before global_index; empty
+    // ranks start where the next rank starts and are skipped over
+    int lo = 0, hi = comm_size - 1;
+    while (lo < hi)
     {
-      if (global_index >= part_range[2 * i] &&
-          global_index <= part_range[2 * i + 1])
-      {
-        *local_index = global_index - part_range[2 * i];
-        return i;
-      }
+      int mid = lo + (hi - lo + 1) / 2;
+      if (part_range[2 * mid] <= global_index)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    if (global_index >= part_range[2 * lo] &&
+        global_index <= part_range[2 * lo + 1])
+    {
+      *local_index = global_index - part_range[2 * lo];
+      return lo;
     }
     printf("Error: orphan global index\n");
     MPI_Abort(OP_MPI_WORLD, 2);
@@ -214,11 +392,8 @@ extern "C"
 
     int n = 0;
 
-    for (int r = 0; r < comm_size; r++)
-    {
-      if (List->ranks[r] >= 0)
-        temp[List->ranks[r]] = List->sizes[r];
-    }
+    for (int r = 0; r < List->ranks_size; r++)
+      temp[List->ranks[r]] = List->sizes[r];
 
     MPI_Allgather(temp, comm_size, MPI_INT, r_temp, comm_size, MPI_INT, Comm);
 
@@ -259,35 +434,34 @@ extern "C"
       disps[r] = ranks[r] = -99;
       sizes[r] = 0;
     }
-    for (int r = 0; r < comm_size; r++)
-    {
-      sizes[index] = disps[index] = 0;
 
-      int *temp = (int *)xmalloc((size / 2) * sizeof(int));
-      for (int i = 0; i < size; i = i + 2)
-      {
-        if (temp_list[i] == r)
-          temp[sizes[index]++] = temp_list[i + 1];
-      }
-      if (sizes[index] > 0)
-      {
-        ranks[index] = r;
-        // sort temp,
-        quickSort(temp, 0, sizes[index] - 1);
-        // eliminate duplicates in temp
-        sizes[index] = removeDups(temp, sizes[index]);
-        total_size = total_size + sizes[index];
+    // group the elements by rank, then sort the elements of each rank and
+    // eliminate duplicates, compacting the lists to the front of list
+    int n = size / 2;
+    int *r_list = (int *)xmalloc(n * sizeof(int));
+#pragma omp parallel for
+    for (int i = 0; i < n; i++)
+    {
+      r_list[i] = temp_list[2 * i];
+      list[i] = temp_list[2 * i + 1];
+    }
+    quickSort_2(r_list, list, 0, n - 1);
 
-        if (index > 0)
-          disps[index] = disps[index - 1] + sizes[index - 1];
-        // add to end of exp_list
-        for (int e = 0; e < sizes[index]; e++)
-          list[disps[index] + e] = temp[e];
+    for (int i = 0, j; i < n; i = j)
+    {
+      for (j = i + 1; j < n && r_list[j] == r_list[i]; j++)
+        ;
+      quickSort(&list[i], 0, j - i - 1);
+      int count = removeDups(&list[i], j - i);
+      memmove(&list[total_size], &list[i], count * sizeof(int));
 
-        index++;
-      }
-      op_free(temp);
+      ranks[index] = r_list[i];
+      sizes[index] = count;
+      disps[index] = total_size;
+      total_size += count;
+      index++;
     }
+    op_free(r_list);
 
     *total = total_size;
     *ranks_size = index;
@@ -315,6 +489,7 @@ extern "C"
     h_list->size = total_size;
     h_list->ranks = ranks;
     h_list->ranks_size = ranks_size;
+    h_list->inter_size = ranks_size;
     h_list->disps = disps;
     h_list->sizes = sizes;
     h_list->list = list;
@@ -341,6 +516,7 @@ extern "C"
     h_list->size = total_size;
     h_list->ranks = ranks;
     h_list->ranks_size = ranks_size;
+    h_list->inter_size = ranks_size;
     h_list->disps = disps;
     h_list->sizes = sizes;
     h_list->list = temp_list;
@@ -370,6 +546,161 @@ extern "C"
                        ranks_size, comm_size, my_rank);
   }
 
+  /*******************************************************************************
+   * Routine to put the neighbours of a halo list that are on other nodes first
+   * (OP_part_hierarchical) and set inter_size. The elements move with their
+   * ranks so disps stay ascending; the exchanges walk the lists in order and
+   * so post the expensive inter-node messages before the intra-node ones
+   *******************************************************************************/
+
+  static void order_list_by_node(halo_list h_list, int *node_id, int my_rank)
+  {
+    int n = h_list->ranks_size;
+    h_list->inter_size = n;
+    if (node_id == NULL || n == 0)
+      return;
+
+    int *ranks = (int *)xmalloc(n * sizeof(int));
+    int *disps = (int *)xmalloc(n * sizeof(int));
+    int *sizes = (int *)xmalloc(n * sizeof(int));
+    int *list = (int *)xmalloc(((size_t)h_list->size + 1) * sizeof(int));
+
+    int k = 0, total = 0;
+    for (int intra = 0; intra < 2; intra++)
+    {
+      if (intra)
+        h_list->inter_size = k;
+      for (int i = 0; i < n; i++)
+      {
+        int r = h_list->ranks[i];
+        if ((node_id[r] == node_id[my_rank]) != intra)
+          continue;
+        ranks[k] = r;
+        sizes[k] = h_list->sizes[i];
+        disps[k] = total;
+        memcpy(&list[total], &h_list->list[h_list->disps[i]],
+               (size_t)sizes[k] * sizeof(int));
+        total += sizes[k];
+        k++;
+      }
+    }
+
+    memcpy(h_list->ranks, ranks, n * sizeof(int));
+    memcpy(h_list->disps, disps, n * sizeof(int));
+    memcpy(h_list->sizes, sizes, n * sizeof(int));
+    memcpy(h_list->list, list, (size_t)h_list->size * sizeof(int));
+    op_free(ranks);
+    op_free(disps);
+    op_free(sizes);
+    op_free(list);
+  }
+
+  /*******************************************************************************
+   * Routine to move a halo list into an arena, with its per-rank arrays packed
+   * together and trimmed to the neighbours actually present
+   *******************************************************************************/
+
+  static size_t halo_list_arena_bytes(halo_list h_list)
+  {
+    return ROUND_UP_64(sizeof(halo_list_core)) +
+           ROUND_UP_64((3 * (size_t)h_list->ranks_size + 1) * sizeof(int)) +
+           ROUND_UP_64((size_t)h_list->size * sizeof(int));
+  }
+
+  static halo_list halo_list_to_arena(op_arena arena, halo_list h_list)
+  {
+    int n = h_list->ranks_size;
+    halo_list a_list =
+        (halo_list)op_arena_alloc(arena, sizeof(halo_list_core));
+    *a_list = *h_list;
+
+    // disps last, with room for the end offset the CUDA back-end stores there
+    int *per_rank =
+        (int *)op_arena_alloc(arena, (3 * (size_t)n + 1) * sizeof(int));
+    a_list->ranks = per_rank;
+    a_list->sizes = per_rank + n;
+    a_list->disps = per_rank + 2 * n;
+    a_list->list =
+        (int *)op_arena_alloc(arena, (size_t)h_list->size * sizeof(int));
+    memcpy(a_list->ranks, h_list->ranks, n * sizeof(int));
+    memcpy(a_list->disps, h_list->disps, n * sizeof(int));
+    memcpy(a_list->sizes, h_list->sizes, n * sizeof(int));
+    a_list->disps[n] = h_list->size;
+    memcpy(a_list->list, h_list->list, (size_t)h_list->size * sizeof(int));
+
+    op_free(h_list->ranks);
+    op_free(h_list->disps);
+    op_free(h_list->sizes);
+    op_free(h_list->list);
+    op_free(h_list);
+    return a_list;
+  }
+
+  /*******************************************************************************
+   * Routine to pack the four halo lists of every set into OP_halo_arena
+   *******************************************************************************/
+
+  static void pack_halo_lists()
+  {
+    size_t halo_bytes = 0;
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      halo_bytes += halo_list_arena_bytes(OP_export_exec_list[s]) +
+                    halo_list_arena_bytes(OP_import_exec_list[s]) +
+                    halo_list_arena_bytes(OP_export_nonexec_list[s]) +
+                    halo_list_arena_bytes(OP_import_nonexec_list[s]);
+    }
+    OP_halo_arena = op_arena_create(halo_bytes);
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      OP_export_exec_list[s] =
+          halo_list_to_arena(OP_halo_arena, OP_export_exec_list[s]);
+      OP_import_exec_list[s] =
+          halo_list_to_arena(OP_halo_arena, OP_import_exec_list[s]);
+      OP_export_nonexec_list[s] =
+          halo_list_to_arena(OP_halo_arena, OP_export_nonexec_list[s]);
+      OP_import_nonexec_list[s] =
+          halo_list_to_arena(OP_halo_arena, OP_import_nonexec_list[s]);
+    }
+  }
+
+  /*******************************************************************************
+   * Routine to create the MPI send/receive buffers of every op_dat, sized by
+   * the halo lists of its set
+   *******************************************************************************/
+
+  static void create_mpi_buffers()
+  {
+    op_dat_entry *item;
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      op_dat dat = item->dat;
+
+      op_mpi_buffer mpi_buf = (op_mpi_buffer)xmalloc(sizeof(op_mpi_buffer_core));
+      memset(mpi_buf, 0, sizeof(op_mpi_buffer_core));
+
+      halo_list exec_e_list = OP_export_exec_list[dat->set->index];
+      halo_list nonexec_e_list = OP_export_nonexec_list[dat->set->index];
+
+      mpi_buf->buf_exec = (char *)xmalloc((size_t)(exec_e_list->size) * (size_t)dat->size);
+      mpi_buf->buf_nonexec = (char *)xmalloc((size_t)(nonexec_e_list->size) * (size_t)dat->size);
+
+      halo_list exec_i_list = OP_import_exec_list[dat->set->index];
+      halo_list nonexec_i_list = OP_import_nonexec_list[dat->set->index];
+
+      mpi_buf->s_req = (MPI_Request *)xmalloc(
+          sizeof(MPI_Request) *
+          (exec_e_list->ranks_size + nonexec_e_list->ranks_size));
+      mpi_buf->r_req = (MPI_Request *)xmalloc(
+          sizeof(MPI_Request) *
+          (exec_i_list->ranks_size + nonexec_i_list->ranks_size));
+
+      mpi_buf->s_num_req = 0;
+      mpi_buf->r_num_req = 0;
+      dat->mpi_buffer = mpi_buf;
+    }
+  }
+
   /*******************************************************************************
    * Check if a given op_map is an on-to map from the from-set to the to-set
    * note: on large meshes this routine takes up a lot of memory due to memory
@@ -580,8 +911,18 @@ extern "C"
       }
     }
 
+    // in node-aware mode the neighbours on other nodes go first in each list
+    int *node_id = NULL;
+    if (OP_part_hierarchical)
+    {
+      node_id = (int *)xmalloc(comm_size * sizeof(int));
+      get_node_ids(node_id, my_rank, comm_size, OP_MPI_WORLD);
+    }
+
     OP_export_exec_list = (halo_list *)xmalloc(OP_set_index * sizeof(halo_list));
 
+    halo_step_start();
+
     /*----- STEP 1 - Construct export lists for execute set elements and related
       mapping table entries -----*/
 
@@ -601,41 +942,54 @@ extern "C"
       cap_s = 1000;
       set_list = (int *)xmalloc(cap_s * sizeof(int));
 
-      for (int e = 0; e < set->size; e++)
-      { // for each elment of this set
-        for (int m = 0; m < OP_map_index; m++)
-        { // for each maping table
-          op_map map = OP_map_list[m];
-
-          if (compare_sets(map->from, set) == 1)
-          { // need to select mappings
-            // FROM this set
-            int part, local_index;
-            for (int j = 0; j < map->dim; j++)
-            { // for each element
-              // pointed at by this entry
-
-              // get the partition that the data belongs to
-              part = get_partition(map->map[e * map->dim + j],               // the specific element being mapped to (i.e. in the "to set")
-                                   part_range[map->to->index], &local_index, // the partition range of the "to set"
-                                   comm_size);
-              // I think the local_index value is set to the local index of the data in that partition
-              // so local is local to the "to set", not the current partition
+#pragma omp parallel
+      {
+        // each thread gathers its part of the list, which is merged at the
+        // end; the order does not matter as create_export_list sorts it
+        int t_i = 0, cap_t = 1000;
+        int *t_list = (int *)xmalloc(cap_t * sizeof(int));
 
-              if (s_i >= cap_s)
-              {
-                cap_s = cap_s * 2;
-                set_list = (int *)xrealloc(set_list, cap_s * sizeof(int));
-              }
+#pragma omp for schedule(static)
+        for (int e = 0; e < set->size; e++)
+        { // for each elment of this set
+          for (int m = 0; m < OP_map_index; m++)
+          { // for each maping table
+            op_map map = OP_map_list[m];
+
+            if (compare_sets(map->from, set) == 1)
+            { // need to select mappings
+              // FROM this set
+              int part, local_index;
+              for (int j = 0; j < map->dim; j++)
+              { // for each element
+                // pointed at by this entry
+
+                // get the partition that the data belongs to
+                part = get_partition(map->map[e * map->dim + j],               // the specific element being mapped to (i.e. in the "to set")
+                                     part_range[map->to->index], &local_index, // the partition range of the "to set"
+                                     comm_size);
+                // I think the local_index value is set to the local index of the data in that partition
+                // so local is local to the "to set", not the current partition
+
+                if (t_i >= cap_t - 1)
+                {
+                  cap_t = cap_t * 2;
+                  t_list = (int *)xrealloc(t_list, cap_t * sizeof(int));
+                }
 
-              if (part != my_rank)
-              {
-                set_list[s_i++] = part; // add to set export list
-                set_list[s_i++] = e;    // current element of the set
+                if (part != my_rank)
+                {
+                  t_list[t_i++] = part; // add to set export list
+                  t_list[t_i++] = e;    // current element of the set
+                }
               }
             }
           }
         }
+
+#pragma omp critical
+        append_list(&set_list, &s_i, &cap_s, t_list, t_i);
+        op_free(t_list);
       }
 
       // create set export list
@@ -643,9 +997,11 @@ extern "C"
       // set->name,s_i);
       halo_list h_list = (halo_list)xmalloc(sizeof(halo_list_core));
       create_export_list(set, set_list, h_list, s_i, comm_size, my_rank); // creates neighbourhood list
+      order_list_by_node(h_list, node_id, my_rank);
       OP_export_exec_list[set->index] = h_list;
       op_free(set_list); // free temp list
     }
+    halo_step_end(1);
 
     /*---- STEP 2 - construct import lists for mappings and execute sets------*/
 
@@ -707,8 +1063,10 @@ extern "C"
       halo_list h_list = (halo_list)xmalloc(sizeof(halo_list_core));
       create_import_list(set, temp, h_list, index, neighbors, sizes, ranks_size,
                          comm_size, my_rank);
+      order_list_by_node(h_list, node_id, my_rank);
       OP_import_exec_list[set->index] = h_list; // this set's import list linked with its index
     }
+    halo_step_end(2);
 
     /*--STEP 3 -Exchange mapping table entries using the import/export lists--*/
 
@@ -726,6 +1084,7 @@ extern "C"
       for (int i = 0; i < e_list->ranks_size; i++)
       {
         sbuf[i] = (int *)xmalloc((size_t)e_list->sizes[i] * map->dim * sizeof(int));
+#pragma omp parallel for
         for (int j = 0; j < e_list->sizes[i]; j++)
         {
           for (int p = 0; p < map->dim; p++)
@@ -767,6 +1126,7 @@ extern "C"
         op_free(sbuf[i]);
       op_free(sbuf);
     }
+    halo_step_end(3);
 
     /*-- STEP 4 - Create import lists for non-execute set elements using mapping
       table entries including the additional mapping table entries --*/
@@ -781,10 +1141,17 @@ extern "C"
     set_list = NULL;
     cap_s = 1000; // keep track of the temp array capacity
 
+    // global index -> position in the import halos of each set, used here and
+    // for renumbering the mapping tables in STEP 8
+    halo_index *import_index =
+        (halo_index *)xcalloc(OP_set_index, sizeof(halo_index));
+
     for (int s = 0; s < OP_set_index; s++)
     { // for each set
       op_set set = OP_set_list[s];
       halo_list exec_set_list = OP_import_exec_list[set->index];
+      halo_index *set_index = &import_index[set->index];
+      halo_index_add_list(set_index, exec_set_list, part_range[set->index], 0);
 
       // create a temporaty scratch space to hold nonexec export list for this set
       s_i = 0;
@@ -801,48 +1168,48 @@ extern "C"
 
           // for each entry in this mapping table: original+execlist
           int len = map->from->size + exec_map_list->size;
-          for (int e = 0; e < len; e++)
+#pragma omp parallel
           {
-            int part;
-            int local_index;
-            for (int j = 0; j < map->dim; j++)
-            { // for each element pointed
-              // at by this entry
-              part = get_partition(map->map[e * map->dim + j],
-                                   part_range[map->to->index], &local_index,
-                                   comm_size);
-
-              if (s_i >= cap_s)
-              {
-                cap_s = cap_s * 2;
-                set_list = (int *)xrealloc(set_list, cap_s * sizeof(int));
-              }
+            // thread private part of the list, merged below
+            int t_i = 0, cap_t = 1000;
+            int *t_list = (int *)xmalloc(cap_t * sizeof(int));
 
-              if (part != my_rank)
-              { // if elements in the import list depend on something else not in this rank
-                int found = -1;
-                // check in exec list
-                int rank = binary_search(exec_set_list->ranks, part, 0,
-                                         exec_set_list->ranks_size - 1);
-
-                if (rank >= 0)
-                { // it is in the exec list
-                  found = binary_search(exec_set_list->list, local_index,
-                                        exec_set_list->disps[rank],
-                                        exec_set_list->disps[rank] +
-                                            exec_set_list->sizes[rank] - 1);
+#pragma omp for schedule(static)
+            for (int e = 0; e < len; e++)
+            {
+              int part;
+              int local_index;
+              for (int j = 0; j < map->dim; j++)
+              { // for each element pointed
+                // at by this entry
+                part = get_partition(map->map[e * map->dim + j],
+                                     part_range[map->to->index], &local_index,
+                                     comm_size);
+
+                if (t_i >= cap_t - 1)
+                {
+                  cap_t = cap_t * 2;
+                  t_list = (int *)xrealloc(t_list, cap_t * sizeof(int));
                 }
 
-                if (found < 0)
-                {
-                  // not in this partition and not found in
-                  // exec list
-                  // add to non-execute set_list
-                  set_list[s_i++] = part;
-                  set_list[s_i++] = local_index;
+                if (part != my_rank)
+                { // if elements in the import list depend on something else not in this rank
+                  // check in exec list
+                  if (halo_index_find(set_index, map->map[e * map->dim + j]) < 0)
+                  {
+                    // not in this partition and not found in
+                    // exec list
+                    // add to non-execute set_list
+                    t_list[t_i++] = part;
+                    t_list[t_i++] = local_index;
+                  }
                 }
               }
             }
+
+#pragma omp critical
+            append_list(&set_list, &s_i, &cap_s, t_list, t_i);
+            op_free(t_list);
           }
         }
       }
@@ -851,9 +1218,13 @@ extern "C"
       // printf("creating non-exec import list of size %d\n",s_i);
       halo_list h_list = (halo_list)xmalloc(sizeof(halo_list_core));
       create_nonexec_import_list(set, set_list, h_list, s_i, comm_size, my_rank);
+      order_list_by_node(h_list, node_id, my_rank);
       op_free(set_list); // free temp list
       OP_import_nonexec_list[set->index] = h_list;
+      halo_index_add_list(set_index, h_list, part_range[set->index],
+                          exec_set_list->size);
     }
+    halo_step_end(4);
 
     /*----------- STEP 5 - construct non-execute set export lists -------------*/
 
@@ -908,8 +1279,10 @@ extern "C"
       halo_list h_list = (halo_list)xmalloc(sizeof(halo_list_core));
       create_nonexec_export_list(set, temp, h_list, index, neighbors, sizes,
                                  ranks_size, comm_size, my_rank);
+      order_list_by_node(h_list, node_id, my_rank);
       OP_export_nonexec_list[set->index] = h_list;
     }
+    halo_step_end(5);
 
     /*-STEP 6 - Exchange execute set elements/data using the import/export
      * lists--*/
@@ -941,6 +1314,7 @@ extern "C"
           for (int i = 0; i < e_list->ranks_size; i++)
           {
             sbuf[i] = (char *)xmalloc((size_t)e_list->sizes[i] * (size_t)dat->size);
+#pragma omp parallel for
             for (int j = 0; j < e_list->sizes[i]; j++)
             {
               int set_elem_index = e_list->list[e_list->disps[i] + j];
@@ -978,6 +1352,8 @@ extern "C"
       }
     }
 
+    halo_step_end(6);
+
     /*-STEP 7 - Exchange non-execute set elements/data using the import/export
      * lists--*/
 
@@ -1008,6 +1384,7 @@ extern "C"
           for (int i = 0; i < e_list->ranks_size; i++)
           {
             sbuf[i] = (char *)xmalloc(e_list->sizes[i] * (size_t)dat->size);
+#pragma omp parallel for
             for (int j = 0; j < e_list->sizes[i]; j++)
             {
               int set_elem_index = e_list->list[e_list->disps[i] + j];
@@ -1042,6 +1419,8 @@ extern "C"
       }
     }
 
+    halo_step_end(7);
+
     /*-STEP 8 ----------------- Renumber Mapping tables-----------------------*/
 
     for (int s = 0; s < OP_set_index; s++)
@@ -1056,13 +1435,11 @@ extern "C"
         { // need to select
           // mappings TO this set
 
-          halo_list exec_set_list = OP_import_exec_list[set->index];
-          halo_list nonexec_set_list = OP_import_nonexec_list[set->index];
-
           halo_list exec_map_list = OP_import_exec_list[map->from->index];
 
           // for each entry in this mapping table: original+execlist
           int len = map->from->size + exec_map_list->size;
+#pragma omp parallel for
           for (int e = 0; e < len; e++)
           {
             for (int j = 0; j < map->dim; j++)
@@ -1080,41 +1457,13 @@ extern "C"
               }
               else
               {
-                int found = -1;
-                // check in exec list
-                int rank1 = binary_search(exec_set_list->ranks, part, 0,
-                                          exec_set_list->ranks_size - 1);
-                // check in nonexec list
-                int rank2 = binary_search(nonexec_set_list->ranks, part, 0,
-                                          nonexec_set_list->ranks_size - 1);
-
-                if (rank1 >= 0)
-                {
-                  found = binary_search(exec_set_list->list, local_index,
-                                        exec_set_list->disps[rank1],
-                                        exec_set_list->disps[rank1] +
-                                            exec_set_list->sizes[rank1] - 1);
-                  if (found >= 0)
-                  {
-                    OP_map_list[map->index]->map[e * map->dim + j] =
-                        found + map->to->size;
-                  }
-                }
-
-                if (rank2 >= 0 && found < 0)
-                {
-                  found = binary_search(nonexec_set_list->list, local_index,
-                                        nonexec_set_list->disps[rank2],
-                                        nonexec_set_list->disps[rank2] +
-                                            nonexec_set_list->sizes[rank2] - 1);
-                  if (found >= 0)
-                  {
-                    OP_map_list[map->index]->map[e * map->dim + j] =
-                        found + set->size + exec_set_list->size;
-                  }
-                }
-
-                if (found < 0)
+                // exec halo elements follow the owned ones, then nonexec
+                int found = halo_index_find(&import_index[set->index],
+                                            map->map[e * map->dim + j]);
+                if (found >= 0)
+                  OP_map_list[map->index]->map[e * map->dim + j] =
+                      found + set->size;
+                else
                   printf("ERROR: Set %10s Element %d needed on rank %d \
                     from partition %d\n",
                          set->name, local_index, my_rank, part);
@@ -1125,48 +1474,25 @@ extern "C"
       }
     }
 
-    /*-STEP 9   ---------------- Create MPI send Buffers-----------------------*/
-    op_dat_entry *item;
-    /**/
-
-    TAILQ_FOREACH(item, &OP_dat_list, entries)
-    {
-      op_dat dat = item->dat;
-
-      op_mpi_buffer mpi_buf = (op_mpi_buffer)xmalloc(sizeof(op_mpi_buffer_core));
-      memset(mpi_buf, 0,sizeof(op_mpi_buffer_core));
-
-      halo_list exec_e_list = OP_export_exec_list[dat->set->index];
-      halo_list nonexec_e_list = OP_export_nonexec_list[dat->set->index];
-
-      mpi_buf->buf_exec = (char *)xmalloc((size_t)(exec_e_list->size) * (size_t)dat->size);
-      mpi_buf->buf_nonexec = (char *)xmalloc((size_t)(nonexec_e_list->size) * (size_t)dat->size);
-
-      halo_list exec_i_list = OP_import_exec_list[dat->set->index];
-      halo_list nonexec_i_list = OP_import_nonexec_list[dat->set->index];
+    for (int s = 0; s < OP_set_index; s++)
+      op_free(import_index[s].slots);
+    op_free(import_index);
 
-      mpi_buf->s_req = (MPI_Request *)xmalloc(
-          sizeof(MPI_Request) *
-          (exec_e_list->ranks_size + nonexec_e_list->ranks_size));
-      mpi_buf->r_req = (MPI_Request *)xmalloc(
-          sizeof(MPI_Request) *
-          (exec_i_list->ranks_size + nonexec_i_list->ranks_size));
+    halo_step_end(8);
 
-      mpi_buf->s_num_req = 0;
-      mpi_buf->r_num_req = 0;
-      dat->mpi_buffer = mpi_buf;
-    }
+    /*-STEP 9   ---------------- Create MPI send Buffers-----------------------*/
+    create_mpi_buffers();
 
     // set dirty bits of all data arrays to 0
     // for each data array
-    item = NULL;
+    op_dat_entry *item;
     TAILQ_FOREACH(item, &OP_dat_list, entries)
     {
       op_dat dat = item->dat;
       dat->dirtybit = 0;
     }
 
-
+    halo_step_end(9);
 
     /*-STEP 10 -------------------- Separate core
      * elements------------------------*/
@@ -1198,7 +1524,7 @@ extern "C"
             core_elems[set->index][count++] = e;
           }
         }
-        quickSort(core_elems[set->index], 0, count - 1);
+        // core_elems is already in ascending order
 
         if (count + num_exp != set->size)
           printf("sizes not equal\n");
@@ -1214,12 +1540,14 @@ extern "C"
           // defined on this set
           {
             char *new_dat = (char *)xmalloc((size_t)set->size * (size_t)dat->size);
+#pragma omp parallel for
             for (int i = 0; i < count; i++)
             {
               memcpy(&new_dat[i * (size_t)dat->size],
                      &dat->data[core_elems[set->index][i] * (size_t)dat->size],
                      dat->size);
             }
+#pragma omp parallel for
             for (int i = 0; i < num_exp; i++)
             {
               memcpy(&new_dat[(count + i) * (size_t)dat->size],
@@ -1239,12 +1567,14 @@ extern "C"
           { // if this mapping is
             // defined from this set
             int *new_map = (int *)xmalloc((size_t)set->size * map->dim * sizeof(int));
+#pragma omp parallel for
             for (int i = 0; i < count; i++)
             {
               memcpy(&new_map[i * (size_t)map->dim],
                      &map->map[core_elems[set->index][i] * (size_t)map->dim],
                      map->dim * sizeof(int));
             }
+#pragma omp parallel for
             for (int i = 0; i < num_exp; i++)
             {
               memcpy(&new_map[(count + i) * (size_t)map->dim],
@@ -1256,6 +1586,7 @@ extern "C"
           }
         }
 
+#pragma omp parallel for
         for (int i = 0; i < exec->size; i++)
         {
           int index =
@@ -1266,6 +1597,7 @@ extern "C"
             exec->list[i] = count + index;
         }
 
+#pragma omp parallel for
         for (int i = 0; i < nonexec->size; i++)
         {
           int index = binary_search(core_elems[set->index], nonexec->list[i], 0,
@@ -1303,6 +1635,7 @@ extern "C"
       halo_list exec_map_list = OP_import_exec_list[map->from->index];
       // for each entry in this mapping table: original+execlist
       int len = map->from->size + exec_map_list->size;
+#pragma omp parallel for
       for (int e = 0; e < len; e++)
       {
         for (int j = 0; j < map->dim; j++)
@@ -1332,6 +1665,8 @@ extern "C"
       }
     }
 
+    halo_step_end(10);
+
     /*-STEP 11 ----------- Save the original set element
      * indexes------------------*/
 
@@ -1411,6 +1746,8 @@ extern "C"
       set->nonexec_size = OP_import_nonexec_list[set->index]->size;
     }
 
+    halo_step_end(11);
+
     /*-STEP 12 ---------- Clean up and Compute rough halo size
      * numbers------------*/
 
@@ -1423,6 +1760,10 @@ extern "C"
     op_free(part_range);
     op_free(exp_elems);
     op_free(core_elems);
+    op_free(node_id);
+
+    // pack the final halo lists of each set next to each other in one arena
+    pack_halo_lists();
 
     op_timers(&cpu_t2, &wall_t2); // timer stop for list create
     // compute import/export lists creation time
@@ -1593,7 +1934,7 @@ extern "C"
       printf("Average (worst case) Halo size = %d Bytes\n",
              avg_halo_size / comm_size);
     }
-
+    halo_step_end(12);
 
         /*-STEP 13 ---------------- Create GPI send Buffers-----------------------*/
 #ifdef HAVE_GPI
@@ -1670,6 +2011,7 @@ extern "C"
 
     GPI_SAFE( gaspi_barrier(OP_GPI_GLOBAL,GPI_TIMEOUT) )
 
+    halo_step_end(13);
 #endif /* HAVE_GPI*/
   
   }
@@ -1681,8 +2023,15 @@ extern "C"
   void op_halo_permap_create()
   {
 
-    int rank;
+    int rank, comm_size;
     MPI_Comm_rank(OP_MPI_WORLD, &rank);
+    MPI_Comm_size(OP_MPI_WORLD, &comm_size);
+    int *node_id = NULL;
+    if (OP_part_hierarchical)
+    {
+      node_id = (int *)xmalloc(comm_size * sizeof(int));
+      get_node_ids(node_id, rank, comm_size, OP_MPI_WORLD);
+    }
     /* --------Step 1: Decide which maps will do partial halo exchange
      * ----------*/
 
@@ -2235,7 +2584,11 @@ extern "C"
       op_free(recv_status);
       op_free(send_status);
       op_free(send_request);
+
+      order_list_by_node(OP_import_nonexec_permap[i], node_id, rank);
+      order_list_by_node(OP_export_nonexec_permap[i], node_id, rank);
     }
+    op_free(node_id);
 
     //
     // resize mpi_buffers to accommodate import data before scattering to actual
@@ -2300,6 +2653,9 @@ extern "C"
 
   void op_halo_destroy()
   {
+    // take the op_dats out of the shared memory windows
+    op_halo_shm_destroy();
+
     // remove halos from op_dats
     op_dat_entry *item;
     TAILQ_FOREACH(item, &OP_dat_list, entries)
@@ -2309,38 +2665,14 @@ extern "C"
     }
 
     // free lists
-    for (int s = 0; s < OP_set_index; s++)
-    {
-      op_set set = OP_set_list[s];
-
-      op_free(OP_import_exec_list[set->index]->ranks);
-      op_free(OP_import_exec_list[set->index]->disps);
-      op_free(OP_import_exec_list[set->index]->sizes);
-      op_free(OP_import_exec_list[set->index]->list);
-      op_free(OP_import_exec_list[set->index]);
-
-      op_free(OP_import_nonexec_list[set->index]->ranks);
-      op_free(OP_import_nonexec_list[set->index]->disps);
-      op_free(OP_import_nonexec_list[set->index]->sizes);
-      op_free(OP_import_nonexec_list[set->index]->list);
-      op_free(OP_import_nonexec_list[set->index]);
-
-      op_free(OP_export_exec_list[set->index]->ranks);
-      op_free(OP_export_exec_list[set->index]->disps);
-      op_free(OP_export_exec_list[set->index]->sizes);
-      op_free(OP_export_exec_list[set->index]->list);
-      op_free(OP_export_exec_list[set->index]);
-
-      op_free(OP_export_nonexec_list[set->index]->ranks);
-      op_free(OP_export_nonexec_list[set->index]->disps);
-      op_free(OP_export_nonexec_list[set->index]->sizes);
-      op_free(OP_export_nonexec_list[set->index]->list);
-      op_free(OP_export_nonexec_list[set->index]);
-    }
+    op_arena_destroy(OP_halo_arena);
+    OP_halo_arena = NULL;
     op_free(OP_import_exec_list);
     op_free(OP_import_nonexec_list);
     op_free(OP_export_exec_list);
     op_free(OP_export_nonexec_list);
+    OP_import_exec_list = OP_import_nonexec_list = NULL;
+    OP_export_exec_list = OP_export_nonexec_list = NULL;
 
     item = NULL;
     TAILQ_FOREACH(item, &OP_dat_list, entries)
@@ -2348,6 +2680,9 @@ extern "C"
       op_dat dat = item->dat;
       op_free(((op_mpi_buffer)(dat->mpi_buffer))->buf_exec);
       op_free(((op_mpi_buffer)(dat->mpi_buffer))->buf_nonexec);
+      op_free(((op_mpi_buffer)(dat->mpi_buffer))->diff_send);
+      op_free(((op_mpi_buffer)(dat->mpi_buffer))->diff_recv);
+      op_free(((op_mpi_buffer)(dat->mpi_buffer))->diff_halo);
       op_free(((op_mpi_buffer)(dat->mpi_buffer))->s_req);
       op_free(((op_mpi_buffer)(dat->mpi_buffer))->r_req);
     }
@@ -2356,23 +2691,623 @@ extern "C"
   }
 
   /*******************************************************************************
-   * Routine to set the dirty bit for an MPI Halo after halo exchange
+   * Routine to free the partial halo exchange lists of op_halo_permap_create
    *******************************************************************************/
 
-  /* IS_COMMON */
-  static void set_dirtybit(op_arg *arg, int hd)
+  void op_halo_permap_destroy()
   {
-    op_dat dat = arg->dat;
-
-    if ((arg->opt == 1) && (arg->argtype == OP_ARG_DAT) &&
-        (arg->acc == OP_INC || arg->acc == OP_WRITE || arg->acc == OP_RW))
+    for (int i = 0; i < OP_map_index; i++)
     {
-      dat->dirtybit = 1;
-      dat->dirty_hd = hd;
-    }
-  }
-
-  void op_mpi_reduce_combined(op_arg *args, int nargs)
+      if (OP_map_partial_exchange && OP_map_partial_exchange[i] == 0)
+        continue;
+      if (OP_import_nonexec_permap)
+      {
+        op_free(OP_import_nonexec_permap[i]->ranks);
+        op_free(OP_import_nonexec_permap[i]->disps);
+        op_free(OP_import_nonexec_permap[i]->sizes);
+        op_free(OP_import_nonexec_permap[i]->list);
+        op_free(OP_import_nonexec_permap[i]);
+      }
+      if (OP_export_nonexec_permap)
+      {
+        op_free(OP_export_nonexec_permap[i]->ranks);
+        op_free(OP_export_nonexec_permap[i]->disps);
+        op_free(OP_export_nonexec_permap[i]->sizes);
+        op_free(OP_export_nonexec_permap[i]->list);
+        op_free(OP_export_nonexec_permap[i]);
+      }
+    }
+    op_free(OP_import_nonexec_permap);
+    op_free(OP_export_nonexec_permap);
+    op_free(set_import_buffer_size);
+    op_free(OP_map_partial_exchange);
+    OP_import_nonexec_permap = OP_export_nonexec_permap = NULL;
+    set_import_buffer_size = NULL;
+    OP_map_partial_exchange = NULL;
+  }
+
+  /*******************************************************************************
+   * Routines to checkpoint the partitioned mesh of each rank and to restart
+   * from it. Each rank writes its sets, local (renumbered) maps, op_dats
+   * including their halos, g_index and halo lists as they are to
+   * <file_name>.<rank>, so that a restart on the same number of ranks reads
+   * them back and skips the partitioner and op_halo_create
+   *******************************************************************************/
+
+#define OP_PART_CKPT_MAGIC "OP2PART"
+#define OP_PART_CKPT_VERSION 1
+
+  static void ckpt_fail(const char *file_name, const char *what)
+  {
+    printf("op_partition checkpoint %s: %s\n", file_name, what);
+    MPI_Abort(OP_MPI_WORLD, 2);
+  }
+
+  static void ckpt_write(FILE *fp, const void *buf, size_t bytes,
+                         const char *file_name)
+  {
+    if (bytes > 0 && fwrite(buf, 1, bytes, fp) != bytes)
+      ckpt_fail(file_name, "write failed");
+  }
+
+  static void ckpt_read(FILE *fp, void *buf, size_t bytes,
+                        const char *file_name)
+  {
+    if (bytes > 0 && fread(buf, 1, bytes, fp) != bytes)
+      ckpt_fail(file_name, "unexpected end of file");
+  }
+
+  static void ckpt_write_name(FILE *fp, const char *name, const char *file_name)
+  {
+    int len = strlen(name);
+    ckpt_write(fp, &len, sizeof(int), file_name);
+    ckpt_write(fp, name, len, file_name);
+  }
+
+  static void ckpt_check_name(FILE *fp, const char *name, const char *file_name)
+  {
+    int len;
+    ckpt_read(fp, &len, sizeof(int), file_name);
+    char *stored = (char *)xmalloc(len + 1);
+    ckpt_read(fp, stored, len, file_name);
+    stored[len] = '\0';
+    if (strcmp(stored, name) != 0)
+    {
+      printf("op_partition checkpoint %s: holds %s where %s was declared\n",
+             file_name, stored, name);
+      MPI_Abort(OP_MPI_WORLD, 2);
+    }
+    op_free(stored);
+  }
+
+  static void ckpt_write_list(FILE *fp, halo_list h_list, const char *file_name)
+  {
+    int n = h_list->ranks_size;
+    ckpt_write(fp, &h_list->size, sizeof(int), file_name);
+    ckpt_write(fp, &h_list->ranks_size, sizeof(int), file_name);
+    ckpt_write(fp, &h_list->inter_size, sizeof(int), file_name);
+    ckpt_write(fp, h_list->ranks, n * sizeof(int), file_name);
+    ckpt_write(fp, h_list->disps, n * sizeof(int), file_name);
+    ckpt_write(fp, h_list->sizes, n * sizeof(int), file_name);
+    ckpt_write(fp, h_list->list, (size_t)h_list->size * sizeof(int), file_name);
+  }
+
+  static halo_list ckpt_read_list(FILE *fp, op_set set, const char *file_name)
+  {
+    halo_list h_list = (halo_list)xmalloc(sizeof(halo_list_core));
+    h_list->set = set;
+    ckpt_read(fp, &h_list->size, sizeof(int), file_name);
+    ckpt_read(fp, &h_list->ranks_size, sizeof(int), file_name);
+    ckpt_read(fp, &h_list->inter_size, sizeof(int), file_name);
+    int n = h_list->ranks_size;
+    h_list->ranks = (int *)xmalloc(n * sizeof(int));
+    h_list->disps = (int *)xmalloc(n * sizeof(int));
+    h_list->sizes = (int *)xmalloc(n * sizeof(int));
+    h_list->list = (int *)xmalloc((size_t)h_list->size * sizeof(int));
+    ckpt_read(fp, h_list->ranks, n * sizeof(int), file_name);
+    ckpt_read(fp, h_list->disps, n * sizeof(int), file_name);
+    ckpt_read(fp, h_list->sizes, n * sizeof(int), file_name);
+    ckpt_read(fp, h_list->list, (size_t)h_list->size * sizeof(int), file_name);
+    return h_list;
+  }
+
+  static FILE *ckpt_open(const char *file_name, const char *mode, char **path)
+  {
+    int my_rank;
+    MPI_Comm_rank(OP_MPI_WORLD, &my_rank);
+    *path = (char *)xmalloc(strlen(file_name) + 16);
+    sprintf(*path, "%s.%d", file_name, my_rank);
+    FILE *fp = fopen(*path, mode);
+    if (fp == NULL)
+      ckpt_fail(*path, "can't open file");
+    return fp;
+  }
+
+  void op_partition_checkpoint(const char *file_name)
+  {
+#ifdef HAVE_GPI
+    (void)file_name;
+    op_printf("op_partition_checkpoint UNSUPPORTED with GPI halo exchanges\n");
+#else
+    if (OP_import_exec_list == NULL)
+    {
+      op_printf("op_partition_checkpoint called before op_partition, ignoring\n");
+      return;
+    }
+
+    int my_rank, comm_size;
+    MPI_Comm_rank(OP_MPI_WORLD, &my_rank);
+    MPI_Comm_size(OP_MPI_WORLD, &comm_size);
+
+    op_dat_entry *item;
+    int dat_count = 0;
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      if (item->dat->dirty_hd == 2)
+        op_download_dat(item->dat);
+      dat_count++;
+    }
+
+    char *path;
+    FILE *fp = ckpt_open(file_name, "wb", &path);
+
+    int header[7] = {OP_PART_CKPT_VERSION, comm_size, my_rank, OP_set_index,
+                     OP_map_index, dat_count,
+                     OP_import_nonexec_permap != NULL};
+    ckpt_write(fp, OP_PART_CKPT_MAGIC, 8, path);
+    ckpt_write(fp, header, sizeof(header), path);
+
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      op_set set = OP_set_list[s];
+      part p = OP_part_list[s];
+      int sizes[5] = {set->size, set->core_size, set->exec_size,
+                      set->nonexec_size, p->is_partitioned};
+      ckpt_write_name(fp, set->name, path);
+      ckpt_write(fp, sizes, sizeof(sizes), path);
+      ckpt_write(fp, p->g_index, (size_t)set->size * sizeof(int), path);
+      ckpt_write(fp, p->elem_part, (size_t)set->size * sizeof(int), path);
+      ckpt_write(fp, orig_part_range[s], 2 * comm_size * sizeof(int), path);
+      ckpt_write_list(fp, OP_export_exec_list[s], path);
+      ckpt_write_list(fp, OP_import_exec_list[s], path);
+      ckpt_write_list(fp, OP_export_nonexec_list[s], path);
+      ckpt_write_list(fp, OP_import_nonexec_list[s], path);
+    }
+
+    for (int m = 0; m < OP_map_index; m++)
+    {
+      op_map map = OP_map_list[m];
+      ckpt_write_name(fp, map->name, path);
+      ckpt_write(fp, &map->dim, sizeof(int), path);
+      ckpt_write(fp, map->map,
+                 (size_t)(map->from->size + map->from->exec_size) * map->dim *
+                     sizeof(int),
+                 path);
+    }
+
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      op_dat dat = item->dat;
+      op_set set = dat->set;
+      ckpt_write_name(fp, dat->name, path);
+      ckpt_write(fp, &dat->size, sizeof(int), path);
+      ckpt_write(fp, &dat->dirtybit, sizeof(int), path);
+      ckpt_write(fp, dat->data,
+                 (size_t)(set->size + set->exec_size + set->nonexec_size) *
+                     dat->size,
+                 path);
+    }
+
+    if (fclose(fp) != 0)
+      ckpt_fail(path, "write failed");
+    op_free(path);
+#endif
+  }
+
+  void partition_restart(const char *file_name)
+  {
+#ifdef HAVE_GPI
+    (void)file_name;
+    op_printf("op_partition_restart UNSUPPORTED with GPI halo exchanges\n");
+#else
+    double cpu_t1, cpu_t2, wall_t1, wall_t2;
+    op_timers(&cpu_t1, &wall_t1);
+
+    int my_rank, comm_size;
+    MPI_Comm_rank(OP_MPI_WORLD, &my_rank);
+    MPI_Comm_size(OP_MPI_WORLD, &comm_size);
+
+    op_dat_entry *item;
+    int dat_count = 0;
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+      dat_count++;
+
+    char *path;
+    FILE *fp = ckpt_open(file_name, "rb", &path);
+
+    char magic[8];
+    int header[7];
+    ckpt_read(fp, magic, 8, path);
+    ckpt_read(fp, header, sizeof(header), path);
+    if (strncmp(magic, OP_PART_CKPT_MAGIC, 8) != 0 ||
+        header[0] != OP_PART_CKPT_VERSION)
+      ckpt_fail(path, "not an OP2 partition checkpoint");
+    if (header[1] != comm_size || header[2] != my_rank)
+      ckpt_fail(path, "written on a different number of MPI ranks");
+    if (header[3] != OP_set_index || header[4] != OP_map_index ||
+        header[5] != dat_count)
+      ckpt_fail(path, "written for different sets, maps or op_dats");
+    int permap = header[6];
+
+    // sets, their original global indices and the halo lists
+    OP_export_exec_list = (halo_list *)xmalloc(OP_set_index * sizeof(halo_list));
+    OP_import_exec_list = (halo_list *)xmalloc(OP_set_index * sizeof(halo_list));
+    OP_export_nonexec_list =
+        (halo_list *)xmalloc(OP_set_index * sizeof(halo_list));
+    OP_import_nonexec_list =
+        (halo_list *)xmalloc(OP_set_index * sizeof(halo_list));
+    OP_part_list = (part *)xmalloc(OP_set_index * sizeof(part));
+    OP_part_index = 0;
+    orig_part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      op_set set = OP_set_list[s];
+      int sizes[5];
+      ckpt_check_name(fp, set->name, path);
+      ckpt_read(fp, sizes, sizeof(sizes), path);
+      set->size = sizes[0];
+      set->core_size = sizes[1];
+      set->exec_size = sizes[2];
+      set->nonexec_size = sizes[3];
+
+      int *g_index = (int *)xmalloc((size_t)set->size * sizeof(int));
+      int *elem_part = (int *)xmalloc((size_t)set->size * sizeof(int));
+      ckpt_read(fp, g_index, (size_t)set->size * sizeof(int), path);
+      ckpt_read(fp, elem_part, (size_t)set->size * sizeof(int), path);
+      decl_partition(set, g_index, elem_part);
+      OP_part_list[s]->is_partitioned = sizes[4];
+
+      orig_part_range[s] = (int *)xmalloc(2 * comm_size * sizeof(int));
+      ckpt_read(fp, orig_part_range[s], 2 * comm_size * sizeof(int), path);
+
+      OP_export_exec_list[s] = ckpt_read_list(fp, set, path);
+      OP_import_exec_list[s] = ckpt_read_list(fp, set, path);
+      OP_export_nonexec_list[s] = ckpt_read_list(fp, set, path);
+      OP_import_nonexec_list[s] = ckpt_read_list(fp, set, path);
+    }
+    pack_halo_lists();
+
+    // mapping tables, already renumbered to local indices
+    for (int m = 0; m < OP_map_index; m++)
+    {
+      op_map map = OP_map_list[m];
+      int dim;
+      ckpt_check_name(fp, map->name, path);
+      ckpt_read(fp, &dim, sizeof(int), path);
+      if (dim != map->dim)
+        ckpt_fail(path, "map dimension differs from the declared one");
+      size_t bytes = (size_t)(map->from->size + map->from->exec_size) *
+                     map->dim * sizeof(int);
+      map->map = (int *)xrealloc(map->map, bytes);
+      ckpt_read(fp, map->map, bytes, path);
+    }
+
+    // op_dats, including their halos
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      op_dat dat = item->dat;
+      op_set set = dat->set;
+      int size;
+      ckpt_check_name(fp, dat->name, path);
+      ckpt_read(fp, &size, sizeof(int), path);
+      if (size != dat->size)
+        ckpt_fail(path, "op_dat element size differs from the declared one");
+      ckpt_read(fp, &dat->dirtybit, sizeof(int), path);
+      size_t bytes =
+          (size_t)(set->size + set->exec_size + set->nonexec_size) * dat->size;
+      dat->data = (char *)xrealloc(dat->data, bytes);
+      ckpt_read(fp, dat->data, bytes, path);
+    }
+
+    fclose(fp);
+    op_free(path);
+
+    create_mpi_buffers();
+
+    if (permap)
+      op_halo_permap_create();
+    else
+    {
+      set_import_buffer_size = (int *)xcalloc(OP_set_index, sizeof(int));
+      OP_map_partial_exchange = (int *)xcalloc(OP_map_index, sizeof(int));
+    }
+
+    op_timers(&cpu_t2, &wall_t2);
+    double time = wall_t2 - wall_t1, max_time;
+    MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, MPI_ROOT, OP_MPI_WORLD);
+    if (my_rank == MPI_ROOT)
+      printf("Max total partition restart time = %lf\n", max_time);
+
+    if (OP_diags > 1)
+      op_partition_report();
+#endif
+  }
+
+  /*******************************************************************************
+   * Routines for the halo exchange between ranks on the same node through
+   * MPI-3 shared memory windows (OP_shm_halo). The storage of every op_dat is
+   * moved into a window, and the owner of exported elements copies them
+   * straight into the halo of its neighbours on the node, instead of packing
+   * them into buf_exec/buf_nonexec and sending a message. Two counters per
+   * rank and op_dat order this: the receiver raises "ready" to the number of
+   * the exchange its halo is waiting for, and each sender adds one to "done"
+   * after each copy
+   *******************************************************************************/
+
+  static void shm_wait_for(long *flag, long value)
+  {
+    // keep MPI progressing the inter-node messages while spinning
+    int probe;
+    while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) < value)
+      MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, OP_MPI_WORLD, &probe,
+                 MPI_STATUS_IGNORE);
+  }
+
+  static void shm_get_dst(halo_list imp_list, halo_list exp_list, int *dst,
+                          int init, int tag)
+  {
+    MPI_Request *request =
+        (MPI_Request *)xmalloc((imp_list->ranks_size + 1) * sizeof(MPI_Request));
+    int *offset = (int *)xmalloc((imp_list->ranks_size + 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < imp_list->ranks_size; i++)
+    {
+      if (OP_shm_node_rank[imp_list->ranks[i]] < 0)
+        continue;
+      offset[n] = init + imp_list->disps[i];
+      MPI_Isend(&offset[n], 1, MPI_INT, imp_list->ranks[i], tag, OP_MPI_WORLD,
+                &request[n]);
+      n++;
+    }
+    for (int i = 0; i < exp_list->ranks_size; i++)
+    {
+      dst[i] = -1;
+      if (OP_shm_node_rank[exp_list->ranks[i]] >= 0)
+        MPI_Recv(&dst[i], 1, MPI_INT, exp_list->ranks[i], tag, OP_MPI_WORLD,
+                 MPI_STATUS_IGNORE);
+    }
+    MPI_Waitall(n, request, MPI_STATUSES_IGNORE);
+    op_free(request);
+    op_free(offset);
+  }
+
+  void op_halo_shm_create()
+  {
+    if (!OP_shm_halo || OP_import_exec_list == NULL)
+      return;
+
+    int my_rank, comm_size;
+    MPI_Comm_rank(OP_MPI_WORLD, &my_rank);
+    MPI_Comm_size(OP_MPI_WORLD, &comm_size);
+    MPI_Comm_split_type(OP_MPI_WORLD, MPI_COMM_TYPE_SHARED, my_rank,
+                        MPI_INFO_NULL, &OP_shm_comm);
+    MPI_Comm_size(OP_shm_comm, &OP_shm_size);
+    MPI_Comm_rank(OP_shm_comm, &OP_shm_rank);
+    if (OP_shm_size == 1)
+    {
+      MPI_Comm_free(&OP_shm_comm);
+      OP_shm_comm = MPI_COMM_NULL;
+      return;
+    }
+
+    int *world_rank = (int *)xmalloc(OP_shm_size * sizeof(int));
+    MPI_Allgather(&my_rank, 1, MPI_INT, world_rank, 1, MPI_INT, OP_shm_comm);
+    OP_shm_node_rank = (int *)xmalloc(comm_size * sizeof(int));
+    for (int r = 0; r < comm_size; r++)
+      OP_shm_node_rank[r] = -1;
+    for (int q = 0; q < OP_shm_size; q++)
+      OP_shm_node_rank[world_rank[q]] = q;
+    op_free(world_rank);
+
+    // where each exported element goes in the receiver's op_dats
+    OP_shm_exec_dst = (int **)xmalloc(OP_set_index * sizeof(int *));
+    OP_shm_nonexec_dst = (int **)xmalloc(OP_set_index * sizeof(int *));
+    OP_shm_senders = (int *)xcalloc(OP_set_index, sizeof(int));
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      op_set set = OP_set_list[s];
+      halo_list lists[2] = {OP_import_exec_list[s], OP_import_nonexec_list[s]};
+      OP_shm_exec_dst[s] = (int *)xmalloc(
+          (OP_export_exec_list[s]->ranks_size + 1) * sizeof(int));
+      OP_shm_nonexec_dst[s] = (int *)xmalloc(
+          (OP_export_nonexec_list[s]->ranks_size + 1) * sizeof(int));
+      shm_get_dst(lists[0], OP_export_exec_list[s], OP_shm_exec_dst[s],
+                  set->size, 2 * s);
+      shm_get_dst(lists[1], OP_export_nonexec_list[s], OP_shm_nonexec_dst[s],
+                  set->size + lists[0]->size, 2 * s + 1);
+      for (int l = 0; l < 2; l++)
+      {
+        for (int i = 0; i < lists[l]->ranks_size; i++)
+          if (OP_shm_node_rank[lists[l]->ranks[i]] >= 0)
+            OP_shm_senders[s]++;
+      }
+    }
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+
+    // the ready and done counters of every op_dat
+    OP_shm_ndat = OP_dat_index;
+    long *flags;
+    MPI_Win_allocate_shared(2 * (MPI_Aint)OP_shm_ndat * sizeof(long),
+                            sizeof(long), info, OP_shm_comm, &flags,
+                            &OP_shm_flag_win);
+    memset(flags, 0, 2 * (size_t)OP_shm_ndat * sizeof(long));
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, OP_shm_flag_win);
+    OP_shm_flags = (long **)xmalloc(OP_shm_size * sizeof(long *));
+    for (int q = 0; q < OP_shm_size; q++)
+    {
+      MPI_Aint bytes;
+      int disp_unit;
+      MPI_Win_shared_query(OP_shm_flag_win, q, &bytes, &disp_unit,
+                           &OP_shm_flags[q]);
+    }
+
+    // move the op_dats into windows
+    op_dat_entry *item;
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      op_dat dat = item->dat;
+      op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+      int user_managed = dat->user_managed;
+      MPI_Allreduce(MPI_IN_PLACE, &user_managed, 1, MPI_INT, MPI_MAX,
+                    OP_shm_comm);
+      if (user_managed)
+        continue;
+
+      size_t bytes = ((size_t)dat->set->size +
+                      OP_import_exec_list[dat->set->index]->size +
+                      OP_import_nonexec_list[dat->set->index]->size) *
+                     dat->size;
+      char *data;
+      MPI_Win_allocate_shared((MPI_Aint)bytes, 1, info, OP_shm_comm, &data,
+                              &mpi_buf->shm_win);
+      memcpy(data, dat->data, bytes);
+      op_free(dat->data);
+      dat->data = data;
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, mpi_buf->shm_win);
+
+      mpi_buf->shm_peer = (char **)xmalloc(OP_shm_size * sizeof(char *));
+      for (int q = 0; q < OP_shm_size; q++)
+      {
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(mpi_buf->shm_win, q, &size, &disp_unit,
+                             &mpi_buf->shm_peer[q]);
+      }
+      mpi_buf->shm_epoch = mpi_buf->shm_waited = 0;
+    }
+    MPI_Info_free(&info);
+
+    // nobody may raise a counter before all have been zeroed
+    MPI_Barrier(OP_shm_comm);
+  }
+
+  /* moves an op_dat out of its window again, collective over the node */
+  void op_dat_shm_detach(op_dat dat)
+  {
+    op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+    if (mpi_buf == NULL || mpi_buf->shm_peer == NULL)
+      return;
+
+    size_t bytes = ((size_t)dat->set->size +
+                    OP_import_exec_list[dat->set->index]->size +
+                    OP_import_nonexec_list[dat->set->index]->size) *
+                   dat->size;
+    char *data = (char *)xmalloc(bytes);
+    memcpy(data, dat->data, bytes);
+    MPI_Win_unlock_all(mpi_buf->shm_win);
+    MPI_Win_free(&mpi_buf->shm_win);
+    dat->data = data;
+    op_free(mpi_buf->shm_peer);
+    mpi_buf->shm_peer = NULL;
+  }
+
+  void op_halo_shm_destroy()
+  {
+    if (OP_shm_comm == MPI_COMM_NULL)
+      return;
+
+    op_dat_entry *item;
+    TAILQ_FOREACH(item, &OP_dat_list, entries) { op_dat_shm_detach(item->dat); }
+
+    MPI_Win_unlock_all(OP_shm_flag_win);
+    MPI_Win_free(&OP_shm_flag_win);
+    op_free(OP_shm_flags);
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      op_free(OP_shm_exec_dst[s]);
+      op_free(OP_shm_nonexec_dst[s]);
+    }
+    op_free(OP_shm_exec_dst);
+    op_free(OP_shm_nonexec_dst);
+    op_free(OP_shm_senders);
+    op_free(OP_shm_node_rank);
+    OP_shm_flags = NULL;
+    OP_shm_exec_dst = OP_shm_nonexec_dst = NULL;
+    OP_shm_senders = NULL;
+    OP_shm_node_rank = NULL;
+    MPI_Comm_free(&OP_shm_comm);
+    OP_shm_comm = MPI_COMM_NULL;
+  }
+
+  /* start an exchange: the halo of dat on this rank may now be overwritten */
+  void op_halo_shm_begin(op_dat dat)
+  {
+    op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+    mpi_buf->shm_epoch++;
+    __atomic_store_n(&OP_shm_flags[OP_shm_rank][2 * dat->index],
+                     mpi_buf->shm_epoch, __ATOMIC_RELEASE);
+  }
+
+  static void shm_push_list(op_dat dat, halo_list list, int *dst)
+  {
+    op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+    size_t size = dat->size;
+    for (int i = 0; i < list->ranks_size; i++)
+    {
+      if (dst[i] < 0)
+        continue;
+      int q = OP_shm_node_rank[list->ranks[i]];
+      shm_wait_for(&OP_shm_flags[q][2 * dat->index], mpi_buf->shm_epoch);
+      char *halo = mpi_buf->shm_peer[q] + (size_t)dst[i] * size;
+      const int *elem = &list->list[list->disps[i]];
+      for (int j = 0; j < list->sizes[i]; j++)
+        memcpy(halo + j * size, dat->data + (size_t)elem[j] * size, size);
+      __atomic_fetch_add(&OP_shm_flags[q][2 * dat->index + 1], 1,
+                         __ATOMIC_RELEASE);
+    }
+  }
+
+  /* copy the exported elements of dat into the halos of the node */
+  void op_halo_shm_push(op_dat dat)
+  {
+    int s = dat->set->index;
+    shm_push_list(dat, OP_export_exec_list[s], OP_shm_exec_dst[s]);
+    shm_push_list(dat, OP_export_nonexec_list[s], OP_shm_nonexec_dst[s]);
+  }
+
+  /* wait for the other ranks of the node to fill in the halo of dat */
+  void op_halo_shm_wait(op_dat dat)
+  {
+    op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+    if (mpi_buf->shm_waited == mpi_buf->shm_epoch)
+      return;
+    shm_wait_for(&OP_shm_flags[OP_shm_rank][2 * dat->index + 1],
+                 mpi_buf->shm_epoch * OP_shm_senders[dat->set->index]);
+    mpi_buf->shm_waited = mpi_buf->shm_epoch;
+  }
+
+  /*******************************************************************************
+   * Routine to set the dirty bit for an MPI Halo after halo exchange
+   *******************************************************************************/
+
+  /* IS_COMMON */
+  static void set_dirtybit(op_arg *arg, int hd)
+  {
+    op_dat dat = arg->dat;
+
+    if ((arg->opt == 1) && (arg->argtype == OP_ARG_DAT) &&
+        (arg->acc == OP_INC || arg->acc == OP_WRITE || arg->acc == OP_RW))
+    {
+      dat->dirtybit = 1;
+      dat->dirty_hd = hd;
+    }
+  }
+
+  void op_mpi_reduce_combined(op_arg *args, int nargs)
   {
     op_timers_core(&c1, &t1);
     int nreductions = 0;
@@ -3117,6 +4052,135 @@ extern "C"
     return temp_dat;
   }
 
+  /*******************************************************************************
+   * Routines to fetch part of a distributed op_dat without migrating it back
+   * to the original partitioning
+   *******************************************************************************/
+
+#define OP_FETCH_RANGE_TAG 2001
+
+  int op_mpi_fetch_data_owned(op_dat dat, char *usr_ptr, int *g_index)
+  {
+    // the elements this rank owns, in its own order, with their original
+    // global indices
+    int size = dat->set->size;
+    if (usr_ptr != NULL)
+      memcpy(usr_ptr, dat->data, (size_t)size * dat->size);
+    if (g_index != NULL)
+      memcpy(g_index, OP_part_list[dat->set->index]->g_index,
+             (size_t)size * sizeof(int));
+    return size;
+  }
+
+  // a message holds the original global indices of n elements, then their data
+  static void unpack_range(char *usr_ptr, char *buf, int n, int low, int size)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      int g;
+      memcpy(&g, &buf[j * sizeof(int)], sizeof(int));
+      memcpy(&usr_ptr[(size_t)(g - low) * size],
+             &buf[n * sizeof(int) + (size_t)j * size], size);
+    }
+  }
+
+  void op_mpi_fetch_data_range(op_dat dat, char *usr_ptr, int low, int high)
+  {
+    int my_rank, comm_size;
+    MPI_Comm_rank(OP_MPI_FETCH_WORLD, &my_rank);
+    MPI_Comm_size(OP_MPI_FETCH_WORLD, &comm_size);
+
+    // every rank states the range it wants (none if high < low); this is the
+    // only collective step
+    int req[3] = {low, high, dat->set->size};
+    int *reqs = (int *)xmalloc(3 * comm_size * sizeof(int));
+    MPI_Allgather(req, 3, MPI_INT, reqs, 3, MPI_INT, OP_MPI_FETCH_WORLD);
+
+    int g_size = 0;
+    for (int r = 0; r < comm_size; r++)
+      g_size += reqs[3 * r + 2];
+    if (high >= low && (low < 0 || high > g_size - 1))
+    {
+      printf("op_fetch_data: Indices not within range of elements held in %s\n",
+             dat->name);
+      MPI_Abort(OP_MPI_FETCH_WORLD, -1);
+    }
+
+    // pack the owned elements each requesting rank asked for and send them to
+    // it directly; ranks that own none of them send nothing
+    int *g_index = OP_part_list[dat->set->index]->g_index;
+    size_t item = sizeof(int) + dat->size;
+    char **sbuf = (char **)xcalloc(comm_size, sizeof(char *));
+    int *counts = (int *)xcalloc(comm_size, sizeof(int));
+    MPI_Request *request_send =
+        (MPI_Request *)xmalloc(comm_size * sizeof(MPI_Request));
+    int n_send = 0;
+    for (int r = 0; r < comm_size; r++)
+    {
+      int r_low = reqs[3 * r], r_high = reqs[3 * r + 1];
+      if (r_high < r_low)
+        continue;
+      for (int i = 0; i < dat->set->size; i++)
+        if (g_index[i] >= r_low && g_index[i] <= r_high)
+          counts[r]++;
+      if (counts[r] == 0)
+        continue;
+
+      sbuf[r] = (char *)xmalloc(counts[r] * item);
+      int c = 0;
+      for (int i = 0; i < dat->set->size; i++)
+      {
+        if (g_index[i] >= r_low && g_index[i] <= r_high)
+        {
+          memcpy(&sbuf[r][c * sizeof(int)], &g_index[i], sizeof(int));
+          memcpy(&sbuf[r][counts[r] * sizeof(int) + (size_t)c * dat->size],
+                 &dat->data[(size_t)i * dat->size], dat->size);
+          c++;
+        }
+      }
+      if (r != my_rank)
+        MPI_Isend(sbuf[r], counts[r] * item, MPI_CHAR, r, OP_FETCH_RANGE_TAG,
+                  OP_MPI_FETCH_WORLD, &request_send[n_send++]);
+    }
+
+    // the number of owners sending is not known, but the number of elements
+    // is, so receive from any source until all have arrived
+    int received = 0;
+    if (counts[my_rank] > 0)
+    {
+      unpack_range(usr_ptr, sbuf[my_rank], counts[my_rank], low, dat->size);
+      received = counts[my_rank];
+    }
+    char *rbuf = NULL;
+    int rcap = 0;
+    while (received < (high >= low ? high - low + 1 : 0))
+    {
+      MPI_Status status;
+      int bytes;
+      MPI_Probe(MPI_ANY_SOURCE, OP_FETCH_RANGE_TAG, OP_MPI_FETCH_WORLD,
+                &status);
+      MPI_Get_count(&status, MPI_CHAR, &bytes);
+      if (bytes > rcap)
+      {
+        rcap = bytes;
+        rbuf = (char *)xrealloc(rbuf, rcap);
+      }
+      MPI_Recv(rbuf, bytes, MPI_CHAR, status.MPI_SOURCE, OP_FETCH_RANGE_TAG,
+               OP_MPI_FETCH_WORLD, MPI_STATUS_IGNORE);
+      unpack_range(usr_ptr, rbuf, bytes / item, low, dat->size);
+      received += bytes / item;
+    }
+
+    MPI_Waitall(n_send, request_send, MPI_STATUSES_IGNORE);
+    for (int r = 0; r < comm_size; r++)
+      free(sbuf[r]);
+    free(sbuf);
+    free(counts);
+    free(request_send);
+    free(rbuf);
+    free(reqs);
+  }
+
   /*******************************************************************************
    * Routine to put (modify) a the data held in a distributed op_dat
    *******************************************************************************/
@@ -3287,6 +4351,163 @@ extern "C"
         tot_time = avg_time = 0.0;
       }
     }
+
+    // time spent in each STEP of op_halo_create
+    double step_max[OP_HALO_CREATE_STEPS], step_sum[OP_HALO_CREATE_STEPS];
+    MPI_Reduce(OP_halo_step_time, step_max, OP_HALO_CREATE_STEPS, MPI_DOUBLE,
+               MPI_MAX, MPI_ROOT, OP_MPI_IO_WORLD);
+    MPI_Reduce(OP_halo_step_time, step_sum, OP_HALO_CREATE_STEPS, MPI_DOUBLE,
+               MPI_SUM, MPI_ROOT, OP_MPI_IO_WORLD);
+    if (my_rank == MPI_ROOT && step_max[0] > 0.0)
+    {
+      printf("___________________________________________________\n");
+      printf("\nHalo creation  Max time(sec)   Avg time(sec)  \n");
+      for (int i = 0; i < OP_HALO_CREATE_STEPS; i++)
+      {
+        if (step_max[i] > 0.0)
+          printf("STEP %-2d        %10.4f      %10.4f    \n", i + 1,
+                 step_max[i], step_sum[i] / comm_size);
+      }
+    }
+    MPI_Comm_free(&OP_MPI_IO_WORLD);
+  }
+
+  /*******************************************************************************
+   * Routine to print the quality of the current partitioning: the load and halo
+   * of each set, the cut of each map and the halo volume of each dat
+   *******************************************************************************/
+  void op_partition_report()
+  {
+    if (OP_import_exec_list == NULL)
+      return;
+
+    int my_rank, comm_size;
+    MPI_Comm OP_MPI_IO_WORLD;
+    MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_IO_WORLD);
+    MPI_Comm_rank(OP_MPI_IO_WORLD, &my_rank);
+    MPI_Comm_size(OP_MPI_IO_WORLD, &comm_size);
+
+    int n_dats = 0;
+    op_dat_entry *item;
+    TAILQ_FOREACH(item, &OP_dat_list, entries) { n_dats++; }
+
+    // gather everything into one array, so that each reduction is a single
+    // collective: 5 values per set, 1 per map and 1 per dat
+    int n_vals = 5 * OP_set_index + OP_map_index + n_dats;
+    double *val = (double *)xmalloc(n_vals * sizeof(double));
+    int *marker = (int *)xcalloc(comm_size, sizeof(int));
+    int v = 0;
+
+    for (int s = 0; s < OP_set_index; s++)
+    {
+      op_set set = OP_set_list[s];
+      halo_list lists[4] = {
+          OP_import_exec_list[set->index], OP_import_nonexec_list[set->index],
+          OP_export_exec_list[set->index], OP_export_nonexec_list[set->index]};
+      int neighbours = 0;
+      for (int l = 0; l < 4; l++)
+      {
+        for (int r = 0; r < lists[l]->ranks_size; r++)
+        {
+          if (marker[lists[l]->ranks[r]] != s + 1)
+          {
+            marker[lists[l]->ranks[r]] = s + 1;
+            neighbours++;
+          }
+        }
+      }
+      val[v++] = (double)set->size;
+      val[v++] = (double)lists[0]->size;
+      val[v++] = (double)lists[1]->size;
+      val[v++] = (double)neighbours;
+      // import elements from ranks on other nodes (all of them unless
+      // OP_part_hierarchical tagged the lists)
+      int off_node = 0;
+      for (int l = 0; l < 2; l++)
+      {
+        for (int r = 0; r < lists[l]->inter_size; r++)
+          off_node += lists[l]->sizes[r];
+      }
+      val[v++] = (double)off_node;
+    }
+
+    for (int m = 0; m < OP_map_index; m++)
+    {
+      op_map map = OP_map_list[m];
+      long cut = 0;
+      for (int e = 0; e < map->from->size; e++)
+      {
+        for (int j = 0; j < map->dim; j++)
+        {
+          if (map->map[e * map->dim + j] >= map->to->size)
+            cut++;
+        }
+      }
+      val[v++] = (double)cut;
+    }
+
+    TAILQ_FOREACH(item, &OP_dat_list, entries)
+    {
+      op_dat dat = item->dat;
+      val[v++] = (double)(OP_import_exec_list[dat->set->index]->size +
+                          OP_import_nonexec_list[dat->set->index]->size) *
+                 dat->size;
+    }
+
+    double *val_min = (double *)xmalloc(n_vals * sizeof(double));
+    double *val_max = (double *)xmalloc(n_vals * sizeof(double));
+    double *val_sum = (double *)xmalloc(n_vals * sizeof(double));
+    MPI_Reduce(val, val_min, n_vals, MPI_DOUBLE, MPI_MIN, MPI_ROOT,
+               OP_MPI_IO_WORLD);
+    MPI_Reduce(val, val_max, n_vals, MPI_DOUBLE, MPI_MAX, MPI_ROOT,
+               OP_MPI_IO_WORLD);
+    MPI_Reduce(val, val_sum, n_vals, MPI_DOUBLE, MPI_SUM, MPI_ROOT,
+               OP_MPI_IO_WORLD);
+
+    if (my_rank == MPI_ROOT)
+    {
+      const char *set_rows[5] = {"owned", "exec halo", "nonexec halo",
+                                 "neighbours", "off-node halo"};
+      v = 0;
+      printf("___________________________________________________\n");
+      printf("\nPartition quality on %d ranks\n", comm_size);
+      printf("%-12s %-12s %12s %12s %12s %14s\n", "set", "", "min", "avg",
+             "max", "total");
+      for (int s = 0; s < OP_set_index; s++)
+      {
+        for (int r = 0; r < 5; r++, v++)
+          printf("%-12s %-12s %12.0f %12.1f %12.0f %14.0f\n",
+                 r == 0 ? OP_set_list[s]->name : "", set_rows[r], val_min[v],
+                 val_sum[v] / comm_size, val_max[v], val_sum[v]);
+      }
+      printf("%-25s %12s %12s %12s %14s\n", "map cut entries", "min", "avg",
+             "max", "total");
+      for (int m = 0; m < OP_map_index; m++, v++)
+        printf("%-25s %12.0f %12.1f %12.0f %14.0f\n", OP_map_list[m]->name,
+               val_min[v], val_sum[v] / comm_size, val_max[v], val_sum[v]);
+      printf("%-25s %12s %12s %12s %14s\n", "dat halo bytes", "min", "avg",
+             "max", "total");
+      TAILQ_FOREACH(item, &OP_dat_list, entries)
+      {
+        printf("%-25s %12.0f %12.1f %12.0f %14.0f\n", item->dat->name,
+               val_min[v], val_sum[v] / comm_size, val_max[v], val_sum[v]);
+        v++;
+      }
+      printf("max/avg owned load:");
+      for (int s = 0; s < OP_set_index; s++)
+      {
+        double avg = val_sum[5 * s] / comm_size;
+        printf(" %s %.3f", OP_set_list[s]->name,
+               avg > 0.0 ? val_max[5 * s] / avg : 1.0);
+      }
+      printf("\n");
+    }
+
+    op_free(val);
+    op_free(val_min);
+    op_free(val_max);
+    op_free(val_sum);
+    op_free(marker);
     MPI_Comm_free(&OP_MPI_IO_WORLD);
   }
 
@@ -3441,30 +4662,8 @@ extern "C"
     op_halo_destroy();
     // free memory used for holding partition information
     op_partition_destroy();
-    // print each mpi process's timing info for each kernel
-    for (int i = 0; i < OP_map_index; i++)
-    {
-      if (OP_map_partial_exchange && OP_map_partial_exchange[i] == 0)
-        continue;
-      if (OP_import_nonexec_permap)
-      {
-        op_free(OP_import_nonexec_permap[i]->ranks);
-        op_free(OP_import_nonexec_permap[i]->disps);
-        op_free(OP_import_nonexec_permap[i]->sizes);
-        op_free(OP_import_nonexec_permap[i]->list);
-        op_free(OP_import_nonexec_permap[i]);
-      }
-      if (OP_export_nonexec_permap)
-      {
-        op_free(OP_export_nonexec_permap[i]->ranks);
-        op_free(OP_export_nonexec_permap[i]->disps);
-        op_free(OP_export_nonexec_permap[i]->sizes);
-        op_free(OP_export_nonexec_permap[i]->list);
-        op_free(OP_export_nonexec_permap[i]);
-      }
-    }
-    op_free(set_import_buffer_size);
-    op_free(OP_map_partial_exchange);
+    // free the partial halo exchange lists
+    op_halo_permap_destroy();
 
     for (int i = 0; i < OP_import_index; i++)
       op_free(OP_import_list[i]);
@@ -3474,6 +4673,9 @@ extern "C"
       op_free(OP_export_list[i]);
     if (OP_export_list)
       op_free(OP_export_list);
+
+    if (OP_MPI_FETCH_WORLD != MPI_COMM_NULL)
+      MPI_Comm_free(&OP_MPI_FETCH_WORLD);
   }
 
   int getSetSizeFromOpArg(op_arg *arg)
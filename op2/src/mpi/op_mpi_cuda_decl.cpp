@@ -53,6 +53,7 @@
 
 MPI_Comm OP_MPI_WORLD;
 MPI_Comm OP_MPI_GLOBAL;
+MPI_Comm OP_MPI_FETCH_WORLD = MPI_COMM_NULL;
 
 //
 // CUDA-specific OP2 functions
@@ -63,14 +64,24 @@ void op_init(int argc, char **argv, int diags) {
 }
 
 void op_init_soa(int argc, char **argv, int diags, int soa) {
-  int flag = 0;
+  int flag = 0, provided;
+  int async = op_hdf5_async_requested(argc, argv);
   OP_auto_soa = soa;
   MPI_Initialized(&flag);
   if (!flag) {
-    MPI_Init(&argc, &argv);
+    // threads are only needed to write HDF5 files in the background, and
+    // MPI_THREAD_MULTIPLE can make every message slower
+    if (!async || MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE,
+                                  &provided) != MPI_SUCCESS)
+      MPI_Init(&argc, &argv);
   }
   OP_MPI_WORLD = MPI_COMM_WORLD;
   OP_MPI_GLOBAL = MPI_COMM_WORLD;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_FETCH_WORLD);
+  MPI_Query_thread(&provided);
+  if (async && provided < MPI_THREAD_MULTIPLE)
+    op_printf("MPI_THREAD_MULTIPLE is not available, HDF5 files will be "
+              "written in the foreground\n");
   op_init_core(argc, argv, diags);
 
 #if CUDART_VERSION < 3020
@@ -115,6 +126,7 @@ void op_mpi_init_soa(int argc, char **argv, int diags, MPI_Fint global,
   }
   OP_MPI_WORLD = MPI_Comm_f2c(local);
   OP_MPI_GLOBAL = MPI_Comm_f2c(global);
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_FETCH_WORLD);
   op_init_core(argc, argv, diags);
 
 #if CUDART_VERSION < 3020
@@ -217,6 +229,9 @@ op_dat op_decl_dat_temp_char(op_set set, int dim, char const *type, int size,
 
   mpi_buf->s_num_req = 0;
   mpi_buf->r_num_req = 0;
+  mpi_buf->shm_peer = NULL;
+  mpi_buf->diff_send = mpi_buf->diff_recv = mpi_buf->diff_halo = NULL;
+  mpi_buf->diff_synced = mpi_buf->diff_pending = 0;
 
   dat->mpi_buffer = mpi_buf;
 
@@ -543,6 +558,8 @@ op_decl_const_char ( int dim, char const * type, int size, char * dat,
 */
 
 void op_exit() {
+  op_exit_hooks_core(); // finishes I/O in flight
+
   // need to free buffer_d used for mpi comms in each op_dat
   if (OP_hybrid_gpu) {
     op_dat_entry *item;
@@ -674,6 +691,12 @@ void op_print_dat_to_binfile(op_dat dat, const char *file_name) {
   // need to get data from GPU
   op_cuda_get_data(dat);
 
+  if (OP_io_stream) {
+    // write straight from the partitioned data, without reordering it first
+    print_dat_to_binfile_mpi_stream(dat, file_name);
+    return;
+  }
+
   // rearrange data backe to original order in mpi
   op_dat temp = op_mpi_get_data(dat);
   print_dat_to_binfile_mpi(temp, file_name);
@@ -763,3 +786,19 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
   free(temp->set);
   free(temp);
 }
+
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  // need to get data from GPU
+  op_cuda_get_data(dat);
+
+  // no migration: the elements this rank holds, with their original indices
+  return op_mpi_fetch_data_owned(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  // need to get data from GPU
+  op_cuda_get_data(dat);
+
+  // only the owners of elements in the range send them, point to point
+  op_mpi_fetch_data_range(dat, usr_ptr, low, high);
+}
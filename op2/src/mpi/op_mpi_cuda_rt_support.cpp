@@ -682,6 +682,13 @@ void op_partition(const char *lib_name, const char *lib_routine,
   op_move_to_device();
 }
 
+void op_partition_restart(const char *file_name) {
+  partition_restart(file_name);
+  if (!OP_hybrid_gpu)
+    return;
+  op_move_to_device();
+}
+
 void op_move_to_device() {
   for (int s = 0; s < OP_set_index; s++) {
     op_set set = OP_set_list[s];
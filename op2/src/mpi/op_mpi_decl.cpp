@@ -57,6 +57,7 @@
 
 MPI_Comm OP_MPI_WORLD;
 MPI_Comm OP_MPI_GLOBAL;
+MPI_Comm OP_MPI_FETCH_WORLD = MPI_COMM_NULL;
 
 #ifdef HAVE_GPI
 gaspi_group_t OP_GPI_WORLD;
@@ -74,14 +75,27 @@ void op_init_soa(int argc, char **argv, int diags, int soa) {
   op_init(argc, argv, diags);
 }
 void op_init(int argc, char **argv, int diags) {
-  int flag = 0;
+  int flag = 0, provided;
+  int async = op_hdf5_async_requested(argc, argv);
   MPI_Initialized(&flag);
   if (!flag) {
-    flag = MPI_Init(&argc, &argv)==MPI_SUCCESS ? 1: 0;
+    // threads are only needed to write HDF5 files in the background, and
+    // MPI_THREAD_MULTIPLE can make every message slower
+    if (async && MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE,
+                                 &provided) == MPI_SUCCESS)
+      flag = 1;
+    else
+      flag = MPI_Init(&argc, &argv)==MPI_SUCCESS ? 1: 0;
   }
   
   OP_MPI_WORLD = MPI_COMM_WORLD;
   OP_MPI_GLOBAL = MPI_COMM_WORLD;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_FETCH_WORLD);
+
+  MPI_Query_thread(&provided);
+  if (async && provided < MPI_THREAD_MULTIPLE)
+    op_printf("MPI_THREAD_MULTIPLE is not available, HDF5 files will be "
+              "written in the foreground\n");
 
 #ifdef HAVE_GPI
   if(!flag){
@@ -135,6 +149,7 @@ void op_mpi_init(int argc, char **argv, int diags, MPI_Fint global,
   }
   OP_MPI_WORLD = MPI_Comm_f2c(local);
   OP_MPI_GLOBAL = MPI_Comm_f2c(global);
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_FETCH_WORLD);
 
 #ifdef HAVE_GPI
   fprintf(stderr, "GPI not initialised here\n");
@@ -211,6 +226,9 @@ op_dat op_decl_dat_temp_char(op_set set, int dim, char const *type, int size,
 
   mpi_buf->s_num_req = 0;
   mpi_buf->r_num_req = 0;
+  mpi_buf->shm_peer = NULL;
+  mpi_buf->diff_send = mpi_buf->diff_recv = mpi_buf->diff_halo = NULL;
+  mpi_buf->diff_synced = mpi_buf->diff_pending = 0;
 
   dat->mpi_buffer = mpi_buf;
 
@@ -226,9 +244,14 @@ op_dat op_decl_dat_temp_char(op_set set, int dim, char const *type, int size,
 }
 
 int op_free_dat_temp_char(op_dat dat) {
+  // its storage may be in a shared memory window
+  op_dat_shm_detach(dat);
   // need to free mpi_buffers used in this op_dat
   free(((op_mpi_buffer)(dat->mpi_buffer))->buf_exec);
   free(((op_mpi_buffer)(dat->mpi_buffer))->buf_nonexec);
+  free(((op_mpi_buffer)(dat->mpi_buffer))->diff_send);
+  free(((op_mpi_buffer)(dat->mpi_buffer))->diff_recv);
+  free(((op_mpi_buffer)(dat->mpi_buffer))->diff_halo);
   free(((op_mpi_buffer)(dat->mpi_buffer))->s_req);
   free(((op_mpi_buffer)(dat->mpi_buffer))->r_req);
   free(dat->mpi_buffer);
@@ -262,6 +285,16 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
   free(temp);
 }
 
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  // no migration: the elements this rank holds, with their original indices
+  return op_mpi_fetch_data_owned(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  // only the owners of elements in the range send them, point to point
+  op_mpi_fetch_data_range(dat, usr_ptr, low, high);
+}
+
 op_dat op_fetch_data_file_char(op_dat dat) {
   // rearrange data backe to original order in mpi
   return op_mpi_get_data(dat);
@@ -318,6 +351,7 @@ void op_print(const char *line) {
 }
 
 void op_exit() {
+  op_exit_hooks_core();
 
 #ifdef HAVE_GPI
   op_gpi_exit();
@@ -486,6 +520,12 @@ void op_timings_to_csv(const char *outputFileName) {
 }
 
 void op_print_dat_to_binfile(op_dat dat, const char *file_name) {
+  if (OP_io_stream) {
+    // write straight from the partitioned data, without reordering it first
+    print_dat_to_binfile_mpi_stream(dat, file_name);
+    return;
+  }
+
   // rearrange data backe to original order in mpi
   op_dat temp = op_mpi_get_data(dat);
   print_dat_to_binfile_mpi(temp, file_name);
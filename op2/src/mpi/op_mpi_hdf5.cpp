@@ -72,11 +72,10 @@ MPI_Comm OP_MPI_HDF5_WORLD;
 extern "C" {
 #endif
 
-int compute_local_size_weight(int global_size, int mpi_comm_size,
-                              int mpi_rank) {
-  int *hybrid_flags = (int *)xmalloc(mpi_comm_size * sizeof(int));
-  MPI_Allgather(&OP_hybrid_gpu, 1, MPI_INT, hybrid_flags, 1, MPI_INT,
-                OP_MPI_HDF5_WORLD);
+/* local size of a set of global_size elements on mpi_rank, given whether each
+   rank runs on a GPU in the hybrid CPU/GPU mode */
+static int local_size_weight(int global_size, int mpi_comm_size, int mpi_rank,
+                             int *hybrid_flags) {
   double total = 0;
   for (int i = 0; i < mpi_comm_size; i++)
     total += hybrid_flags[i] == 1 ? OP_hybrid_balance : 1.0;
@@ -87,7 +86,8 @@ int compute_local_size_weight(int global_size, int mpi_comm_size,
   int local_start = ((double)global_size) * (cumulative / total);
   int local_end =
       ((double)global_size) *
-      ((cumulative + (OP_hybrid_gpu ? OP_hybrid_balance : 1.0)) / total);
+      ((cumulative + (hybrid_flags[mpi_rank] ? OP_hybrid_balance : 1.0)) /
+       total);
   if (mpi_rank + 1 == mpi_comm_size)
     local_end = global_size; // make sure we don't have rounding problems
   int local_size = local_end - local_start;
@@ -95,66 +95,266 @@ int compute_local_size_weight(int global_size, int mpi_comm_size,
   return local_size;
 }
 
+int compute_local_size_weight(int global_size, int mpi_comm_size,
+                              int mpi_rank) {
+  int *hybrid_flags = (int *)xmalloc(mpi_comm_size * sizeof(int));
+  MPI_Allgather(&OP_hybrid_gpu, 1, MPI_INT, hybrid_flags, 1, MPI_INT,
+                OP_MPI_HDF5_WORLD);
+  int local_size =
+      local_size_weight(global_size, mpi_comm_size, mpi_rank, hybrid_flags);
+  op_free(hybrid_flags);
+  return local_size;
+}
+
 /*******************************************************************************
-* Routine to read an op_set from an hdf5 file
+* Routines to open an hdf5 file once for reading several op_sets, op_maps and
+* op_dats, sharing the communicator and property lists between the reads
 *******************************************************************************/
 
-op_set op_decl_set_hdf5(char const *file, char const *name) {
-  // create new communicator
+struct op_hdf5_file_core {
+  char *name;
+  hid_t file_id;
+  hid_t dxpl; // collective transfer
+  hid_t dapl; // chunk cache, see op_hdf5_access_plist
+  MPI_Comm comm;
   int my_rank, comm_size;
-  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
-  MPI_Comm_rank(OP_MPI_HDF5_WORLD, &my_rank);
-  MPI_Comm_size(OP_MPI_HDF5_WORLD, &comm_size);
+  int *hybrid_flags; // OP_hybrid_gpu of each rank, for the local set sizes
+  hid_t part_id; // file of the partition vectors, see op_hdf5_use_partition
+  int nparted;   // sets read straight into their partition, and the original
+  op_set *parted_sets; // global index of their local elements
+  int **parted_rows;
+};
+
+/* rows of the file read for the elements of set, NULL if the set was
+   declared with the block distribution */
+static int *partitioned_rows(op_hdf5_file f, op_set set) {
+  for (int i = 0; i < f->nparted; i++)
+    if (f->parted_sets[i] == set)
+      return f->parted_rows[i];
+  return NULL;
+}
 
-  // MPI variables
-  MPI_Info info = MPI_INFO_NULL;
+/* selects the rows of a 2D dataspace listed in increasing order, as a union
+   of hyperslabs over the runs of consecutive rows */
+static void select_rows(hid_t space, int *rows, int n, int dim) {
+  H5Sselect_none(space);
+  hsize_t offset[2] = {0, 0};
+  hsize_t count[2] = {0, (hsize_t)dim};
+  for (int i = 0; i < n;) {
+    int j = i + 1;
+    while (j < n && rows[j] == rows[j - 1] + 1)
+      j++;
+    offset[0] = rows[i];
+    count[0] = j - i;
+    H5Sselect_hyperslab(space, H5S_SELECT_OR, offset, NULL, count, NULL);
+    i = j;
+  }
+}
 
-  // HDF5 APIs definitions
-  hid_t file_id;  // file identifier
-  hid_t plist_id; // property list identifier
-  hid_t dset_id;  // dataset identifier
+op_hdf5_file op_hdf5_open(char const *file) {
+  op_dump_to_hdf5_wait();
+  op_hdf5_file f = (op_hdf5_file)xmalloc(sizeof(struct op_hdf5_file_core));
+  MPI_Comm_dup(OP_MPI_WORLD, &f->comm);
+  MPI_Comm_rank(f->comm, &f->my_rank);
+  MPI_Comm_size(f->comm, &f->comm_size);
 
   if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_set_hdf5()\n",
-              file);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    op_printf("File %s does not exist .... aborting op_hdf5_open()\n", file);
+    MPI_Abort(f->comm, 2);
   }
 
   // Set up file access property list with parallel I/O access
-  plist_id = H5Pcreate(H5P_FILE_ACCESS);
-  H5Pset_fapl_mpio(plist_id, OP_MPI_HDF5_WORLD, info);
+  hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist_id, f->comm, MPI_INFO_NULL);
+  f->file_id = H5Fopen(file, H5F_ACC_RDONLY, plist_id);
+  H5Pclose(plist_id);
+  if (f->file_id < 0) {
+    op_printf("Could not obtain read access to file '%s'\n", file);
+    MPI_Abort(f->comm, 2);
+  }
 
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, plist_id);
+  // Create property list for collective dataset reads.
+  f->dxpl = H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(f->dxpl, H5FD_MPIO_COLLECTIVE);
+  f->dapl = op_hdf5_access_plist();
+
+  f->hybrid_flags = (int *)xmalloc(f->comm_size * sizeof(int));
+  MPI_Allgather(&OP_hybrid_gpu, 1, MPI_INT, f->hybrid_flags, 1, MPI_INT,
+                f->comm);
+  f->name = strdup(file);
+  f->part_id = -1;
+  f->nparted = 0;
+  f->parted_sets = NULL;
+  f->parted_rows = NULL;
+  return f;
+}
+
+void op_hdf5_use_partition(op_hdf5_file f, char const *part_file) {
+  if (f->part_id >= 0)
+    H5Fclose(f->part_id);
+  if (strcmp(part_file, f->name) == 0) {
+    H5Iinc_ref(f->file_id);
+    f->part_id = f->file_id;
+    return;
+  }
+
+  if (file_exist(part_file) == 0) {
+    op_printf("File %s does not exist .... aborting op_hdf5_use_partition()\n",
+              part_file);
+    MPI_Abort(f->comm, 2);
+  }
+  hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist_id, f->comm, MPI_INFO_NULL);
+  f->part_id = H5Fopen(part_file, H5F_ACC_RDONLY, plist_id);
   H5Pclose(plist_id);
+  if (f->part_id < 0) {
+    op_printf("Could not obtain read access to file '%s'\n", part_file);
+    MPI_Abort(f->comm, 2);
+  }
+}
+
+void op_hdf5_close(op_hdf5_file f) {
+  op_dump_to_hdf5_wait();
+  H5Pclose(f->dxpl);
+  op_hdf5_close_plist(f->dapl);
+  if (f->part_id >= 0)
+    H5Fclose(f->part_id);
+  H5Fclose(f->file_id);
+  // the rows are the g_index of the sets, now owned by op_partition
+  op_free(f->parted_sets);
+  op_free(f->parted_rows);
+  MPI_Comm_free(&f->comm);
+  op_free(f->hybrid_flags);
+  free(f->name);
+  op_free(f);
+}
+
+/*******************************************************************************
+* Routine to read an op_set from an hdf5 file
+*******************************************************************************/
+
+op_set op_hdf5_decl_set(op_hdf5_file f, char const *name) {
+  op_dump_to_hdf5_wait();
 
   // Create the dataset with default properties and close dataspace.
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  hid_t dset_id = H5Dopen(f->file_id, name, H5P_DEFAULT);
   if (dset_id < 0) {
-    op_printf("Could not open dataset '%s' in file '%s'\n", name, file);
-    H5Fclose(file_id);
+    op_printf("Could not open dataset '%s' in file '%s'\n", name, f->name);
     return NULL;
   }
 
-  // Create property list for collective dataset read.
-  plist_id = H5Pcreate(H5P_DATASET_XFER);
-  H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
-
   int g_size = 0;
   // read data
-  H5Dread(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, plist_id, &g_size);
-
-  H5Pclose(plist_id);
+  H5Dread(dset_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, f->dxpl, &g_size);
   H5Dclose(dset_id);
-  H5Fclose(file_id);
+  if (g_size < 0) {
+    op_printf("Set '%s' in file '%s' has a negative size %d\n", name, f->name,
+              g_size);
+    MPI_Abort(f->comm, 2);
+  }
 
   // calculate local size of set for this mpi process
-  int l_size = compute_local_size_weight(g_size, comm_size, my_rank);
-  MPI_Comm_free(&OP_MPI_HDF5_WORLD);
+  int l_size =
+      local_size_weight(g_size, f->comm_size, f->my_rank, f->hybrid_flags);
 
-  return op_decl_set(l_size, name);
+  if (f->part_id < 0)
+    return op_decl_set(l_size, name);
+
+  // read this rank's block of the partition vector, and send the index of
+  // each element to the rank it belongs to
+  char *path = (char *)xmalloc(strlen(name) + 11);
+  sprintf(path, "partition/%s", name);
+  dset_id = H5Dopen(f->part_id, path, H5P_DEFAULT);
+  if (dset_id < 0) {
+    op_printf("Partition vector '%s' not found\n", path);
+    MPI_Abort(f->comm, 2);
+  }
+  op_hdf5_dataset_properties dset_props;
+  if (get_dataset_properties(dset_id, &dset_props) < 0 ||
+      dset_props.size != (hsize_t)g_size || dset_props.dim != 1) {
+    op_printf("Partition vector '%s' does not match the size of set %s\n",
+              path, name);
+    MPI_Abort(f->comm, 2);
+  }
+  free((char *)dset_props.type_str);
+
+  int disp = 0;
+  for (int i = 0; i < f->my_rank; i++)
+    disp += local_size_weight(g_size, f->comm_size, i, f->hybrid_flags);
+  hsize_t count[2] = {(hsize_t)l_size, 1};
+  hsize_t offset[2] = {(hsize_t)disp, 0};
+  hid_t memspace = H5Screate_simple(2, count, NULL);
+  hid_t dataspace = H5Dget_space(dset_id);
+  H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
+  int *owner = (int *)xmalloc(sizeof(int) * (l_size + 1));
+  H5Dread(dset_id, H5T_NATIVE_INT, memspace, dataspace, f->dxpl, owner);
+  H5Sclose(memspace);
+  H5Sclose(dataspace);
+  H5Dclose(dset_id);
+
+  int comm_size = f->comm_size;
+  int *send_count = (int *)xcalloc(comm_size, sizeof(int));
+  int *send_displs = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_count = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_displs = (int *)xmalloc(comm_size * sizeof(int));
+  for (int i = 0; i < l_size; i++) {
+    if (owner[i] < 0 || owner[i] >= comm_size) {
+      printf("Partition vector '%s' assigns an element to rank %d, but there "
+             "are %d ranks\n",
+             path, owner[i], comm_size);
+      MPI_Abort(f->comm, 2);
+    }
+    send_count[owner[i]]++;
+  }
+  send_displs[0] = 0;
+  for (int r = 1; r < comm_size; r++)
+    send_displs[r] = send_displs[r - 1] + send_count[r - 1];
+  int *sbuf = (int *)xmalloc(sizeof(int) * (l_size + 1));
+  int *pos = (int *)xmalloc(comm_size * sizeof(int));
+  memcpy(pos, send_displs, comm_size * sizeof(int));
+  for (int i = 0; i < l_size; i++)
+    sbuf[pos[owner[i]]++] = disp + i;
+  op_free(pos);
+  op_free(owner);
+
+  MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, f->comm);
+  int n = 0;
+  for (int r = 0; r < comm_size; r++) {
+    recv_displs[r] = n;
+    n += recv_count[r];
+  }
+  // blocks arrive in rank order, each in increasing order, so the rows are
+  // sorted like the g_index of a set after migration
+  int *rows = (int *)xmalloc(sizeof(int) * (n + 1));
+  MPI_Alltoallv(sbuf, send_count, send_displs, MPI_INT, rows, recv_count,
+                recv_displs, MPI_INT, f->comm);
+  op_free(sbuf);
+  op_free(send_count);
+  op_free(send_displs);
+  op_free(recv_count);
+  op_free(recv_displs);
+  op_free(path);
+
+  op_set set = op_decl_set(n, name);
+  op_partition_preload(set, rows, l_size);
+  f->parted_sets =
+      (op_set *)xrealloc(f->parted_sets, (f->nparted + 1) * sizeof(op_set));
+  f->parted_rows =
+      (int **)xrealloc(f->parted_rows, (f->nparted + 1) * sizeof(int *));
+  f->parted_sets[f->nparted] = set;
+  f->parted_rows[f->nparted++] = rows;
+  return set;
+}
+
+op_set op_decl_set_hdf5(char const *file, char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_set set = op_hdf5_decl_set(f, name);
+  op_hdf5_close(f);
+  return set;
 }
 
 op_set op_decl_set_hdf5_infer_size(char const *file, char const *name, char const *set_dataset_name) {
+  op_dump_to_hdf5_wait();
   // op_printf("op_decl_set_hdf5_infer_size() called in op_mpi_hdf5.c\n");
   // create new communicator
   int my_rank, comm_size;
@@ -236,20 +436,13 @@ op_set op_decl_set_hdf5_infer_size(char const *file, char const *name, char cons
 * Routine to read an op_map from an hdf5 file
 *******************************************************************************/
 
-op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
+op_map op_hdf5_decl_map(op_hdf5_file f, op_set from, op_set to, int dim,
                         char const *name) {
-  // create new communicator
-  int my_rank, comm_size;
-  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
-  MPI_Comm_rank(OP_MPI_HDF5_WORLD, &my_rank);
-  MPI_Comm_size(OP_MPI_HDF5_WORLD, &comm_size);
-
-  // MPI variables
-  MPI_Info info = MPI_INFO_NULL;
+  op_dump_to_hdf5_wait();
+  char const *file = f->name;
+  int my_rank = f->my_rank, comm_size = f->comm_size;
 
   // HDF5 APIs definitions
-  hid_t file_id;   // file identifier
-  hid_t plist_id;  // property list identifier
   hid_t dset_id;   // dataset identifier
   hid_t dataspace; // data space identifier
   hid_t memspace;  // memory space identifier
@@ -258,28 +451,16 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   hsize_t count[2]; // hyperslab selection parameters
   hsize_t offset[2];
 
-  if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_map_hdf5()\n",
-              file);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
-  }
-
-  // Set up file access property list with parallel I/O access
-  plist_id = H5Pcreate(H5P_FILE_ACCESS);
-  H5Pset_fapl_mpio(plist_id, OP_MPI_HDF5_WORLD, info);
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, plist_id);
-  H5Pclose(plist_id);
-
   /* Save old error handler */
   H5E_auto_t old_func;
   void *old_client_data;
   H5error_off(&old_func, &old_client_data);
 
   /*open data set*/
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  dset_id = H5Dopen(f->file_id, name, f->dapl);
   if (dset_id < 0) {
     op_printf("op_map with name : %s not found in file : %s \n", name, file);
-    H5Fclose(file_id);
+    H5error_on(old_func, old_client_data);
     return NULL;
   }
 
@@ -288,26 +469,29 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   if (status < 0) {
     op_printf("Could not get properties of dataset '%s' in file '%s'\n", name,
               file);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
   int g_size = dset_props.size;
 
   // calculate local size of set for this mpi process
-  int l_size = compute_local_size_weight(g_size, comm_size, my_rank);
+  int *rows = partitioned_rows(f, from);
+  int l_size = rows != NULL ? from->size
+                            : local_size_weight(g_size, comm_size, my_rank,
+                                                f->hybrid_flags);
   // check if size is accurate
   if (from->size != l_size) {
     op_printf(
         "map from set size %d in file %s and size %d do not match on rank %d\n",
         l_size, file, from->size, my_rank);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
   int map_dim = dset_props.dim;
   if (map_dim != dim) {
     op_printf("map.dim %d in file %s and dim %d do not match\n", map_dim, file,
               dim);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
   const char *typ = dset_props.type_str;
@@ -318,13 +502,10 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   /*read in map in hyperslabs*/
 
   // Each process defines dataset in memory and reads from a hyperslab in the
-  // file.
+  // file, the blocks of the lower ranks come first.
   int disp = 0;
-  int *sizes = (int *)xmalloc(sizeof(int) * comm_size);
-  MPI_Allgather(&l_size, 1, MPI_INT, sizes, 1, MPI_INT, OP_MPI_HDF5_WORLD);
   for (int i = 0; i < my_rank; i++)
-    disp = disp + sizes[i];
-  op_free(sizes);
+    disp = disp + local_size_weight(g_size, comm_size, i, f->hybrid_flags);
 
   count[0] = l_size;
   count[1] = dim;
@@ -332,36 +513,32 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   offset[1] = 0;
   memspace = H5Screate_simple(2, count, NULL);
 
-  // Select hyperslab in the file.
+  // Select hyperslab in the file, or the rows of the partition.
   dataspace = H5Dget_space(dset_id);
-  H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-  // Create property list for collective dataset write.
-  plist_id = H5Pcreate(H5P_DATASET_XFER);
-  H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
+  if (rows != NULL)
+    select_rows(dataspace, rows, l_size, dim);
+  else
+    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
 
   // initialize data buffer and read data
   int *map = 0;
   if (strcmp(typ, "int") == 0 || strcmp(typ, "integer(4)") == 0) {
     map = (int *)xmalloc(sizeof(int) * l_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_INT, memspace, dataspace, plist_id, map);
+    H5Dread(dset_id, H5T_NATIVE_INT, memspace, dataspace, f->dxpl, map);
   } else if (strcmp(typ, "long") == 0) {
     map = (int *)xmalloc(sizeof(long) * l_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_LONG, memspace, dataspace, plist_id, map);
+    H5Dread(dset_id, H5T_NATIVE_LONG, memspace, dataspace, f->dxpl, map);
   } else if (strcmp(typ, "long long") == 0) {
     map = (int *)xmalloc(sizeof(long) * l_size * dim);
-    H5Dread(dset_id, H5T_NATIVE_LLONG, memspace, dataspace, plist_id, map);
+    H5Dread(dset_id, H5T_NATIVE_LLONG, memspace, dataspace, f->dxpl, map);
   } else {
     op_printf("unknown type\n");
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
-  H5Pclose(plist_id);
   H5Sclose(memspace);
   H5Sclose(dataspace);
   H5Dclose(dset_id);
-  H5Fclose(file_id);
-  MPI_Comm_free(&OP_MPI_HDF5_WORLD);
 
   free((char*)dset_props.type_str);
 
@@ -371,56 +548,43 @@ op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
   return new_map;
 }
 
+op_map op_decl_map_hdf5(op_set from, op_set to, int dim, char const *file,
+                        char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_map map = op_hdf5_decl_map(f, from, to, dim, name);
+  op_hdf5_close(f);
+  return map;
+}
+
 /*******************************************************************************
 * Routine to read an op_dat from an hdf5 file
 *******************************************************************************/
 
-op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
+op_dat op_hdf5_decl_dat(op_hdf5_file f, op_set set, int dim, char const *type,
                         char const *name) {
-  // create new communicator
-  int my_rank, comm_size;
-  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
-  MPI_Comm_rank(OP_MPI_HDF5_WORLD, &my_rank);
-  MPI_Comm_size(OP_MPI_HDF5_WORLD, &comm_size);
-
-  // MPI variables
-  MPI_Info info = MPI_INFO_NULL;
+  op_dump_to_hdf5_wait();
+  char const *file = f->name;
+  int my_rank = f->my_rank, comm_size = f->comm_size;
 
   // HDF5 APIs definitions
-  hid_t file_id;   // file identifier
-  hid_t plist_id;  // property list identifier
   hid_t dset_id;   // dataset identifier
   hid_t dataspace; // data space identifier
   hid_t memspace;  // memory space identifier
 
   hsize_t count[2]; // hyperslab selection parameters
   hsize_t offset[2];
-  hid_t attr; // attribute identifier
   herr_t status;
 
-  if (file_exist(file) == 0) {
-    op_printf("File %s does not exist .... aborting op_decl_dat_hdf5()\n",
-              file);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
-  }
-
-  // Set up file access property list with parallel I/O access
-  plist_id = H5Pcreate(H5P_FILE_ACCESS);
-  H5Pset_fapl_mpio(plist_id, OP_MPI_HDF5_WORLD, info);
-
-  file_id = H5Fopen(file, H5F_ACC_RDONLY, plist_id);
-  H5Pclose(plist_id);
-
   /* Save old error handler */
   H5E_auto_t old_func;
   void *old_client_data;
   H5error_off(&old_func, &old_client_data);
 
   /*open data set*/
-  dset_id = H5Dopen(file_id, name, H5P_DEFAULT);
+  dset_id = H5Dopen(f->file_id, name, f->dapl);
   if (dset_id < 0) {
     op_printf("op_dat with name : %s not found in file : %s \n", name, file);
-    H5Fclose(file_id);
+    H5error_on(old_func, old_client_data);
     return NULL;
   }
 
@@ -429,7 +593,7 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   if (status < 0) {
     op_printf("Could not get properties of dataset '%s' in file '%s'\n", name,
               file);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
   size_t type_size;
 
@@ -437,7 +601,7 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   if (dat_dim != dim) {
     op_printf("dat.dim %d in file %s and dim %d do not match\n", dat_dim, file,
               dim);
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
   const char *typ = dset_props.type_str;
@@ -454,12 +618,15 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   // Create the dataset with default properties and close dataspace.
   // Each process defines dataset in memory and reads from a hyperslab in the
   // file.
+  int *rows = partitioned_rows(f, set);
   int disp = 0;
-  int *sizes = (int *)xmalloc(sizeof(int) * comm_size);
-  MPI_Allgather(&(set->size), 1, MPI_INT, sizes, 1, MPI_INT, OP_MPI_HDF5_WORLD);
-  for (int i = 0; i < my_rank; i++)
-    disp = disp + sizes[i];
-  op_free(sizes);
+  if (rows == NULL) {
+    int *sizes = (int *)xmalloc(sizeof(int) * comm_size);
+    MPI_Allgather(&(set->size), 1, MPI_INT, sizes, 1, MPI_INT, f->comm);
+    for (int i = 0; i < my_rank; i++)
+      disp = disp + sizes[i];
+    op_free(sizes);
+  }
 
   count[0] = set->size;
   count[1] = dim;
@@ -467,44 +634,40 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   offset[1] = 0;
   memspace = H5Screate_simple(2, count, NULL);
 
-  // Select hyperslab in the file.
+  // Select hyperslab in the file, or the rows of the partition.
   dataspace = H5Dget_space(dset_id);
-  H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-  // Create property list for collective dataset write.
-  plist_id = H5Pcreate(H5P_DATASET_XFER);
-  H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
+  if (rows != NULL)
+    select_rows(dataspace, rows, set->size, dim);
+  else
+    H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
 
   // initialize data buffer and read in data
   char *data = 0;
   if (strcmp(type, "double") == 0 || strcmp(type, "double:soa") == 0 ||
       strcmp(type, "double precision") == 0 || strcmp(type, "real(8)") == 0) {
     data = (char *)xmalloc(set->size * dim * sizeof(double));
-    H5Dread(dset_id, H5T_NATIVE_DOUBLE, memspace, dataspace, plist_id, data);
+    H5Dread(dset_id, H5T_NATIVE_DOUBLE, memspace, dataspace, f->dxpl, data);
     type_size = sizeof(double);
   } else if (strcmp(type, "float") == 0 || strcmp(type, "float:soa") == 0 ||
              strcmp(type, "real(4)") == 0 || strcmp(type, "real") == 0) {
     data = (char *)xmalloc(set->size * dim * sizeof(float));
-    H5Dread(dset_id, H5T_NATIVE_FLOAT, memspace, dataspace, plist_id, data);
+    H5Dread(dset_id, H5T_NATIVE_FLOAT, memspace, dataspace, f->dxpl, data);
     type_size = sizeof(float);
 
   } else if (strcmp(type, "int") == 0 || strcmp(type, "int:soa") == 0 ||
              strcmp(type, "int(4)") == 0 || strcmp(type, "integer") == 0 ||
              strcmp(type, "integer(4)") == 0) {
     data = (char *)xmalloc(set->size * dim * sizeof(int));
-    H5Dread(dset_id, H5T_NATIVE_INT, memspace, dataspace, plist_id, data);
+    H5Dread(dset_id, H5T_NATIVE_INT, memspace, dataspace, f->dxpl, data);
     type_size = sizeof(int);
   } else {
     op_printf("unknown type\n");
-    MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    MPI_Abort(f->comm, 2);
   }
 
-  H5Pclose(plist_id);
   H5Sclose(memspace);
   H5Sclose(dataspace);
   H5Dclose(dset_id);
-  H5Fclose(file_id);
-  MPI_Comm_free(&OP_MPI_HDF5_WORLD);
 
   free((char*)dset_props.type_str);
 
@@ -513,11 +676,20 @@ op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
   return new_dat;
 }
 
+op_dat op_decl_dat_hdf5(op_set set, int dim, char const *type, char const *file,
+                        char const *name) {
+  op_hdf5_file f = op_hdf5_open(file);
+  op_dat dat = op_hdf5_decl_dat(f, set, dim, type, name);
+  op_hdf5_close(f);
+  return dat;
+}
+
 /*******************************************************************************
 * Routine to read in a constant from a named hdf5 file
 *******************************************************************************/
 void op_get_const_hdf5(char const *name, int dim, char const *type,
                        char *const_data, char const *file_name) {
+  op_dump_to_hdf5_wait();
   // create new communicator
   int my_rank, comm_size;
   MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
@@ -635,6 +807,7 @@ void op_get_const_hdf5(char const *name, int dim, char const *type,
 * Routine to write all to a named hdf5 file
 *******************************************************************************/
 void op_dump_to_hdf5(char const *file_name) {
+  op_dump_to_hdf5_wait();
   op_printf("Writing to %s\n", file_name);
 
   // declare timers
@@ -737,28 +910,32 @@ void op_dump_to_hdf5(char const *file_name) {
     plist_id = H5Pcreate(H5P_DATASET_XFER);
     H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
 
+    hid_t dcpl = op_hdf5_create_plist(g_size, map->dim, sizeof(map->map[0]),
+                                      comm_size, 1);
+
     // create map path
     create_path(map->name, file_id);
 
     // Create the dataset with default properties and close dataspace.
     if (sizeof(map->map[0]) == sizeof(int)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_INT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, dataspace, plist_id,
                map->map);
     } else if (sizeof(map->map[0]) == sizeof(long)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_LONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LONG, memspace, dataspace, plist_id,
                map->map);
     } else if (sizeof(map->map[0]) == sizeof(long long)) {
       dset_id = H5Dcreate(file_id, map->name, H5T_NATIVE_LLONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LLONG, memspace, dataspace, plist_id,
                map->map);
     }
 
     H5Dclose(dset_id);
+    op_hdf5_close_plist(dcpl);
     H5Pclose(plist_id);
     H5Sclose(memspace);
     H5Sclose(dataspace);
@@ -848,6 +1025,9 @@ void op_dump_to_hdf5(char const *file_name) {
     plist_id = H5Pcreate(H5P_DATASET_XFER);
     H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
 
+    hid_t dcpl = op_hdf5_create_plist(g_size, dat->dim, dat->size / dat->dim,
+                                      comm_size, 0);
+
     // create dateset path
     create_path(dat->name, file_id);
 
@@ -857,7 +1037,7 @@ void op_dump_to_hdf5(char const *file_name) {
         strcmp(dat->type, "double precision") == 0 ||
         strcmp(dat->type, "real(8)") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_DOUBLE, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, memspace, dataspace, plist_id,
                dat->data);
     } else if (strcmp(dat->type, "float") == 0 ||
@@ -865,7 +1045,7 @@ void op_dump_to_hdf5(char const *file_name) {
                strcmp(dat->type, "real(4)") == 0 ||
                strcmp(dat->type, "real") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_FLOAT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, dataspace, plist_id,
                dat->data);
     } else if (strcmp(dat->type, "int") == 0 ||
@@ -874,19 +1054,19 @@ void op_dump_to_hdf5(char const *file_name) {
                strcmp(dat->type, "integer") == 0 ||
                strcmp(dat->type, "integer(4)") == 0) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_INT, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, dataspace, plist_id,
                dat->data);
     } else if ((strcmp(dat->type, "long") == 0) ||
                (strcmp(dat->type, "long:soa") == 0)) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_LONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LONG, memspace, dataspace, plist_id,
                dat->data);
     } else if ((strcmp(dat->type, "long long") == 0) ||
                (strcmp(dat->type, "long long:soa") == 0)) {
       dset_id = H5Dcreate(file_id, dat->name, H5T_NATIVE_LLONG, dataspace,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT);
       H5Dwrite(dset_id, H5T_NATIVE_LLONG, memspace, dataspace, plist_id,
                dat->data);
     } else {
@@ -895,6 +1075,7 @@ void op_dump_to_hdf5(char const *file_name) {
     }
 
     H5Dclose(dset_id);
+    op_hdf5_close_plist(dcpl);
     H5Pclose(plist_id);
     H5Sclose(memspace);
     H5Sclose(dataspace);
@@ -951,11 +1132,183 @@ void op_dump_to_hdf5(char const *file_name) {
   MPI_Comm_free(&OP_MPI_HDF5_WORLD);
 }
 
+/*******************************************************************************
+* Routine to write all to a named hdf5 file on a helper thread, the data is
+* copied first so the caller can carry on and change it. The collective writes
+* are made from the helper thread, so this needs MPI_THREAD_MULTIPLE, otherwise
+* the snapshot is written before returning
+*******************************************************************************/
+void op_dump_to_hdf5_async(char const *file_name) {
+  // only one dump is in flight at a time
+  op_dump_to_hdf5_wait();
+
+  int my_rank, comm_size, thread_level;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
+  MPI_Comm_rank(OP_MPI_HDF5_WORLD, &my_rank);
+  MPI_Comm_size(OP_MPI_HDF5_WORLD, &comm_size);
+  MPI_Query_thread(&thread_level);
+  int background = thread_level == MPI_THREAD_MULTIPLE;
+  if (background)
+    op_printf("Writing to %s in the background\n", file_name);
+  else
+    op_printf("Writing to %s, MPI_THREAD_MULTIPLE (OP_HDF5_ASYNC) is needed "
+              "to write in the background\n",
+              file_name);
+
+  op_hdf5_dump *dump = new op_hdf5_dump;
+  dump->file_name = strdup(file_name);
+  // HDF5 keeps its own duplicate of the communicator
+  dump->fapl = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(dump->fapl, OP_MPI_HDF5_WORLD, MPI_INFO_NULL);
+  dump->dxpl = H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(dump->dxpl, H5FD_MPIO_COLLECTIVE);
+  dump->nparts = comm_size;
+  dump->n = 0;
+  dump->entries = (op_hdf5_dump_entry *)xmalloc(
+      (OP_set_index + OP_map_index + OP_dat_index) * sizeof(op_hdf5_dump_entry));
+
+  // global sizes and offsets of the sets, in one collective
+  int *sizes = (int *)xmalloc(sizeof(int) * comm_size * OP_set_index);
+  int *local = (int *)xmalloc(sizeof(int) * OP_set_index);
+  for (int s = 0; s < OP_set_index; s++)
+    local[s] = OP_set_list[s]->size;
+  MPI_Allgather(local, OP_set_index, MPI_INT, sizes, OP_set_index, MPI_INT,
+                OP_MPI_HDF5_WORLD);
+  hsize_t *g_size = (hsize_t *)xmalloc(sizeof(hsize_t) * OP_set_index);
+  hsize_t *disp = (hsize_t *)xmalloc(sizeof(hsize_t) * OP_set_index);
+  for (int s = 0; s < OP_set_index; s++) {
+    g_size[s] = disp[s] = 0;
+    for (int i = 0; i < comm_size; i++) {
+      g_size[s] += sizes[i * OP_set_index + s];
+      if (i < my_rank)
+        disp[s] += sizes[i * OP_set_index + s];
+    }
+  }
+
+  for (int s = 0; s < OP_set_index; s++) {
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    memset(entry, 0, sizeof(op_hdf5_dump_entry));
+    entry->name = strdup(OP_set_list[s]->name);
+    entry->g_size = g_size[s];
+  }
+
+  for (int m = 0; m < OP_map_index; m++) {
+    op_map map = OP_map_list[m];
+    if (map->dim == 0 || g_size[map->from->index] == 0)
+      continue;
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    entry->name = strdup(map->name);
+    entry->type = strdup("int");
+    entry->type_len = 10;
+    entry->h5type = H5T_NATIVE_INT;
+    entry->dim = map->dim;
+    entry->is_map = 1;
+    entry->size = (int)g_size[map->from->index];
+    entry->g_size = g_size[map->from->index];
+    entry->offset = disp[map->from->index];
+    entry->count = map->from->size;
+    size_t bytes = (size_t)map->from->size * map->dim * sizeof(int);
+    entry->data = (char *)xmalloc(bytes);
+    memcpy(entry->data, map->map, bytes);
+  }
+
+  op_dat_entry *item;
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    op_dat dat = item->dat;
+    if (dat->size == 0 || g_size[dat->set->index] == 0)
+      continue;
+    op_hdf5_dump_entry *entry = &dump->entries[dump->n++];
+    entry->h5type = op_hdf5_dat_type(dat->type);
+    if (entry->h5type < 0) {
+      op_printf("Unknown type - in op_dump_to_hdf5_async() writing op_dats\n");
+      MPI_Abort(OP_MPI_HDF5_WORLD, 2);
+    }
+    entry->name = strdup(dat->name);
+    entry->type = strdup(dat->type);
+    entry->type_len = strlen(dat->type);
+    entry->dim = dat->dim;
+    entry->is_map = 0;
+    entry->size = dat->size;
+    entry->g_size = g_size[dat->set->index];
+    entry->offset = disp[dat->set->index];
+    entry->count = dat->set->size;
+    size_t bytes = (size_t)dat->set->size * dat->size;
+    entry->data = (char *)xmalloc(bytes);
+    memcpy(entry->data, dat->data, bytes);
+  }
+
+  op_free(sizes);
+  op_free(local);
+  op_free(g_size);
+  op_free(disp);
+  MPI_Comm_free(&OP_MPI_HDF5_WORLD);
+
+  op_hdf5_dump_start(dump, background);
+}
+
+/*******************************************************************************
+* Routines to open a stream of snapshots of selected op_dats in a named hdf5
+* file and register the op_dats, see op_hdf5_stream_step. Each process writes
+* its own elements at their original indices, so the op_dats are not
+* migrated back to the original partitioning
+*******************************************************************************/
+
+void op_hdf5_stream_open(char const *file_name, int cadence) {
+  op_dump_to_hdf5_wait();
+  if (OP_hdf5_stream != NULL) {
+    op_printf("op_hdf5_stream_open error -- a stream is already open\n");
+    MPI_Abort(OP_MPI_WORLD, 2);
+  }
+
+  int my_rank, comm_size, thread_level;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_HDF5_WORLD);
+  MPI_Comm_rank(OP_MPI_HDF5_WORLD, &my_rank);
+  MPI_Comm_size(OP_MPI_HDF5_WORLD, &comm_size);
+  MPI_Query_thread(&thread_level);
+
+  op_hdf5_stream_core *s =
+      (op_hdf5_stream_core *)xcalloc(1, sizeof(op_hdf5_stream_core));
+  s->background = thread_level == MPI_THREAD_MULTIPLE;
+  if (s->background)
+    op_printf("Streaming to %s every %d steps\n", file_name, cadence);
+  else
+    op_printf("Streaming to %s every %d steps, MPI_THREAD_MULTIPLE "
+              "(OP_HDF5_ASYNC) is needed to write in the background\n",
+              file_name, cadence);
+
+  // HDF5 keeps its own duplicate of the communicator
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(fapl, OP_MPI_HDF5_WORLD, MPI_INFO_NULL);
+  s->file_id = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+  H5Pclose(fapl);
+  MPI_Comm_free(&OP_MPI_HDF5_WORLD);
+  if (s->file_id < 0) {
+    op_printf("Could not create file '%s'\n", file_name);
+    MPI_Abort(OP_MPI_WORLD, 2);
+  }
+  s->dxpl = H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(s->dxpl, H5FD_MPIO_COLLECTIVE);
+  s->nparts = comm_size;
+  s->rank = my_rank;
+  s->cadence = MAX(cadence, 1);
+  s->step_dset = -1;
+  OP_hdf5_stream = s;
+  op_register_exit_hook(op_hdf5_exit);
+}
+
+void op_hdf5_stream_dat(op_dat dat) {
+  // collective: the global size, and the original index of each element
+  int size = dat->set->size, g_size = 0;
+  MPI_Allreduce(&size, &g_size, 1, MPI_INT, MPI_SUM, OP_MPI_WORLD);
+  op_hdf5_stream_add(dat, g_size, OP_part_list[dat->set->index]->g_index);
+}
+
 /*******************************************************************************
 * Routine to write a constant to a named hdf5 file
 *******************************************************************************/
 void op_write_const_hdf5(char const *name, int dim, char const *type,
                          char *const_data, char const *file_name) {
+  op_dump_to_hdf5_wait();
   // letting know that writing is happening ...
   op_printf("Writing '%s' to file '%s'\n", name, file_name);
 
@@ -1109,6 +1462,7 @@ void op_write_const_hdf5(char const *name, int dim, char const *type,
 
 void op_fetch_data_hdf5(op_dat data, char const *file_name,
                         char const *path_name) {
+  op_dump_to_hdf5_wait();
   // letting know that writing is happening ...
   op_printf("Writing '%s' to file '%s'\n", path_name, file_name);
 
@@ -1340,6 +1694,9 @@ void op_fetch_data_hdf5(op_dat data, char const *file_name,
   plist_id = H5Pcreate(H5P_DATASET_XFER);
   H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
 
+  hid_t dcpl = op_hdf5_create_plist(g_size, dat->dim, dat->size / dat->dim,
+                                    comm_size, 0);
+
   // create dataset path
   create_path(path_name, file_id);
 
@@ -1349,7 +1706,7 @@ void op_fetch_data_hdf5(op_dat data, char const *file_name,
       strcmp(dat->type, "double precision") == 0 ||
       strcmp(dat->type, "real(8)") == 0) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_DOUBLE, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, memspace, dataspace, plist_id,
              dat->data);
   } else if (strcmp(dat->type, "float") == 0 ||
@@ -1357,7 +1714,7 @@ void op_fetch_data_hdf5(op_dat data, char const *file_name,
              strcmp(dat->type, "real(4)") == 0 ||
              strcmp(dat->type, "real") == 0) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_FLOAT, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, dataspace, plist_id,
              dat->data);
   } else if (strcmp(dat->type, "int") == 0 ||
@@ -1366,18 +1723,18 @@ void op_fetch_data_hdf5(op_dat data, char const *file_name,
              strcmp(dat->type, "integer") == 0 ||
              strcmp(dat->type, "integer(4)") == 0) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_INT, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, dataspace, plist_id, dat->data);
   } else if ((strcmp(dat->type, "long") == 0) ||
              (strcmp(dat->type, "long:soa") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_LONG, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_LONG, memspace, dataspace, plist_id,
              dat->data);
   } else if ((strcmp(dat->type, "long long") == 0) ||
              (strcmp(dat->type, "long long:soa") == 0)) {
     dset_id = H5Dcreate(file_id, path_name, H5T_NATIVE_LLONG, dataspace,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT);
     H5Dwrite(dset_id, H5T_NATIVE_LLONG, memspace, dataspace, plist_id,
              dat->data);
   } else {
@@ -1386,6 +1743,7 @@ void op_fetch_data_hdf5(op_dat data, char const *file_name,
   }
 
   H5Dclose(dset_id);
+  op_hdf5_close_plist(dcpl);
   H5Pclose(plist_id);
   H5Sclose(memspace);
   H5Sclose(dataspace);
@@ -1447,6 +1805,7 @@ void op_fetch_data_hdf5_file(op_dat dat, char const *file_name) {
 }
 
 void op_fetch_data_hdf5_file_ptr(char *data, const char *file_name) {
+  op_dump_to_hdf5_wait();
   op_dat_entry *item;
   op_dat_entry *tmp_item;
   op_dat item_dat = NULL;
@@ -1481,6 +1840,39 @@ void op_fetch_data_hdf5_file_path(op_dat dat, char const *file_name,
   op_fetch_data_hdf5(dat, file_name, path_name);
 }
 
+/*******************************************************************************
+* Routine to write the partition of each op_set to a named hdf5 file, as the
+* rank of each element in the original order, under partition/<set name>
+*******************************************************************************/
+
+void op_dump_partition_hdf5(char const *file_name) {
+  int my_rank;
+  MPI_Comm_rank(OP_MPI_WORLD, &my_rank);
+
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    char *path = (char *)xmalloc(strlen(set->name) + 11);
+    sprintf(path, "partition/%s", set->name);
+    int *owner = (int *)xmalloc(sizeof(int) * (set->size + 1));
+    for (int i = 0; i < set->size; i++)
+      owner[i] = my_rank;
+
+    // a temporary op_dat, so that the vector goes back to the original order
+    op_dat_core temp;
+    memset(&temp, 0, sizeof(op_dat_core));
+    temp.set = set;
+    temp.dim = 1;
+    temp.size = sizeof(int);
+    temp.type = "int";
+    temp.name = path;
+    temp.data = (char *)owner;
+    op_fetch_data_hdf5(&temp, file_name, path);
+
+    op_free(owner);
+    op_free(path);
+  }
+}
+
 #ifdef __cplusplus
 }
 #endif
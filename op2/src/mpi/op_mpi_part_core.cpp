@@ -46,6 +46,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <algorithm>
 #include <tuple>
 
 #include <op_lib_c.h>
@@ -94,6 +95,285 @@ extern "C" {
 
 MPI_Comm OP_PART_WORLD;
 
+// relative speed of this rank, measured by op_repartition (1.0 = average)
+static double OP_part_capacity = 1.0;
+
+/*******************************************************************************
+ * Utility function to compute the fraction of each set that every rank in
+ * OP_PART_WORLD should own, from the GPU balance and the measured capacity.
+ * Returns 1 if all ranks get the same share
+ *******************************************************************************/
+
+static int *get_part_order(int comm_size);
+
+static int get_part_targets(double *target, int comm_size) {
+  double capacity =
+      OP_part_capacity * (OP_hybrid_gpu == 1 ? OP_hybrid_balance : 1.0);
+  MPI_Allgather(&capacity, 1, MPI_DOUBLE, target, 1, MPI_DOUBLE,
+                OP_PART_WORLD);
+
+  // part p is handed to rank order[p], see order_parts_by_node
+  int *order = get_part_order(comm_size);
+  if (order != NULL) {
+    double *by_rank = (double *)xmalloc(comm_size * sizeof(double));
+    memcpy(by_rank, target, comm_size * sizeof(double));
+    for (int p = 0; p < comm_size; p++)
+      target[p] = by_rank[order[p]];
+    op_free(by_rank);
+    op_free(order);
+  }
+
+  double total = 0.0;
+  int uniform = 1;
+  for (int i = 0; i < comm_size; i++) {
+    total += target[i];
+    if (target[i] != target[0])
+      uniform = 0;
+  }
+  for (int i = 0; i < comm_size; i++)
+    target[i] /= total;
+  return uniform;
+}
+
+/*******************************************************************************
+ * Utility function to get the rank each part goes to in node-aware mode
+ * (OP_part_hierarchical): the ranks of the first node, then those of the
+ * next, so that runs of consecutive parts - which the random, inertial and
+ * space filling curve partitioners cut from neighbouring pieces of the
+ * mesh - land on one node. Returns NULL when part p simply goes to rank p
+ *******************************************************************************/
+
+static int *get_part_order(int comm_size) {
+  if (!OP_part_hierarchical)
+    return NULL;
+
+  int my_rank;
+  MPI_Comm_rank(OP_PART_WORLD, &my_rank);
+  int *node_id = (int *)xmalloc(comm_size * sizeof(int));
+  get_node_ids(node_id, my_rank, comm_size, OP_PART_WORLD);
+
+  int *order = (int *)xmalloc(comm_size * sizeof(int));
+  for (int r = 0; r < comm_size; r++)
+    order[r] = r;
+  std::stable_sort(order, order + comm_size, [node_id](int a, int b) {
+    return node_id[a] < node_id[b];
+  });
+  op_free(node_id);
+  return order;
+}
+
+/*******************************************************************************
+ * Routine to hand the parts of the primary set to the ranks in node order
+ *******************************************************************************/
+
+static void order_parts_by_node(op_set primary_set, int comm_size) {
+  int *order = get_part_order(comm_size);
+  if (order == NULL)
+    return;
+
+  int *elem_part = OP_part_list[primary_set->index]->elem_part;
+  for (int i = 0; i < primary_set->size; i++)
+    elem_part[i] = order[elem_part[i]];
+  op_free(order);
+}
+
+// average integer vertex weight handed to the partitioners
+#define OP_PART_WEIGHT_SCALE 100
+
+// a source of per-element weights, see op_partition_weights
+typedef struct {
+  op_dat dat;         /* weights of the elements of dat->set, or NULL */
+  op_map map;         /* adds them to the elements it points to, or NULL */
+  char const *kernel; /* loop whose measured cost per element is used */
+} part_weight_core;
+
+static part_weight_core *OP_part_weight_list = NULL;
+static int OP_part_weight_index = 0;
+
+/*******************************************************************************
+ * Routines to register per-element weights for the partitioners: either given
+ * by a dim 1 op_dat, or the measured cost of an op_par_loop per element of the
+ * set it iterates over. With a map, the weights of the from-set are added to
+ * the to-set elements they point to
+ *******************************************************************************/
+
+static void add_part_weight(op_dat dat, op_map map, const char *kernel) {
+  OP_part_weight_list = (part_weight_core *)xrealloc(
+      OP_part_weight_list,
+      (OP_part_weight_index + 1) * sizeof(part_weight_core));
+  OP_part_weight_list[OP_part_weight_index].dat = dat;
+  OP_part_weight_list[OP_part_weight_index].map = map;
+  OP_part_weight_list[OP_part_weight_index].kernel = kernel;
+  OP_part_weight_index++;
+}
+
+void op_partition_weights(op_dat weights, op_map map) {
+  if (weights == NULL) { // forget all weights
+    op_free(OP_part_weight_list);
+    OP_part_weight_list = NULL;
+    OP_part_weight_index = 0;
+    return;
+  }
+  if (weights->dim != 1 || (map != NULL && map->from != weights->set)) {
+    op_printf("op_partition_weights: %s must have dim 1 and be defined on "
+              "the from-set of the map, ignoring\n",
+              weights->name);
+    return;
+  }
+  add_part_weight(weights, map, NULL);
+}
+
+void op_partition_loop_weights(const char *kernel_name, op_map map) {
+  add_part_weight(NULL, map, kernel_name);
+}
+
+/*******************************************************************************
+ * Utility function to get the weight of one element of a dim 1 op_dat
+ *******************************************************************************/
+
+static double get_weight_value(op_dat dat, int i) {
+  if (op_type_equivalence(dat->type, "double"))
+    return ((double *)dat->data)[i];
+  if (op_type_equivalence(dat->type, "float"))
+    return ((float *)dat->data)[i];
+  if (op_type_equivalence(dat->type, "int"))
+    return ((int *)dat->data)[i];
+  if (op_type_equivalence(dat->type, "ll"))
+    return (double)((long long *)dat->data)[i];
+  return 1.0;
+}
+
+/*******************************************************************************
+ * Utility function to compute the integer weights of the local elements of a
+ * set from the registered sources, with maps still in global numbering and
+ * the elements spread by part_range. Returns NULL if the set has no weights
+ *******************************************************************************/
+
+static int *get_vertex_weights(op_set set, int **part_range, int comm_size) {
+  int found = 0;
+  for (int w = 0; w < OP_part_weight_index; w++) {
+    part_weight_core *src = &OP_part_weight_list[w];
+    if ((src->map == NULL && (src->dat == NULL || src->dat->set == set)) ||
+        (src->map != NULL && src->map->to == set))
+      found = 1;
+  }
+  if (!found)
+    return NULL;
+
+  double *wgt = (double *)xcalloc(set->size > 0 ? set->size : 1, sizeof(double));
+  int *send_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *send_disps = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_disps = (int *)xmalloc(comm_size * sizeof(int));
+
+  for (int w = 0; w < OP_part_weight_index; w++) {
+    part_weight_core *src = &OP_part_weight_list[w];
+    if (src->map != NULL ? src->map->to != set
+                         : (src->dat != NULL && src->dat->set != set))
+      continue;
+    op_set from = src->map != NULL ? src->map->from : set;
+
+    // measured cost per element of the loop: total time over all ranks
+    // divided by the elements processed
+    double cost = 0.0;
+    if (src->dat == NULL) {
+      double loop[2] = {0.0, (double)from->size};
+      for (int k = 0; k < OP_kern_max; k++) {
+        if (OP_kernels[k].name != NULL &&
+            strcmp(OP_kernels[k].name, src->kernel) == 0) {
+          loop[0] = OP_kernels[k].time - OP_kernels[k].mpi_time;
+          loop[1] *= OP_kernels[k].count;
+        }
+      }
+      double loop_g[2];
+      MPI_Allreduce(loop, loop_g, 2, MPI_DOUBLE, MPI_SUM, OP_PART_WORLD);
+      if (loop_g[0] <= 0.0 || loop_g[1] <= 0.0) {
+        op_printf("No timing for loop %s, not used for partition weights\n",
+                  src->kernel);
+        continue;
+      }
+      cost = loop_g[0] / loop_g[1];
+    }
+
+    if (src->map == NULL) {
+      for (int i = 0; i < set->size; i++)
+        wgt[i] += src->dat != NULL ? get_weight_value(src->dat, i) : cost;
+      continue;
+    }
+
+    // add to the elements pointed at, which may live on other ranks
+    op_map map = src->map;
+    int n = from->size * map->dim;
+    int *owner = (int *)xmalloc((n > 0 ? n : 1) * sizeof(int));
+    int *local = (int *)xmalloc((n > 0 ? n : 1) * sizeof(int));
+    for (int r = 0; r < comm_size; r++)
+      send_sizes[r] = 0;
+    for (int e = 0; e < n; e++) {
+      owner[e] = get_partition(map->map[e], part_range[set->index], &local[e],
+                               comm_size);
+      send_sizes[owner[e]]++;
+    }
+    MPI_Alltoall(send_sizes, 1, MPI_INT, recv_sizes, 1, MPI_INT,
+                 OP_PART_WORLD);
+    send_disps[0] = recv_disps[0] = 0;
+    for (int r = 1; r < comm_size; r++) {
+      send_disps[r] = send_disps[r - 1] + send_sizes[r - 1];
+      recv_disps[r] = recv_disps[r - 1] + recv_sizes[r - 1];
+    }
+    int recv_total = recv_disps[comm_size - 1] + recv_sizes[comm_size - 1];
+
+    int *sbuf_i = (int *)xmalloc((n > 0 ? n : 1) * sizeof(int));
+    double *sbuf_d = (double *)xmalloc((n > 0 ? n : 1) * sizeof(double));
+    for (int r = 0; r < comm_size; r++)
+      send_sizes[r] = 0;
+    for (int e = 0; e < n; e++) {
+      int k = send_disps[owner[e]] + send_sizes[owner[e]]++;
+      sbuf_i[k] = local[e];
+      sbuf_d[k] =
+          src->dat != NULL ? get_weight_value(src->dat, e / map->dim) : cost;
+    }
+    int *rbuf_i =
+        (int *)xmalloc((recv_total > 0 ? recv_total : 1) * sizeof(int));
+    double *rbuf_d =
+        (double *)xmalloc((recv_total > 0 ? recv_total : 1) * sizeof(double));
+    MPI_Alltoallv(sbuf_i, send_sizes, send_disps, MPI_INT, rbuf_i, recv_sizes,
+                  recv_disps, MPI_INT, OP_PART_WORLD);
+    MPI_Alltoallv(sbuf_d, send_sizes, send_disps, MPI_DOUBLE, rbuf_d,
+                  recv_sizes, recv_disps, MPI_DOUBLE, OP_PART_WORLD);
+    for (int i = 0; i < recv_total; i++)
+      wgt[rbuf_i[i]] += rbuf_d[i];
+
+    op_free(rbuf_d);
+    op_free(rbuf_i);
+    op_free(sbuf_d);
+    op_free(sbuf_i);
+    op_free(local);
+    op_free(owner);
+  }
+  op_free(send_sizes);
+  op_free(send_disps);
+  op_free(recv_sizes);
+  op_free(recv_disps);
+
+  // scale to integers with the given average, every element at least 1, and
+  // keep the global sum in range of a 32 bit index
+  double local_sum[2] = {0.0, (double)set->size}, sum[2];
+  for (int i = 0; i < set->size; i++)
+    local_sum[0] += wgt[i];
+  MPI_Allreduce(local_sum, sum, 2, MPI_DOUBLE, MPI_SUM, OP_PART_WORLD);
+  double scale = sum[0] > 0.0 ? OP_PART_WEIGHT_SCALE * sum[1] / sum[0] : 0.0;
+  if (scale * sum[0] > (double)(INT_MAX / 2))
+    scale = (double)(INT_MAX / 2) / sum[0];
+
+  int *vwgt = (int *)xmalloc((set->size > 0 ? set->size : 1) * sizeof(int));
+  for (int i = 0; i < set->size; i++) {
+    double v = wgt[i] * scale + 0.5;
+    vwgt[i] = v < 1.0 ? 1 : (int)v;
+  }
+  op_free(wgt);
+  return vwgt;
+}
+
 /*******************************************************************************
  * Utility function to find the number of times a value appears in an array
  *******************************************************************************/
@@ -198,6 +478,7 @@ static int *create_exp_list_2(op_set set, int *temp_list, halo_list h_list,
   h_list->size = total_size;
   h_list->ranks = ranks;
   h_list->ranks_size = index;
+  h_list->inter_size = index;
   h_list->disps = disps;
   h_list->sizes = sizes;
   h_list->list = to_list;
@@ -225,6 +506,7 @@ static void create_imp_list_2(op_set set, int *temp_list, halo_list h_list,
   h_list->size = total_size;
   h_list->ranks = ranks;
   h_list->ranks_size = ranks_size;
+  h_list->inter_size = ranks_size;
   h_list->disps = disps;
   h_list->sizes = sizes;
   h_list->list = temp_list;
@@ -767,6 +1049,84 @@ static void partition_all(op_set primary_set, int my_rank, int comm_size) {
   op_free(part_range);
 }
 
+/*******************************************************************************
+ * Routine to count how many entries of a sorted list of global indices fall
+ * into each rank's range of part_range, and the matching displacements
+ *******************************************************************************/
+
+static void count_by_owner(int *list, int count, int *range, int *counts,
+                           int *displs, int comm_size) {
+  for (int r = 0; r < comm_size; r++)
+    counts[r] = 0;
+  int r = 0;
+  for (int i = 0; i < count; i++) {
+    while (r < comm_size - 1 && list[i] > range[2 * r + 1])
+      r++;
+    counts[r]++;
+  }
+  displs[0] = 0;
+  for (int r = 1; r < comm_size; r++)
+    displs[r] = displs[r - 1] + counts[r - 1];
+}
+
+/*******************************************************************************
+ * Routine to build the renumbering directory of a set: the original (block)
+ * owner of each element, given by orig_part_range, learns the new global
+ * index of the elements it held before migration. The returned array holds
+ * the new global index of each element in this rank's original range
+ *******************************************************************************/
+
+static int *create_renumber_directory(op_set set, int *new_range, int my_rank,
+                                      int comm_size) {
+  int *orig_range = orig_part_range[set->index];
+  int *g_index = OP_part_list[set->index]->g_index;
+
+  int *send_count = (int *)xmalloc(comm_size * sizeof(int));
+  int *send_displs = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_count = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_displs = (int *)xmalloc(comm_size * sizeof(int));
+
+  // g_index is sorted after migration, so pairs of (original index, new
+  // global index) are already grouped by their original owner
+  count_by_owner(g_index, set->size, orig_range, send_count, send_displs,
+                 comm_size);
+  int *sbuf = (int *)xmalloc(2 * (size_t)set->size * sizeof(int));
+  for (int i = 0; i < set->size; i++) {
+    sbuf[2 * i] = g_index[i];
+    sbuf[2 * i + 1] = get_global_index(i, my_rank, new_range, comm_size);
+  }
+  for (int r = 0; r < comm_size; r++) {
+    send_count[r] *= 2;
+    send_displs[r] *= 2;
+  }
+
+  MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, OP_PART_WORLD);
+  int rcount = 0;
+  for (int r = 0; r < comm_size; r++) {
+    recv_displs[r] = rcount;
+    rcount += recv_count[r];
+  }
+  int *rbuf = (int *)xmalloc((size_t)rcount * sizeof(int));
+  MPI_Alltoallv(sbuf, send_count, send_displs, MPI_INT, rbuf, recv_count,
+                recv_displs, MPI_INT, OP_PART_WORLD);
+  op_free(sbuf);
+
+  int start = orig_range[2 * my_rank];
+  int size = orig_range[2 * my_rank + 1] - start + 1;
+  int *directory = (int *)xmalloc((size_t)size * sizeof(int));
+  for (int i = 0; i < size; i++)
+    directory[i] = -1;
+  for (int i = 0; i < rcount; i += 2)
+    directory[rbuf[i] - start] = rbuf[i + 1];
+
+  op_free(rbuf);
+  op_free(send_count);
+  op_free(send_displs);
+  op_free(recv_count);
+  op_free(recv_displs);
+  return directory;
+}
+
 /*******************************************************************************
  * Routine to renumber mapping table entries with new partition's indexes
  *******************************************************************************/
@@ -776,6 +1136,16 @@ static void renumber_maps(int my_rank, int comm_size) {
   int **part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
   get_part_range(part_range, my_rank, comm_size, OP_PART_WORLD);
 
+  // renumbering directories, created on demand for each "to" set
+  int **directory = (int **)xmalloc(OP_set_index * sizeof(int *));
+  for (int s = 0; s < OP_set_index; s++)
+    directory[s] = NULL;
+
+  int *send_count = (int *)xmalloc(comm_size * sizeof(int));
+  int *send_displs = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_count = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_displs = (int *)xmalloc(comm_size * sizeof(int));
+
   // find elements of the "to" set thats not in this local process
   for (int m = 0; m < OP_map_index; m++) { // for each maping table
     op_map map = OP_map_list[m];
@@ -810,100 +1180,36 @@ static void renumber_maps(int my_rank, int comm_size) {
       req_list = (int *)xrealloc(req_list, count * sizeof(int));
     }
 
-    // do an allgather to findout how many elements that each process will
-    // be requesting partition information about
-    int recv_count[comm_size];
-    MPI_Allgather(&count, 1, MPI_INT, recv_count, 1, MPI_INT, OP_PART_WORLD);
-
-    // discover global size of these required elements
-    int g_count = 0;
-    for (int i = 0; i < comm_size; i++)
-      g_count += recv_count[i];
-
-    // prepare for an allgatherv
-    int disp = 0;
-    int *displs = (int *)xmalloc(comm_size * sizeof(int));
-    for (int i = 0; i < comm_size; i++) {
-      displs[i] = disp;
-      disp = disp + recv_count[i];
-    }
-
-    // allocate memory to hold the global indexes of elements requiring
-    // partition details
-    int *g_index = (int *)xmalloc(sizeof(int) * g_count);
-
-    MPI_Allgatherv(req_list, count, MPI_INT, g_index, recv_count, displs,
-                   MPI_INT, OP_PART_WORLD);
-    op_free(req_list);
-
-    if (g_count > 0) {
-      quickSort(g_index, 0, g_count - 1);
-      g_count = removeDups(g_index, g_count);
-      g_index = (int *)xrealloc(g_index, g_count * sizeof(int));
-    }
-
-    // printf("on rank %d map %s needs set %s : before g_count = %d\n",
-    //    my_rank, map->name, map->to->name, g_count);
-
-    // go through the recieved global g_index array and see if any local
-    // element's
-    // partition details are requested by some foreign process
-    int *exp_index = (int *)xmalloc(sizeof(int) * g_count);
-    int *exp_g_index = (int *)xmalloc(sizeof(int) * g_count);
-
-    int exp_count = 0;
-    for (int i = 0; i < g_count; i++) {
-      int local_index = binary_search(OP_part_list[map->to->index]->g_index,
-                                      g_index[i], 0, map->to->size - 1);
-      int global_index;
-      if (local_index >= 0) {
-        exp_g_index[exp_count] = g_index[i];
-
-        global_index = get_global_index(local_index, my_rank,
-                                        part_range[map->to->index], comm_size);
-        exp_index[exp_count++] = global_index;
-      }
-    }
-    op_free(g_index);
-
-    // realloc exp_index, exp_g_index
-    exp_index = (int *)xrealloc(exp_index, sizeof(int) * exp_count);
-    exp_g_index = (int *)xrealloc(exp_g_index, sizeof(int) * exp_count);
-
-    // now export to every MPI rank, these partition info with an all-to-all
-    MPI_Allgather(&exp_count, 1, MPI_INT, recv_count, 1, MPI_INT,
-                  OP_PART_WORLD);
-    disp = 0;
-    op_free(displs);
-    displs = (int *)xmalloc(comm_size * sizeof(int));
-
-    for (int i = 0; i < comm_size; i++) {
-      displs[i] = disp;
-      disp = disp + recv_count[i];
+    if (directory[map->to->index] == NULL)
+      directory[map->to->index] = create_renumber_directory(
+          map->to, part_range[map->to->index], my_rank, comm_size);
+
+    // send each request to the original owner of the element, which answers
+    // from its directory; the sorted request list is already grouped by owner
+    int *orig_range = orig_part_range[map->to->index];
+    count_by_owner(req_list, count, orig_range, send_count, send_displs,
+                   comm_size);
+    MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT,
+                 OP_PART_WORLD);
+    int rcount = 0;
+    for (int r = 0; r < comm_size; r++) {
+      recv_displs[r] = rcount;
+      rcount += recv_count[r];
     }
 
-    // allocate memory to hold the incomming partition details and allgatherv
-    g_count = 0;
-    for (int i = 0; i < comm_size; i++)
-      g_count += recv_count[i];
-    int *all_imp_index = (int *)xmalloc(sizeof(int) * g_count);
-    g_index = (int *)xmalloc(sizeof(int) * g_count);
-
-    // printf("on rank %d map %s need set %s: After g_count = %d\n",
-    //    my_rank, map.name,map.to.name,g_count);
+    int *requests = (int *)xmalloc((size_t)rcount * sizeof(int));
+    MPI_Alltoallv(req_list, send_count, send_displs, MPI_INT, requests,
+                  recv_count, recv_displs, MPI_INT, OP_PART_WORLD);
 
-    MPI_Allgatherv(exp_g_index, exp_count, MPI_INT, g_index, recv_count, displs,
-                   MPI_INT, OP_PART_WORLD);
+    int start = orig_range[2 * my_rank];
+    for (int i = 0; i < rcount; i++)
+      requests[i] = directory[map->to->index][requests[i] - start];
 
-    MPI_Allgatherv(exp_index, exp_count, MPI_INT, all_imp_index, recv_count,
-                   displs, MPI_INT, OP_PART_WORLD);
-
-    op_free(exp_index);
-    op_free(exp_g_index);
-
-    // sort all_imp_index according to g_index array
-    if (g_count > 0)
-      quickSort_2(g_index, all_imp_index, 0, g_count - 1);
+    // replies come back in the order of req_list
+    int *new_index = (int *)xmalloc((size_t)count * sizeof(int));
+    MPI_Alltoallv(requests, recv_count, recv_displs, MPI_INT, new_index,
+                  send_count, send_displs, MPI_INT, OP_PART_WORLD);
+    op_free(requests);
 
     // now we hopefully have all the informattion required to renumber this map
     // so now, again go through each entry of this mapping table and renumber
@@ -916,14 +1222,13 @@ static void renumber_maps(int my_rank, int comm_size) {
 
         if (local_index < 0) // not in this partition
         {
-          // need to search through g_index array
-          int found = binary_search(g_index, map->map[i * map->dim + j], 0,
-                                    g_count - 1);
-          if (found < 0)
+          // need to search through the request list
+          int found = binary_search(req_list, map->map[i * map->dim + j], 0,
+                                    count - 1);
+          if (found < 0 || new_index[found] < 0)
             printf("Problem in renumbering\n");
           else {
-            OP_map_list[map->index]->map[i * map->dim + j] =
-                all_imp_index[found];
+            OP_map_list[map->index]->map[i * map->dim + j] = new_index[found];
           }
         } else // in this partition
         {
@@ -934,12 +1239,19 @@ static void renumber_maps(int my_rank, int comm_size) {
       }
     }
 
-    op_free(g_index);
-    op_free(displs);
-    op_free(all_imp_index);
+    op_free(req_list);
+    op_free(new_index);
   }
-  for (int i = 0; i < OP_set_index; i++)
+
+  op_free(send_count);
+  op_free(send_displs);
+  op_free(recv_count);
+  op_free(recv_displs);
+  for (int i = 0; i < OP_set_index; i++) {
+    op_free(directory[i]);
     op_free(part_range[i]);
+  }
+  op_free(directory);
   op_free(part_range);
 }
 
@@ -1501,13 +1813,27 @@ void op_partition_random(op_set primary_set) {
   /*-----STEP 1 - Partition Primary set using a random number generator
    * --------*/
 
+  double *target = (double *)xmalloc(comm_size * sizeof(double));
+  int uniform = get_part_targets(target, comm_size);
+  for (int i = 1; i < comm_size; i++)
+    target[i] += target[i - 1];
+
   int *partition = (int *)xmalloc(sizeof(int) * primary_set->size);
   // printf("RAND_MAX = %d",RAND_MAX);
   for (int i = 0; i < primary_set->size; i++) {
     // not sure if this is the best way to generate the required random number
-    partition[i] = // rand()%comm_size;
-        (int)((double)rand() / ((double)RAND_MAX + 1) * comm_size);
+    double r = (double)rand() / ((double)RAND_MAX + 1);
+    if (uniform) {
+      partition[i] = // rand()%comm_size;
+          (int)(r * comm_size);
+    } else {
+      int p = 0;
+      while (p < comm_size - 1 && r >= target[p])
+        p++;
+      partition[i] = p;
+    }
   }
+  op_free(target);
 
   // initialise primary set as partitioned
   OP_part_list[primary_set->index]->elem_part = partition;
@@ -1521,6 +1847,9 @@ void op_partition_random(op_set primary_set) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(primary_set, comm_size);
+
   // partition all other sets
   partition_all(primary_set, my_rank, comm_size);
 
@@ -1540,6 +1869,121 @@ void op_partition_random(op_set primary_set) {
     printf("Max total random partitioning time = %lf\n", max_time);
 }
 
+/*******************************************************************************
+ * Sets read straight into their final partition (see op_hdf5_use_partition):
+ * the original global indices of the local elements, in increasing order, and
+ * the size of the block of the set this rank would have held otherwise
+ *******************************************************************************/
+
+static int **preload_g_index = NULL;
+static int *preload_block_size = NULL;
+static int preload_cap = 0;
+
+void op_partition_preload(op_set set, int *g_index, int block_size) {
+  if (set->index >= preload_cap) {
+    int cap = 2 * (set->index + 1);
+    preload_g_index = (int **)xrealloc(preload_g_index, cap * sizeof(int *));
+    preload_block_size =
+        (int *)xrealloc(preload_block_size, cap * sizeof(int));
+    for (int s = preload_cap; s < cap; s++) {
+      preload_g_index[s] = NULL;
+      preload_block_size[s] = 0;
+    }
+    preload_cap = cap;
+  }
+  preload_g_index[set->index] = g_index;
+  preload_block_size[set->index] = block_size;
+}
+
+/*******************************************************************************
+ * This routine takes over the partitioning of the sets that were read straight
+ * into their final partition, so no data is migrated and only the mapping
+ * tables are renumbered. Other sets keep their block distribution. Returns 1
+ * if all sets were preloaded
+ *******************************************************************************/
+
+static int op_partition_preloaded() {
+  // declare timers
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  double time;
+  double max_time;
+
+  op_timers(&cpu_t1, &wall_t1); // timer start for partitioning
+
+  // create new communicator for partitioning
+  int my_rank, comm_size;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_PART_WORLD);
+  MPI_Comm_rank(OP_PART_WORLD, &my_rank);
+  MPI_Comm_size(OP_PART_WORLD, &comm_size);
+
+  // partition range of the sets as they are, used for the ones not preloaded
+  int **part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+  get_part_range(part_range, my_rank, comm_size, OP_PART_WORLD);
+
+  // the original partition range is the block distribution the sets would
+  // have been read with, so that data is written back in the original order
+  orig_part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+  OP_part_list = (part *)xmalloc(OP_set_index * sizeof(part));
+  int *sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int all_preloaded = 1;
+
+  for (int s = 0; s < OP_set_index; s++) { // for each set
+    op_set set = OP_set_list[s];
+    int *range = (int *)xmalloc(2 * comm_size * sizeof(int));
+    int *g_index = s < preload_cap ? preload_g_index[s] : NULL;
+
+    if (g_index != NULL) {
+      MPI_Allgather(&preload_block_size[s], 1, MPI_INT, sizes, 1, MPI_INT,
+                    OP_PART_WORLD);
+      int disp = 0;
+      for (int i = 0; i < comm_size; i++) {
+        range[2 * i] = disp;
+        disp = disp + sizes[i];
+        range[2 * i + 1] = disp - 1;
+      }
+    } else {
+      all_preloaded = 0;
+      memcpy(range, part_range[s], 2 * comm_size * sizeof(int));
+      g_index = (int *)xmalloc(sizeof(int) * set->size);
+      for (int i = 0; i < set->size; i++)
+        g_index[i] = get_global_index(i, my_rank, range, comm_size);
+    }
+    orig_part_range[s] = range;
+
+    int *partition = (int *)xmalloc(sizeof(int) * set->size);
+    for (int i = 0; i < set->size; i++)
+      partition[i] = my_rank;
+    decl_partition(set, g_index, partition);
+    OP_part_list[s]->is_partitioned = 1;
+  }
+  op_free(sizes);
+
+  // the g_index arrays now belong to OP_part_list
+  op_free(preload_g_index);
+  op_free(preload_block_size);
+  preload_g_index = NULL;
+  preload_block_size = NULL;
+  preload_cap = 0;
+
+  for (int i = 0; i < OP_set_index; i++)
+    op_free(part_range[i]);
+  op_free(part_range);
+
+  // the elements and mapping tables are already in place, sorted by their
+  // original global index, the mapping tables only need renumbering
+  renumber_maps(my_rank, comm_size);
+
+  op_timers(&cpu_t2, &wall_t2); // timer stop for partitioning
+
+  // print time for partitioning
+  time = wall_t2 - wall_t1;
+  MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, MPI_ROOT, OP_PART_WORLD);
+  MPI_Comm_free(&OP_PART_WORLD);
+  if (my_rank == MPI_ROOT)
+    printf("Max total preloaded partitioning time = %lf\n", max_time);
+  return all_preloaded;
+}
+
 /*******************************************************************************
  * Routine to revert back to the original partitioning
  *******************************************************************************/
@@ -1673,6 +2117,9 @@ void op_partition_geom(op_dat coords) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(coords->set, comm_size);
+
   // partition all other sets
   partition_all(coords->set, my_rank, comm_size);
 
@@ -2035,10 +2482,24 @@ void op_partition_geomkway(op_dat coords, op_map primary_map) {
   idx_t wgtflag = 0;
   idx_t options[3] = {1, 3, 15};
 
+  // per-element weights, if any were registered
+  idx_t *vwgt = NULL;
+  int *weights = get_vertex_weights(primary_map->to, part_range, comm_size);
+  if (weights != NULL) {
+    vwgt = (idx_t *)xmalloc((primary_map->to->size + 1) * sizeof(idx_t));
+    for (int i = 0; i < primary_map->to->size; i++)
+      vwgt[i] = (idx_t)weights[i];
+    op_free(weights);
+    wgtflag = 2;
+  }
+
   idx_t ncon = 1;
+  double *target = (double *)xmalloc(comm_size * sizeof(double));
+  get_part_targets(target, comm_size);
   real_t *tpwgts = (real_t *)xmalloc(comm_size * sizeof(real_t) * ncon);
   for (int i = 0; i < comm_size * ncon; i++)
-    tpwgts[i] = (real_t)1.0 / (real_t)comm_size;
+    tpwgts[i] = (real_t)target[i];
+  op_free(target);
 
   real_t *ubvec = (real_t *)xmalloc(sizeof(real_t) * ncon);
   *ubvec = 1.05;
@@ -2063,7 +2524,7 @@ void op_partition_geomkway(op_dat coords, op_map primary_map) {
     printf("ParMETIS_V3_PartGeomKway Output\n");
     printf("-----------------------------------------------------------\n");
   }
-  ParMETIS_V3_PartGeomKway(vtxdist, xadj, adjncy, NULL, NULL, &wgtflag,
+  ParMETIS_V3_PartGeomKway(vtxdist, xadj, adjncy, vwgt, NULL, &wgtflag,
                            &numflag, &ndims, xyz, &ncon, &comm_size_pm, tpwgts,
                            ubvec, options, &edge_cut, partition,
                            &OP_PART_WORLD);
@@ -2076,6 +2537,7 @@ void op_partition_geomkway(op_dat coords, op_map primary_map) {
   op_free(adjncy);
   op_free(ubvec);
   op_free(tpwgts);
+  op_free(vwgt);
   op_free(xyz);
 
   // saniti check to see if all elements were partitioned
@@ -2095,6 +2557,9 @@ void op_partition_geomkway(op_dat coords, op_map primary_map) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(primary_map->to, comm_size);
+
   // partition all other sets
   partition_all(primary_map->to, my_rank, comm_size);
 
@@ -2560,9 +3025,18 @@ void op_partition_ptscotch(op_map primary_map) {
   cap = (primary_map->to->size) * primary_map->dim;
 
   SCOTCH_Num *vendloctab = NULL; // not needed
-  SCOTCH_Num *veloloctab = NULL; // not needed
   SCOTCH_Num *vlblocltab = NULL; // not needed
 
+  // local vertex load array, only if weights were registered
+  SCOTCH_Num *veloloctab = NULL;
+  int *weights = get_vertex_weights(primary_map->to, part_range, comm_size);
+  if (weights != NULL) {
+    veloloctab = (SCOTCH_Num *)xmalloc(sizeof(SCOTCH_Num) * (vertlocnbr + 1));
+    for (int i = 0; i < vertlocnbr; i++)
+      veloloctab[i] = (SCOTCH_Num)weights[i];
+    op_free(weights);
+  }
+
   // the local adjacency array, of size at least edgelocsiz,
   // which stores the global indices of end vertices
   SCOTCH_Num *edgeloctab = (SCOTCH_Num *)xmalloc(sizeof(SCOTCH_Num) * cap);
@@ -2660,6 +3134,7 @@ void op_partition_ptscotch(op_map primary_map) {
   SCOTCH_dgraphPart(grafptr, comm_size, &straptr, partloctab);
   op_free(edgeloctab);
   op_free(vertloctab);
+  op_free(veloloctab);
 
   // saniti check to see if all elements were partitioned
   for (int i = 0; i < primary_map->to->size; i++) {
@@ -2684,6 +3159,9 @@ void op_partition_ptscotch(op_map primary_map) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(primary_map->to, comm_size);
+
   // partition all other sets
   partition_all(primary_map->to, my_rank, comm_size);
 
@@ -2777,8 +3255,23 @@ void op_partition_inertial(op_dat x_dat) {
   int current_part_size = block_size;   // losl
   int current_group_size = global_size; // lopl
 
-  MPI_Request s_request, s_request2;
-  MPI_Status s_status, s_status2;
+  // share of each rank, and the world rank of the first rank in the group
+  double *share = (double *)xmalloc(comm_size * sizeof(double));
+  int uniform = get_part_targets(share, comm_size);
+  int group_offset = 0;
+
+  // per-element weights, if any were registered, travel with the coordinates
+  double *w = NULL;
+  int *weights = get_vertex_weights(x_dat->set, part_range, comm_size);
+  if (weights != NULL) {
+    w = (double *)xmalloc((block_size > 0 ? block_size : 1) * sizeof(double));
+    for (int i = 0; i < block_size; i++)
+      w[i] = (double)weights[i];
+    op_free(weights);
+  }
+
+  MPI_Request s_request, s_request2, s_request3;
+  MPI_Status s_status, s_status2, s_status3;
   MPI_Status r_status;
 
   double *dist;
@@ -2897,6 +3390,32 @@ void op_partition_inertial(op_dat x_dat) {
       double dupper = distmax_g;
       double dsplit = distavg_g;
       long nsplit = ((long)current_group_size * (long)(comm_size / 2)) / (long)comm_size;
+      if (!uniform) {
+        double lower = 0.0, total = 0.0;
+        for (int i = 0; i < comm_size; i++) {
+          total += share[group_offset + i];
+          if (i < comm_size / 2)
+            lower += share[group_offset + i];
+        }
+        nsplit = (long)((double)current_group_size * lower / total + 0.5);
+      }
+
+      // with weights, split the total weight in the same ratio instead, to
+      // within half the heaviest element
+      double wsplit = 0.0, wtol = 0.0;
+      if (w != NULL) {
+        double wsum = 0.0, wmax = 0.0, wsum_g, wmax_g;
+        for (int i = 0; i < current_part_size; i++) {
+          wsum += w[i];
+          wmax = MAX(wmax, w[i]);
+        }
+        MPI_Allreduce(&wsum, &wsum_g, 1, MPI_DOUBLE, MPI_SUM, mpi_comm);
+        MPI_Allreduce(&wmax, &wmax_g, 1, MPI_DOUBLE, MPI_MAX, mpi_comm);
+        if (current_group_size > 0)
+          wsplit = wsum_g * (double)nsplit / (double)current_group_size;
+        wtol = 0.5 * wmax_g;
+      }
+
       int nlower_g = 0;
       while (1) {
         int nlower = 0;
@@ -2904,12 +3423,20 @@ void op_partition_inertial(op_dat x_dat) {
         for (int i = 0; i < current_part_size; i++)
           nlower += (dist[i] <= dsplit ? 1 : 0);
         MPI_Allreduce(&nlower, &nlower_g, 1, MPI_INT, MPI_SUM, mpi_comm);
-        if (nlower_g == nsplit)
+        double diff = (double)nlower_g - (double)nsplit;
+        if (w != NULL) {
+          double wlower = 0.0, wlower_g = 0.0;
+          for (int i = 0; i < current_part_size; i++)
+            wlower += (dist[i] <= dsplit ? w[i] : 0.0);
+          MPI_Allreduce(&wlower, &wlower_g, 1, MPI_DOUBLE, MPI_SUM, mpi_comm);
+          diff = wlower_g - wsplit;
+        }
+        if (fabs(diff) <= wtol)
           break;
-        else if (nlower_g < nsplit) {
+        else if (diff < 0.0) {
           dlower = dsplit;
           dsplit = (dsplit + dupper) / 2.0;
-        } else if (nlower_g > nsplit) {
+        } else {
           dupper = dsplit;
           dsplit = (dsplit + dlower) / 2.0;
         }
@@ -2926,6 +3453,11 @@ void op_partition_inertial(op_dat x_dat) {
       double *x_send =
           (double *)xmalloc(3 * (current_part_size>0?current_part_size:1) * sizeof(double));
       int *idx_gbl_send = (int *)xmalloc((current_part_size>1?current_part_size:1) * sizeof(int));
+      double *w_keep = NULL, *w_send = NULL;
+      if (w != NULL) {
+        w_keep = (double *)xmalloc((current_part_size > 0 ? current_part_size : 1) * sizeof(double));
+        w_send = (double *)xmalloc((current_part_size > 0 ? current_part_size : 1) * sizeof(double));
+      }
       int keep_ctr = 0;
       int send_ctr = 0;
       if (my_rank <= comm_size / 2 - 1) {
@@ -2934,11 +3466,15 @@ void op_partition_inertial(op_dat x_dat) {
             idx_gbl_keep[keep_ctr] = global_indices[i];
             for (int j = 0; j < 3; j++)
               x_keep[3 * keep_ctr + j] = x[3 * i + j];
+            if (w != NULL)
+              w_keep[keep_ctr] = w[i];
             keep_ctr++;
           } else {
             idx_gbl_send[send_ctr] = global_indices[i];
             for (int j = 0; j < 3; j++)
               x_send[3 * send_ctr + j] = x[3 * i + j];
+            if (w != NULL)
+              w_send[send_ctr] = w[i];
             send_ctr++;
           }
         }
@@ -2948,11 +3484,15 @@ void op_partition_inertial(op_dat x_dat) {
             idx_gbl_keep[keep_ctr] = global_indices[i];
             for (int j = 0; j < 3; j++)
               x_keep[3 * keep_ctr + j] = x[3 * i + j];
+            if (w != NULL)
+              w_keep[keep_ctr] = w[i];
             keep_ctr++;
           } else {
             idx_gbl_send[send_ctr] = global_indices[i];
             for (int j = 0; j < 3; j++)
               x_send[3 * send_ctr + j] = x[3 * i + j];
+            if (w != NULL)
+              w_send[send_ctr] = w[i];
             send_ctr++;
           }
         }
@@ -2982,6 +3522,11 @@ void op_partition_inertial(op_dat x_dat) {
           idx_gbl_keep,
           (keep_ctr + size_0 + size_1 + 1) *
               sizeof(int)); // Implicitly assign global_indices = idx_gbl_keep
+      if (w != NULL) {
+        op_free(w);
+        w = (double *)xrealloc(w_keep, (keep_ctr + size_0 + size_1 + 1) *
+                                           sizeof(double));
+      }
       current_part_size = keep_ctr + size_0 + size_1;
 
       MPI_Wait(&s_request, &s_status);
@@ -2990,6 +3535,9 @@ void op_partition_inertial(op_dat x_dat) {
                 &s_request);
       MPI_Isend(idx_gbl_send, send_ctr, MPI_INT, target_part, 2, mpi_comm,
                 &s_request2);
+      if (w != NULL)
+        MPI_Isend(w_send, send_ctr, MPI_DOUBLE, target_part, 3, mpi_comm,
+                  &s_request3);
 
       // Pack kept - receive 0 - receive 1
       if (2 * my_rank != (comm_size - 1)) {
@@ -2997,12 +3545,18 @@ void op_partition_inertial(op_dat x_dat) {
                  mpi_comm, &r_status);
         MPI_Recv(&global_indices[keep_ctr], size_0, MPI_INT, target_part, 2,
                  mpi_comm, &r_status);
+        if (w != NULL)
+          MPI_Recv(&w[keep_ctr], size_0, MPI_DOUBLE, target_part, 3, mpi_comm,
+                   &r_status);
       }
       if (2 * (my_rank + 1) == comm_size - 1) {
         MPI_Recv(&x[(keep_ctr + size_0) * 3], size_1 * 3, MPI_DOUBLE,
                  target_part - 1, 1, mpi_comm, &r_status);
         MPI_Recv(&global_indices[keep_ctr + size_0], size_1, MPI_INT,
                  target_part - 1, 2, mpi_comm, &r_status);
+        if (w != NULL)
+          MPI_Recv(&w[keep_ctr + size_0], size_1, MPI_DOUBLE, target_part - 1,
+                   3, mpi_comm, &r_status);
       }
 
       // Divide group in two
@@ -3032,6 +3586,7 @@ void op_partition_inertial(op_dat x_dat) {
         current_group_size = current_group_upper;
         current_group = upper_group;
         mpi_comm = upper_comm;
+        group_offset += comm_size / 2;
       }
       MPI_Comm_rank(mpi_comm, &my_rank);
       MPI_Comm_size(mpi_comm, &comm_size);
@@ -3041,11 +3596,17 @@ void op_partition_inertial(op_dat x_dat) {
       op_free(processes_upper);
       MPI_Wait(&s_request, &s_status);
       MPI_Wait(&s_request2, &s_status2);
+      if (w != NULL) {
+        MPI_Wait(&s_request3, &s_status3);
+        op_free(w_send);
+      }
       op_free(idx_gbl_send);
       op_free(x_send);
     }
   }
   op_free(x);
+  op_free(w);
+  op_free(share);
   quickSort(global_indices, 0, current_part_size - 1);
   MPI_Comm_dup(OP_MPI_WORLD, &OP_PART_WORLD);
   MPI_Comm_rank(OP_PART_WORLD, &my_rank);
@@ -3149,6 +3710,9 @@ void op_partition_inertial(op_dat x_dat) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(x_dat->set, comm_size);
+
   // partition all other sets
   partition_all(x_dat->set, my_rank, comm_size);
 
@@ -3167,6 +3731,319 @@ void op_partition_inertial(op_dat x_dat) {
     printf("Max total inertial partitioning time = %lf\n", max_time);
 }
 
+/*******************************************************************************
+ * Utility functions for the space filling curve partitioner: the key of a
+ * point with dim coordinates of bits bits each, on a Hilbert curve (Skilling's
+ * transpose algorithm) or a Morton curve (plain bit interleaving)
+ *******************************************************************************/
+
+static uint64_t sfc_key(unsigned int *X, int dim, int bits, int hilbert) {
+  if (hilbert) {
+    unsigned int M = 1u << (bits - 1);
+    // inverse undo of the excess work
+    for (unsigned int Q = M; Q > 1; Q >>= 1) {
+      unsigned int P = Q - 1;
+      for (int i = 0; i < dim; i++) {
+        if (X[i] & Q)
+          X[0] ^= P;
+        else {
+          unsigned int t = (X[0] ^ X[i]) & P;
+          X[0] ^= t;
+          X[i] ^= t;
+        }
+      }
+    }
+    // Gray encode
+    for (int i = 1; i < dim; i++)
+      X[i] ^= X[i - 1];
+    unsigned int t = 0;
+    for (unsigned int Q = M; Q > 1; Q >>= 1)
+      if (X[dim - 1] & Q)
+        t ^= Q - 1;
+    for (int i = 0; i < dim; i++)
+      X[i] ^= t;
+  }
+
+  uint64_t key = 0;
+  for (int b = bits - 1; b >= 0; b--)
+    for (int i = 0; i < dim; i++)
+      key = (key << 1) | ((X[i] >> b) & 1u);
+  return key;
+}
+
+typedef struct {
+  uint64_t key; /* position on the curve */
+  int g_index;  /* global index of the element, breaks ties */
+  int weight;   /* weight of the element */
+} sfc_elem;
+
+static bool sfc_less(const sfc_elem &a, const sfc_elem &b) {
+  return a.key < b.key || (a.key == b.key && a.g_index < b.g_index);
+}
+
+/*******************************************************************************
+ * Partition a set by cutting a space filling curve through the coordinates
+ * into pieces of the target sizes, after a parallel sample sort of the keys
+ *******************************************************************************/
+
+void op_partition_sfc(op_dat x_dat, int hilbert) {
+  // declare timers
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  double time;
+  double max_time;
+
+  op_timers(&cpu_t1, &wall_t1); // timer start for partitioning
+
+  // create new communicator for partitioning
+  int my_rank, comm_size;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_PART_WORLD);
+  MPI_Comm_rank(OP_PART_WORLD, &my_rank);
+  MPI_Comm_size(OP_PART_WORLD, &comm_size);
+
+  /*--STEP 0 - initialise partitioning data stauctures with the current (block)
+    partitioning information */
+
+  // Compute global partition range information for each set
+  int **part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+  get_part_range(part_range, my_rank, comm_size, OP_PART_WORLD);
+
+  // save the original part_range for future partition reversing
+  orig_part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    orig_part_range[set->index] = (int *)xmalloc(2 * comm_size * sizeof(int));
+    for (int j = 0; j < comm_size; j++) {
+      orig_part_range[set->index][2 * j] = part_range[set->index][2 * j];
+      orig_part_range[set->index][2 * j + 1] =
+          part_range[set->index][2 * j + 1];
+    }
+  }
+
+  // allocate memory for list
+  OP_part_list = (part *)xmalloc(OP_set_index * sizeof(part));
+
+  for (int s = 0; s < OP_set_index; s++) { // for each set
+    op_set set = OP_set_list[s];
+    int *g_index = (int *)xmalloc(sizeof(int) * (set->size > 0 ? set->size : 1));
+    for (int i = 0; i < set->size; i++)
+      g_index[i] =
+          get_global_index(i, my_rank, part_range[set->index], comm_size);
+    decl_partition(set, g_index, NULL);
+  }
+
+  /*--STEP 1 - compute the curve keys of the local elements */
+
+  op_set set = x_dat->set;
+  int dim = x_dat->dim;
+  int n = set->size;
+  int is_float = op_type_equivalence(x_dat->type, "float");
+  double *x = (double *)xmalloc((n > 0 ? n : 1) * dim * sizeof(double));
+  for (int i = 0; i < n * dim; i++)
+    x[i] = is_float ? ((float *)x_dat->data)[i] : ((double *)x_dat->data)[i];
+
+  // bounding box
+  double lo[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+  double hi[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+  for (int i = 0; i < n; i++) {
+    for (int d = 0; d < dim; d++) {
+      lo[d] = MIN(lo[d], x[i * dim + d]);
+      hi[d] = MAX(hi[d], x[i * dim + d]);
+    }
+  }
+  double lo_g[3], hi_g[3];
+  MPI_Allreduce(lo, lo_g, dim, MPI_DOUBLE, MPI_MIN, OP_PART_WORLD);
+  MPI_Allreduce(hi, hi_g, dim, MPI_DOUBLE, MPI_MAX, OP_PART_WORLD);
+
+  int bits = dim == 1 ? 32 : 64 / dim;
+  double cells = (double)((1ull << bits) - 1);
+  int *weights = get_vertex_weights(set, part_range, comm_size);
+
+  sfc_elem *elem = (sfc_elem *)xmalloc((n > 0 ? n : 1) * sizeof(sfc_elem));
+  for (int i = 0; i < n; i++) {
+    unsigned int X[3];
+    for (int d = 0; d < dim; d++) {
+      double extent = hi_g[d] - lo_g[d];
+      X[d] = extent > 0.0
+                 ? (unsigned int)((x[i * dim + d] - lo_g[d]) / extent * cells)
+                 : 0;
+    }
+    elem[i].key = sfc_key(X, dim, bits, hilbert);
+    elem[i].g_index = part_range[set->index][2 * my_rank] + i;
+    elem[i].weight = weights != NULL ? weights[i] : 1;
+  }
+  op_free(weights);
+  op_free(x);
+  std::sort(elem, elem + n, sfc_less);
+
+  /*--STEP 2 - sample sort: pick splitters from a regular sample of every rank
+    and send each element to the rank owning its piece of the curve */
+
+  int n_samples = MIN(n, comm_size);
+  int *sample_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *sample_disps = (int *)xmalloc(comm_size * sizeof(int));
+  int sample_bytes = n_samples * (int)sizeof(sfc_elem);
+  MPI_Allgather(&sample_bytes, 1, MPI_INT, sample_sizes, 1, MPI_INT,
+                OP_PART_WORLD);
+  sample_disps[0] = 0;
+  for (int r = 1; r < comm_size; r++)
+    sample_disps[r] = sample_disps[r - 1] + sample_sizes[r - 1];
+  int total_samples =
+      (sample_disps[comm_size - 1] + sample_sizes[comm_size - 1]) /
+      (int)sizeof(sfc_elem);
+
+  sfc_elem *sample = (sfc_elem *)xmalloc((comm_size + 1) * sizeof(sfc_elem));
+  for (int i = 0; i < n_samples; i++)
+    sample[i] = elem[(long)i * n / n_samples];
+  sfc_elem *samples = (sfc_elem *)xmalloc(
+      (total_samples > 0 ? total_samples : 1) * sizeof(sfc_elem));
+  MPI_Allgatherv(sample, sample_bytes, MPI_BYTE, samples, sample_sizes,
+                 sample_disps, MPI_BYTE, OP_PART_WORLD);
+  std::sort(samples, samples + total_samples, sfc_less);
+
+  // rank r receives the elements from splitter r-1 up to splitter r
+  int *send_sizes = (int *)xcalloc(comm_size, sizeof(int));
+  int *send_disps = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_disps = (int *)xmalloc(comm_size * sizeof(int));
+  int dest = 0;
+  for (int i = 0; i < n; i++) {
+    while (dest < comm_size - 1 &&
+           !sfc_less(elem[i], samples[(long)(dest + 1) * total_samples /
+                                      comm_size]))
+      dest++;
+    send_sizes[dest] += sizeof(sfc_elem);
+  }
+  MPI_Alltoall(send_sizes, 1, MPI_INT, recv_sizes, 1, MPI_INT, OP_PART_WORLD);
+  send_disps[0] = recv_disps[0] = 0;
+  for (int r = 1; r < comm_size; r++) {
+    send_disps[r] = send_disps[r - 1] + send_sizes[r - 1];
+    recv_disps[r] = recv_disps[r - 1] + recv_sizes[r - 1];
+  }
+  int n_recv = (recv_disps[comm_size - 1] + recv_sizes[comm_size - 1]) /
+               (int)sizeof(sfc_elem);
+  sfc_elem *bucket =
+      (sfc_elem *)xmalloc((n_recv > 0 ? n_recv : 1) * sizeof(sfc_elem));
+  MPI_Alltoallv(elem, send_sizes, send_disps, MPI_BYTE, bucket, recv_sizes,
+                recv_disps, MPI_BYTE, OP_PART_WORLD);
+  std::sort(bucket, bucket + n_recv, sfc_less);
+  op_free(elem);
+  op_free(sample);
+  op_free(samples);
+  op_free(sample_sizes);
+  op_free(sample_disps);
+
+  /*--STEP 3 - cut the curve: an element goes to the rank whose share of the
+    total weight contains the middle of the element */
+
+  double *target = (double *)xmalloc(comm_size * sizeof(double));
+  get_part_targets(target, comm_size);
+  for (int r = 1; r < comm_size; r++)
+    target[r] += target[r - 1];
+
+  double local_weight = 0.0, offset = 0.0, total_weight = 0.0;
+  for (int i = 0; i < n_recv; i++)
+    local_weight += bucket[i].weight;
+  MPI_Exscan(&local_weight, &offset, 1, MPI_DOUBLE, MPI_SUM, OP_PART_WORLD);
+  if (my_rank == 0)
+    offset = 0.0;
+  MPI_Allreduce(&local_weight, &total_weight, 1, MPI_DOUBLE, MPI_SUM,
+                OP_PART_WORLD);
+
+  // send (global index, partition) pairs back to the owners
+  int *answer = (int *)xmalloc((n_recv > 0 ? 2 * n_recv : 1) * sizeof(int));
+  int part = 0;
+  for (int i = 0; i < n_recv; i++) {
+    double mid = offset + 0.5 * bucket[i].weight;
+    offset += bucket[i].weight;
+    while (part < comm_size - 1 && mid >= target[part] * total_weight)
+      part++;
+    answer[2 * i] = bucket[i].g_index;
+    answer[2 * i + 1] = part;
+  }
+  op_free(target);
+
+  op_free(bucket);
+
+  // the answers are in curve order, group them by owner
+  int *owner = (int *)xmalloc((n_recv > 0 ? n_recv : 1) * sizeof(int));
+  for (int r = 0; r < comm_size; r++)
+    send_sizes[r] = 0;
+  for (int i = 0; i < n_recv; i++) {
+    int local_index;
+    owner[i] = get_partition(answer[2 * i], part_range[set->index],
+                             &local_index, comm_size);
+    send_sizes[owner[i]] += 2;
+  }
+  send_disps[0] = 0;
+  for (int r = 1; r < comm_size; r++)
+    send_disps[r] = send_disps[r - 1] + send_sizes[r - 1];
+  int *answer_sorted =
+      (int *)xmalloc((n_recv > 0 ? 2 * n_recv : 1) * sizeof(int));
+  for (int r = 0; r < comm_size; r++)
+    send_sizes[r] = 0;
+  for (int i = 0; i < n_recv; i++) {
+    int k = send_disps[owner[i]] + send_sizes[owner[i]];
+    send_sizes[owner[i]] += 2;
+    answer_sorted[k] = answer[2 * i];
+    answer_sorted[k + 1] = answer[2 * i + 1];
+  }
+  op_free(owner);
+  op_free(answer);
+
+  MPI_Alltoall(send_sizes, 1, MPI_INT, recv_sizes, 1, MPI_INT, OP_PART_WORLD);
+  recv_disps[0] = 0;
+  for (int r = 1; r < comm_size; r++)
+    recv_disps[r] = recv_disps[r - 1] + recv_sizes[r - 1];
+  int *reply = (int *)xmalloc((n > 0 ? 2 * n : 1) * sizeof(int));
+  MPI_Alltoallv(answer_sorted, send_sizes, send_disps, MPI_INT, reply,
+                recv_sizes, recv_disps, MPI_INT, OP_PART_WORLD);
+  op_free(answer_sorted);
+
+  int *partition = (int *)xmalloc((n > 0 ? n : 1) * sizeof(int));
+  for (int i = 0; i < n; i++)
+    partition[reply[2 * i] - part_range[set->index][2 * my_rank]] =
+        reply[2 * i + 1];
+  op_free(reply);
+  op_free(send_sizes);
+  op_free(send_disps);
+  op_free(recv_sizes);
+  op_free(recv_disps);
+
+  // initialise primary set as partitioned
+  OP_part_list[set->index]->elem_part = partition;
+  OP_part_list[set->index]->is_partitioned = 1;
+
+  // free part range
+  for (int i = 0; i < OP_set_index; i++)
+    op_free(part_range[i]);
+  op_free(part_range);
+
+  /*-STEP 4 - Partition all other sets,migrate data and renumber mapping
+   * tables-*/
+
+  // hand the parts to the ranks node by node
+  order_parts_by_node(set, comm_size);
+
+  // partition all other sets
+  partition_all(set, my_rank, comm_size);
+
+  // migrate data, sort elements
+  migrate_all(my_rank, comm_size);
+
+  // renumber mapping tables
+  renumber_maps(my_rank, comm_size);
+
+  op_timers(&cpu_t2, &wall_t2); // timer stop for partitioning
+
+  // printf time for partitioning
+  time = wall_t2 - wall_t1;
+  MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, MPI_ROOT, OP_PART_WORLD);
+  MPI_Comm_free(&OP_PART_WORLD);
+  if (my_rank == MPI_ROOT)
+    printf("Max total space filling curve partitioning time = %lf\n",
+           max_time);
+}
+
 /*******************************************************************************
 * Toplevel partitioning selection function - also triggers halo creation
 *******************************************************************************/
@@ -3191,7 +4068,16 @@ void partition(const char *lib_name, const char *lib_routine, op_set prime_set,
   if (lib_routine == NULL)
     lib_routine = "NULL";
 
-  if (strcmp(lib_name, "KAHIP") == 0) {
+  if (preload_g_index != NULL) {
+    op_printf("Using the partition the mesh was read with\n");
+    if (strcmp(lib_name, "NULL") != 0)
+      op_printf("Ignoring input partitioner : %s\n", lib_name);
+    if (op_partition_preloaded() == 0) {
+      op_printf("Sets not read with the partition keep their block "
+                "distribution\n");
+      partial_halo_flag = 0;
+    }
+  } else if (strcmp(lib_name, "KAHIP") == 0) {
 #ifdef HAVE_KAHIP
     op_printf("Selected Partitioning Routine : %s\n", lib_routine);
     if (strcmp(lib_routine, "KWAY") == 0) {
@@ -3361,6 +4247,30 @@ void partition(const char *lib_name, const char *lib_routine, op_set prime_set,
       op_printf("Reverting to trivial block partitioning\n");
       partial_halo_flag = 0;
     }
+  } else if (strcmp(lib_name, "SFC") == 0) {
+    op_printf("Selected Partitioning Routine : %s\n", lib_name);
+    if (data != NULL && data->data != NULL) {
+      if (data->dim >= 1 && data->dim <= 3) {
+        if (strcmp(lib_routine, "MORTON") == 0)
+          op_partition_sfc(data, 0); // Morton (Z-order) curve
+        else {
+          if (strcmp(lib_routine, "HILBERT") != 0 &&
+              strcmp(lib_routine, "NULL") != 0)
+            op_printf("Partitioning Routine : %s UNSUPPORTED, using HILBERT\n",
+                      lib_routine);
+          op_partition_sfc(data, 1); // Hilbert curve
+        }
+      } else {
+        op_printf("Space filling curves need 1D, 2D or 3D coordinates\n");
+        op_printf("Reverting to trivial block partitioning\n");
+        partial_halo_flag = 0;
+      }
+    } else {
+      op_printf("Partitioning based on dataset : NULL - UNSUPPORTED "
+                "Partitioner Specification\n");
+      op_printf("Reverting to trivial block partitioning\n");
+      partial_halo_flag = 0;
+    }
   } else {
     op_printf("Partitioning Library : %s UNSUPPORTED\n", lib_name);
     op_printf("Ignoring input routine : %s\n", lib_routine);
@@ -3388,6 +4298,9 @@ void partition(const char *lib_name, const char *lib_routine, op_set prime_set,
       OP_map_partial_exchange[i] = 0;
   }
 
+  if (OP_diags > 1)
+    op_partition_report();
+
 #ifdef DEBUG // sanity check to identify if the partitioning results in ophan
              // elements
   int ctr = 0;
@@ -3437,6 +4350,247 @@ void op_partition_ptr(const char *lib_name, const char *lib_routine,
   op_partition(lib_name, lib_routine, prime_set, item_map, item_dat);
 }
 
+/*******************************************************************************
+ * Utility function to fill the import halo of ids[] from the owners of the
+ * elements, through one pair of export/import lists
+ *******************************************************************************/
+
+static void exchange_halo_ids(int *ids, int import_offset, halo_list exp_list,
+                              halo_list imp_list) {
+  int *sbuf = (int *)xmalloc((exp_list->size > 0 ? exp_list->size : 1) *
+                             sizeof(int));
+  MPI_Request *request = (MPI_Request *)xmalloc(
+      (exp_list->ranks_size + imp_list->ranks_size + 1) * sizeof(MPI_Request));
+
+  int n_req = 0;
+  for (int i = 0; i < exp_list->ranks_size; i++) {
+    for (int j = 0; j < exp_list->sizes[i]; j++)
+      sbuf[exp_list->disps[i] + j] =
+          ids[exp_list->list[exp_list->disps[i] + j]];
+    MPI_Isend(&sbuf[exp_list->disps[i]], exp_list->sizes[i], MPI_INT,
+              exp_list->ranks[i], 1, OP_PART_WORLD, &request[n_req++]);
+  }
+  for (int i = 0; i < imp_list->ranks_size; i++)
+    MPI_Irecv(&ids[import_offset + imp_list->disps[i]], imp_list->sizes[i],
+              MPI_INT, imp_list->ranks[i], 1, OP_PART_WORLD,
+              &request[n_req++]);
+  MPI_Waitall(n_req, request, MPI_STATUSES_IGNORE);
+
+  op_free(request);
+  op_free(sbuf);
+}
+
+/*******************************************************************************
+ * Routine to partition the mesh again once the halos exist, giving each rank
+ * a share in proportion to the compute throughput measured since op_partition
+ * (or the previous op_repartition) by the op_par_loop timers
+ *******************************************************************************/
+
+void op_repartition(const char *lib_name, const char *lib_routine,
+                    op_set prime_set, op_map prime_map, op_dat coords) {
+#ifdef HAVE_GPI
+  (void)lib_name;
+  (void)lib_routine;
+  (void)prime_set;
+  (void)prime_map;
+  (void)coords;
+  op_printf("op_repartition UNSUPPORTED with GPI halo exchanges\n");
+#else
+  if (OP_import_exec_list == NULL) {
+    op_printf("op_repartition called before op_partition, ignoring\n");
+    return;
+  }
+
+  int my_rank, comm_size;
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_PART_WORLD);
+  MPI_Comm_rank(OP_PART_WORLD, &my_rank);
+  MPI_Comm_size(OP_PART_WORLD, &comm_size);
+
+  /*--STEP 1 - measure the throughput of each rank: owned elements per second
+    of kernel time spent outside MPI since the last repartitioning */
+
+  static double compute_mark = 0.0;
+  double compute = 0.0;
+  for (int k = 0; k < OP_kern_max; k++)
+    compute += OP_kernels[k].time - OP_kernels[k].mpi_time;
+  double owned = 0.0;
+  for (int s = 0; s < OP_set_index; s++)
+    owned += OP_set_list[s]->size;
+
+  double load[2] = {owned, compute - compute_mark};
+  compute_mark = compute;
+  double *loads = (double *)xmalloc(2 * comm_size * sizeof(double));
+  MPI_Allgather(load, 2, MPI_DOUBLE, loads, 2, MPI_DOUBLE, OP_PART_WORLD);
+
+  double rate_sum = 0.0, time_sum = 0.0, time_max = 0.0;
+  int n_rate = 0;
+  for (int r = 0; r < comm_size; r++) {
+    time_sum += loads[2 * r + 1];
+    time_max = MAX(time_max, loads[2 * r + 1]);
+    if (loads[2 * r] > 0.0 && loads[2 * r + 1] > 0.0) {
+      rate_sum += loads[2 * r] / loads[2 * r + 1];
+      n_rate++;
+    }
+  }
+  // ranks without a measurement are taken to run at the average rate
+  double rate_avg = n_rate > 0 ? rate_sum / n_rate : 0.0;
+  double rate = (load[0] > 0.0 && load[1] > 0.0) ? load[0] / load[1] : rate_avg;
+  OP_part_capacity = rate_avg > 0.0 ? rate / rate_avg : 1.0;
+  if (time_sum > 0.0)
+    op_printf("Repartitioning, compute time imbalance (max/avg) = %lf\n",
+              time_max * comm_size / time_sum);
+  op_free(loads);
+
+  /*--STEP 2 - number the owned elements of each set in rank order, and
+    fetch the numbers of the halo elements from their owners */
+
+  int **part_range = (int **)xmalloc(OP_set_index * sizeof(int *));
+  get_part_range(part_range, my_rank, comm_size, OP_PART_WORLD);
+
+  int **ids = (int **)xmalloc(OP_set_index * sizeof(int *));
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    halo_list exec_i = OP_import_exec_list[set->index];
+    halo_list nonexec_i = OP_import_nonexec_list[set->index];
+    int total = set->size + exec_i->size + nonexec_i->size;
+
+    ids[set->index] = (int *)xmalloc((total > 0 ? total : 1) * sizeof(int));
+    for (int i = 0; i < set->size; i++)
+      ids[set->index][i] = part_range[set->index][2 * my_rank] + i;
+    exchange_halo_ids(ids[set->index], set->size,
+                      OP_export_exec_list[set->index], exec_i);
+    exchange_halo_ids(ids[set->index], set->size + exec_i->size,
+                      OP_export_nonexec_list[set->index], nonexec_i);
+  }
+
+  // put the mapping tables back into global numbering
+  for (int m = 0; m < OP_map_index; m++) {
+    op_map map = OP_map_list[m];
+    int *to_ids = ids[map->to->index];
+    for (int e = 0; e < map->from->size * map->dim; e++)
+      map->map[e] = to_ids[map->map[e]];
+    map->map =
+        (int *)xrealloc(map->map, (size_t)map->from->size * map->dim * sizeof(int));
+  }
+
+  for (int s = 0; s < OP_set_index; s++)
+    op_free(ids[s]);
+  op_free(ids);
+
+  /*--STEP 3 - keep the original global indices, then tear down the halos,
+    the plans and the current partitioning */
+
+  int **prev_g_index = (int **)xmalloc(OP_set_index * sizeof(int *));
+  for (int s = 0; s < OP_set_index; s++) {
+    prev_g_index[s] = OP_part_list[s]->g_index;
+    op_free(OP_part_list[s]->elem_part);
+    op_free(OP_part_list[s]);
+  }
+  op_free(OP_part_list);
+  OP_part_list = NULL;
+  OP_part_index = 0;
+  int **prev_part_range = orig_part_range;
+  orig_part_range = NULL;
+
+  op_dat_entry *item;
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    if (item->dat->dirty_hd == 2)
+      op_download_dat(item->dat);
+  }
+  op_halo_permap_destroy();
+  op_halo_destroy();
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    op_free(item->dat->mpi_buffer);
+    item->dat->mpi_buffer = NULL;
+  }
+  op_rt_exit();
+  MPI_Comm_free(&OP_PART_WORLD);
+
+  /*--STEP 4 - partition again, this time with the measured capacities */
+
+  op_partition(lib_name, lib_routine, prime_set, prime_map, coords);
+
+  /*--STEP 5 - the new g_index holds the numbering of STEP 2, replace it with
+    the original global index held by the previous owner of each element */
+
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_PART_WORLD);
+  int *send_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *send_disps = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_sizes = (int *)xmalloc(comm_size * sizeof(int));
+  int *recv_disps = (int *)xmalloc(comm_size * sizeof(int));
+
+  for (int s = 0; s < OP_set_index; s++) {
+    op_set set = OP_set_list[s];
+    int *g_index = OP_part_list[set->index]->g_index;
+    int n = set->size > 0 ? set->size : 1;
+    int *owner = (int *)xmalloc(n * sizeof(int));
+    int *local = (int *)xmalloc(n * sizeof(int));
+
+    for (int r = 0; r < comm_size; r++)
+      send_sizes[r] = 0;
+    for (int i = 0; i < set->size; i++) {
+      owner[i] = get_partition(g_index[i], part_range[set->index], &local[i],
+                               comm_size);
+      send_sizes[owner[i]]++;
+    }
+    MPI_Alltoall(send_sizes, 1, MPI_INT, recv_sizes, 1, MPI_INT,
+                 OP_PART_WORLD);
+    send_disps[0] = recv_disps[0] = 0;
+    for (int r = 1; r < comm_size; r++) {
+      send_disps[r] = send_disps[r - 1] + send_sizes[r - 1];
+      recv_disps[r] = recv_disps[r - 1] + recv_sizes[r - 1];
+    }
+    int recv_total = recv_disps[comm_size - 1] + recv_sizes[comm_size - 1];
+
+    // requests grouped by owner, pos[] remembers where each answer goes
+    int *request = (int *)xmalloc(n * sizeof(int));
+    int *pos = (int *)xmalloc(n * sizeof(int));
+    for (int r = 0; r < comm_size; r++)
+      send_sizes[r] = 0;
+    for (int i = 0; i < set->size; i++) {
+      int k = send_disps[owner[i]] + send_sizes[owner[i]]++;
+      request[k] = local[i];
+      pos[k] = i;
+    }
+
+    int *reply =
+        (int *)xmalloc((recv_total > 0 ? recv_total : 1) * sizeof(int));
+    MPI_Alltoallv(request, send_sizes, send_disps, MPI_INT, reply, recv_sizes,
+                  recv_disps, MPI_INT, OP_PART_WORLD);
+    for (int i = 0; i < recv_total; i++)
+      reply[i] = prev_g_index[set->index][reply[i]];
+    MPI_Alltoallv(reply, recv_sizes, recv_disps, MPI_INT, request, send_sizes,
+                  send_disps, MPI_INT, OP_PART_WORLD);
+    for (int k = 0; k < set->size; k++)
+      g_index[pos[k]] = request[k];
+
+    op_free(reply);
+    op_free(pos);
+    op_free(request);
+    op_free(local);
+    op_free(owner);
+    op_free(prev_g_index[set->index]);
+  }
+  op_free(prev_g_index);
+  op_free(send_sizes);
+  op_free(send_disps);
+  op_free(recv_sizes);
+  op_free(recv_disps);
+
+  // the original block ranges still describe the numbering of g_index
+  for (int s = 0; s < OP_set_index; s++) {
+    op_free(orig_part_range[s]);
+    op_free(part_range[s]);
+  }
+  op_free(orig_part_range);
+  op_free(part_range);
+  orig_part_range = prev_part_range;
+
+  TAILQ_FOREACH(item, &OP_dat_list, entries) { item->dat->dirtybit = 1; }
+  MPI_Comm_free(&OP_PART_WORLD);
+#endif
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -3754,17 +4908,14 @@ setup_part_data(op_map primary_map, int my_rank, int comm_size, int **adj,
     partition_pm[i] = -99;
   }
 
-  int *hybrid_flags = (int *)xmalloc(comm_size * sizeof(int));
-  MPI_Allgather(&OP_hybrid_gpu, 1, MPI_INT, hybrid_flags, 1, MPI_INT,
-                OP_PART_WORLD);
-  double total = 0;
-  for (int i = 0; i < comm_size; i++)
-    total += hybrid_flags[i] == 1 ? OP_hybrid_balance : 1.0;
+  double *target = (double *)xmalloc(comm_size * sizeof(double));
+  get_part_targets(target, comm_size);
 
   T ncon = 1;
   real_t *tpwgts = (real_t *)xmalloc(comm_size * sizeof(real_t) * ncon);
   for (int i = 0; i < comm_size * ncon; i++)
-    tpwgts[i] = hybrid_flags[i] == 1 ? OP_hybrid_balance / total : 1.0 / total;
+    tpwgts[i] = (real_t)target[i];
+  op_free(target);
 
   real_t *ubvec = (real_t *)xmalloc(sizeof(real_t) * ncon);
   *ubvec = 1.05;
@@ -3803,11 +4954,11 @@ void check_partition(op_map primary_map, T *partition_pm, int my_rank,
 
 #ifdef HAVE_PARMETIS
 void perform_kway_partition(idx_t *vtxdist, idx_t *xadj, idx_t *adjncy,
-                            idx_t *wgtflag, idx_t *numflag, idx_t *ncon,
-                            idx_t *nparts, real_t *tpwgts, real_t *ubvec,
-                            idx_t *options, idx_t *edgecut, idx_t *part,
-                            MPI_Comm *comm) {
-  ParMETIS_V3_PartKway(vtxdist, xadj, adjncy, NULL, NULL, wgtflag, numflag,
+                            idx_t *vwgt, idx_t *wgtflag, idx_t *numflag,
+                            idx_t *ncon, idx_t *nparts, real_t *tpwgts,
+                            real_t *ubvec, idx_t *options, idx_t *edgecut,
+                            idx_t *part, MPI_Comm *comm) {
+  ParMETIS_V3_PartKway(vtxdist, xadj, adjncy, vwgt, NULL, wgtflag, numflag,
                        ncon, nparts, tpwgts, ubvec, options, edgecut, part,
                        comm);
 }
@@ -3815,11 +4966,11 @@ void perform_kway_partition(idx_t *vtxdist, idx_t *xadj, idx_t *adjncy,
 
 #ifdef HAVE_KAHIP
 void perform_kway_partition(idxtype *vtxdist, idxtype *xadj, idxtype *adjncy,
-                            idxtype *, idxtype *, idxtype *, idxtype *nparts,
-                            real_t *, real_t *, idxtype *, idxtype *edgecut,
-                            idxtype *part, MPI_Comm *comm) {
+                            idxtype *vwgt, idxtype *, idxtype *, idxtype *,
+                            idxtype *nparts, real_t *, real_t *, idxtype *,
+                            idxtype *edgecut, idxtype *part, MPI_Comm *comm) {
   double imb = 0.03;
-  ParHIPPartitionKWay(vtxdist, xadj, adjncy, NULL, NULL, (int *)nparts, &imb,
+  ParHIPPartitionKWay(vtxdist, xadj, adjncy, vwgt, NULL, (int *)nparts, &imb,
                       false, 1, ULTRAFASTMESH, (int *)edgecut, part, comm);
 }
 #endif
@@ -3882,6 +5033,17 @@ void op_partition_kway_generic(op_map primary_map, bool use_kahip) {
   T wgtflag = 0;
   T options[3] = {1, 3, 15};
 
+  // per-element weights, if any were registered
+  T *vwgt = NULL;
+  int *weights = get_vertex_weights(primary_map->to, part_range, comm_size);
+  if (weights != NULL) {
+    vwgt = (T *)xmalloc((primary_map->to->size + 1) * sizeof(T));
+    for (int i = 0; i < primary_map->to->size; i++)
+      vwgt[i] = (T)weights[i];
+    op_free(weights);
+    wgtflag = 2;
+  }
+
   // clean up before calling ParMetis
   for (int i = 0; i < OP_set_index; i++)
     op_free(part_range[i]);
@@ -3905,12 +5067,13 @@ void op_partition_kway_generic(op_map primary_map, bool use_kahip) {
     printf("-----------------------------------------------------------\n");
   }
 
-  perform_kway_partition(vtxdist, xadj, adjncy, &wgtflag, &numflag, &ncon,
-                         &comm_size_pm, tpwgts, ubvec, options, &edge_cut,
-                         partition_pm, &OP_PART_WORLD);
+  perform_kway_partition(vtxdist, xadj, adjncy, vwgt, &wgtflag, &numflag,
+                         &ncon, &comm_size_pm, tpwgts, ubvec, options,
+                         &edge_cut, partition_pm, &OP_PART_WORLD);
 
   if (my_rank == MPI_ROOT)
     printf("-----------------------------------------------------------\n");
+  op_free(vwgt);
   op_free(vtxdist);
   op_free(xadj);
   op_free(adjncy);
@@ -3922,6 +5085,9 @@ void op_partition_kway_generic(op_map primary_map, bool use_kahip) {
   /*-STEP 2 - Partition all other sets,migrate data and renumber mapping
    * tables-*/
 
+  // hand the parts to the ranks node by node
+  order_parts_by_node(primary_map->to, comm_size);
+
   // partition all other sets
   partition_all(primary_map->to, my_rank, comm_size);
 
@@ -54,6 +54,113 @@ void op_upload_dat(op_dat dat) {}
 
 void op_download_dat(op_dat dat) {}
 
+/*******************************************************************************
+ * Differential halo exchange (OP_diff_halo): buf_exec/buf_nonexec keep what
+ * was last sent to each neighbour, so a message only carries a bitmap of the
+ * blocks of OP_DIFF_BLOCK elements that changed since, followed by those
+ * blocks. The receiver keeps the halo as last received in diff_halo and copies
+ * it back over the whole halo, since loops may have written the exec halo.
+ *******************************************************************************/
+
+// largest message for n elements: bitmap words, then every block
+static size_t diff_msg_size(int n, int size) {
+  int blocks = (n + OP_DIFF_BLOCK - 1) / OP_DIFF_BLOCK;
+  return ((blocks + 31) / 32) * sizeof(unsigned int) + (size_t)n * size;
+}
+
+static void diff_halo_alloc(op_dat dat) {
+  op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+  if (mpi_buf->diff_halo != NULL)
+    return;
+  halo_list lists[4] = {OP_export_exec_list[dat->set->index],
+                        OP_export_nonexec_list[dat->set->index],
+                        OP_import_exec_list[dat->set->index],
+                        OP_import_nonexec_list[dat->set->index]};
+  size_t bytes[2] = {0, 0};
+  for (int l = 0; l < 4; l++)
+    for (int i = 0; i < lists[l]->ranks_size; i++)
+      bytes[l / 2] += diff_msg_size(lists[l]->sizes[i], dat->size);
+  mpi_buf->diff_send = (char *)xmalloc(bytes[0]);
+  mpi_buf->diff_recv = (char *)xmalloc(bytes[1]);
+  mpi_buf->diff_halo = (char *)xmalloc(
+      (size_t)(lists[2]->size + lists[3]->size) * dat->size);
+  mpi_buf->diff_synced = 0;
+}
+
+// packs the blocks of export entry i that differ from the last sent values in
+// shadow, or all of them if full, returns the message length
+static int diff_pack(op_dat dat, halo_list list, int i, char *shadow,
+                     char *msg, int full) {
+  int n = list->sizes[i];
+  int *elems = &list->list[list->disps[i]];
+  shadow += (size_t)list->disps[i] * dat->size;
+  int blocks = (n + OP_DIFF_BLOCK - 1) / OP_DIFF_BLOCK;
+  unsigned int *bits = (unsigned int *)msg;
+  memset(bits, 0, ((blocks + 31) / 32) * sizeof(unsigned int));
+  char *out = msg + ((blocks + 31) / 32) * sizeof(unsigned int);
+  for (int b = 0; b < blocks; b++) {
+    int lo = b * OP_DIFF_BLOCK;
+    int hi = MIN(n, lo + OP_DIFF_BLOCK);
+    int changed = full;
+    for (int j = lo; j < hi; j++) {
+      char *cur = &dat->data[(size_t)dat->size * elems[j]];
+      char *old = &shadow[(size_t)j * dat->size];
+      if (full || memcmp(cur, old, dat->size) != 0) {
+        memcpy(old, cur, dat->size);
+        changed = 1;
+      }
+    }
+    if (changed) {
+      bits[b / 32] |= 1u << (b % 32);
+      memcpy(out, &shadow[(size_t)lo * dat->size], (size_t)(hi - lo) * dat->size);
+      out += (size_t)(hi - lo) * dat->size;
+    }
+  }
+  return (int)(out - msg);
+}
+
+// applies a message for n elements to halo, the last received values
+static void diff_unpack(const char *msg, char *halo, int n, int size) {
+  int blocks = (n + OP_DIFF_BLOCK - 1) / OP_DIFF_BLOCK;
+  const unsigned int *bits = (const unsigned int *)msg;
+  const char *in = msg + ((blocks + 31) / 32) * sizeof(unsigned int);
+  for (int b = 0; b < blocks; b++) {
+    if (!(bits[b / 32] & (1u << (b % 32))))
+      continue;
+    int lo = b * OP_DIFF_BLOCK;
+    int hi = MIN(n, lo + OP_DIFF_BLOCK);
+    memcpy(&halo[(size_t)lo * size], in, (size_t)(hi - lo) * size);
+    in += (size_t)(hi - lo) * size;
+  }
+}
+
+// completes a differential exchange once its messages have arrived
+static void diff_halo_finish(op_dat dat) {
+  op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+  int shm = mpi_buf->shm_peer != NULL;
+  halo_list lists[2] = {OP_import_exec_list[dat->set->index],
+                        OP_import_nonexec_list[dat->set->index]};
+  size_t off = 0;
+  size_t init = (size_t)dat->set->size * dat->size;
+  char *shadow = mpi_buf->diff_halo;
+  for (int l = 0; l < 2; l++) {
+    halo_list list = lists[l];
+    for (int i = 0; i < list->ranks_size; i++) {
+      if (shm && OP_shm_node_rank[list->ranks[i]] >= 0)
+        continue;
+      size_t at = (size_t)list->disps[i] * dat->size;
+      diff_unpack(&mpi_buf->diff_recv[off], &shadow[at], list->sizes[i],
+                  dat->size);
+      memcpy(&dat->data[init + at], &shadow[at],
+             (size_t)list->sizes[i] * dat->size);
+      off += diff_msg_size(list->sizes[i], dat->size);
+    }
+    init += (size_t)list->size * dat->size;
+    shadow += (size_t)list->size * dat->size;
+  }
+  mpi_buf->diff_pending = 0;
+}
+
 /*******************************************************************************
  * Main MPI Halo Exchange Function
  *******************************************************************************/
@@ -91,6 +198,18 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
     halo_list exp_exec_list = OP_export_exec_list[dat->set->index];
     halo_list exp_nonexec_list = OP_export_nonexec_list[dat->set->index];
 
+    // neighbours on this node write straight into the halo, see
+    // op_halo_shm_create, only the others get messages
+    int shm = ((op_mpi_buffer)(dat->mpi_buffer))->shm_peer != NULL;
+    if (shm)
+      op_halo_shm_begin(dat);
+
+    // with OP_diff_halo the messages are staged in diff_send/diff_recv
+    op_mpi_buffer mpi_buf = (op_mpi_buffer)(dat->mpi_buffer);
+    if (OP_diff_halo)
+      diff_halo_alloc(dat);
+    size_t s_off = 0, r_off = 0;
+
     //-------first exchange exec elements related to this data array--------
 
     // sanity checks
@@ -105,6 +224,17 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
 
     int set_elem_index;
     for (int i = 0; i < exp_exec_list->ranks_size; i++) {
+      if (shm && OP_shm_node_rank[exp_exec_list->ranks[i]] >= 0)
+        continue;
+      if (OP_diff_halo) {
+        int bytes = diff_pack(dat, exp_exec_list, i, mpi_buf->buf_exec,
+                              &mpi_buf->diff_send[s_off], !mpi_buf->diff_synced);
+        MPI_Isend(&mpi_buf->diff_send[s_off], bytes, MPI_CHAR,
+                  exp_exec_list->ranks[i], dat->index, OP_MPI_WORLD,
+                  &mpi_buf->s_req[mpi_buf->s_num_req++]);
+        s_off += diff_msg_size(exp_exec_list->sizes[i], dat->size);
+        continue;
+      }
       for (int j = 0; j < exp_exec_list->sizes[i]; j++) {
         set_elem_index = exp_exec_list->list[exp_exec_list->disps[i] + j];
         memcpy(&((op_mpi_buffer)(dat->mpi_buffer))
@@ -133,6 +263,16 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
 
     int init = dat->set->size * dat->size;
     for (int i = 0; i < imp_exec_list->ranks_size; i++) {
+      if (shm && OP_shm_node_rank[imp_exec_list->ranks[i]] >= 0)
+        continue;
+      if (OP_diff_halo) {
+        size_t bytes = diff_msg_size(imp_exec_list->sizes[i], dat->size);
+        MPI_Irecv(&mpi_buf->diff_recv[r_off], (int)bytes, MPI_CHAR,
+                  imp_exec_list->ranks[i], dat->index, OP_MPI_WORLD,
+                  &mpi_buf->r_req[mpi_buf->r_num_req++]);
+        r_off += bytes;
+        continue;
+      }
       //      printf("import exec on to %d from %d data %10s, number of elements
       //      of size %d | recieving:\n ",
       //           my_rank, imp_exec_list->ranks[i], dat->name,
@@ -158,6 +298,17 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
     int rank;
     MPI_Comm_rank(OP_MPI_WORLD, &rank);
     for (int i = 0; i < exp_nonexec_list->ranks_size; i++) {
+      if (shm && OP_shm_node_rank[exp_nonexec_list->ranks[i]] >= 0)
+        continue;
+      if (OP_diff_halo) {
+        int bytes = diff_pack(dat, exp_nonexec_list, i, mpi_buf->buf_nonexec,
+                              &mpi_buf->diff_send[s_off], !mpi_buf->diff_synced);
+        MPI_Isend(&mpi_buf->diff_send[s_off], bytes, MPI_CHAR,
+                  exp_nonexec_list->ranks[i], dat->index, OP_MPI_WORLD,
+                  &mpi_buf->s_req[mpi_buf->s_num_req++]);
+        s_off += diff_msg_size(exp_nonexec_list->sizes[i], dat->size);
+        continue;
+      }
       for (int j = 0; j < exp_nonexec_list->sizes[i]; j++) {
         set_elem_index = exp_nonexec_list->list[exp_nonexec_list->disps[i] + j];
         memcpy(&((op_mpi_buffer)(dat->mpi_buffer))
@@ -183,6 +334,16 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
 
     int nonexec_init = (dat->set->size + imp_exec_list->size) * dat->size;
     for (int i = 0; i < imp_nonexec_list->ranks_size; i++) {
+      if (shm && OP_shm_node_rank[imp_nonexec_list->ranks[i]] >= 0)
+        continue;
+      if (OP_diff_halo) {
+        size_t bytes = diff_msg_size(imp_nonexec_list->sizes[i], dat->size);
+        MPI_Irecv(&mpi_buf->diff_recv[r_off], (int)bytes, MPI_CHAR,
+                  imp_nonexec_list->ranks[i], dat->index, OP_MPI_WORLD,
+                  &mpi_buf->r_req[mpi_buf->r_num_req++]);
+        r_off += bytes;
+        continue;
+      }
       //      printf("import on to %d from %d data %10s, number of elements of
       //      size %d | recieving:\n ",
       //            my_rank, imp_nonexec_list->ranks[i], dat->name,
@@ -194,6 +355,16 @@ void op_exchange_halo(op_arg *arg, int exec_flag) {
           &((op_mpi_buffer)(dat->mpi_buffer))
                ->r_req[((op_mpi_buffer)(dat->mpi_buffer))->r_num_req++]);
     }
+
+    // with the messages in flight, copy into the halos on this node
+    if (shm)
+      op_halo_shm_push(dat);
+
+    if (OP_diff_halo) {
+      mpi_buf->diff_synced = 1;
+      mpi_buf->diff_pending = 1;
+    }
+
     // clear dirty bit
     dat->dirtybit = 0;
     arg->sent = 1;
@@ -261,6 +432,9 @@ void op_exchange_halo_partial(op_arg *arg, int exec_flag) {
                ->r_req[((op_mpi_buffer)(dat->mpi_buffer))->r_num_req++]);
     }
 
+    // buf_nonexec no longer holds what the last full exchange sent
+    ((op_mpi_buffer)(dat->mpi_buffer))->diff_synced = 0;
+
     // note that we are not settinging the dirtybit to 0, since it's not a full
     // exchange
     arg->sent = 1;
@@ -284,6 +458,10 @@ void op_wait_all(op_arg *arg) {
                 ((op_mpi_buffer)(dat->mpi_buffer))->r_req, MPI_STATUSES_IGNORE);
     ((op_mpi_buffer)(dat->mpi_buffer))->s_num_req = 0;
     ((op_mpi_buffer)(dat->mpi_buffer))->r_num_req = 0;
+    if (((op_mpi_buffer)(dat->mpi_buffer))->shm_peer != NULL)
+      op_halo_shm_wait(dat);
+    if (((op_mpi_buffer)(dat->mpi_buffer))->diff_pending)
+      diff_halo_finish(dat);
     arg->sent = 2; // set flag to indicate completed comm
     if (arg->map != OP_ID && OP_map_partial_exchange[arg->map->index]) {
       int my_rank;
@@ -306,6 +484,12 @@ void op_wait_all_cuda(op_arg *arg) {}
 void op_partition(const char *lib_name, const char *lib_routine,
                   op_set prime_set, op_map prime_map, op_dat coords) {
   partition(lib_name, lib_routine, prime_set, prime_map, coords);
+  op_halo_shm_create();
+}
+
+void op_partition_restart(const char *file_name) {
+  partition_restart(file_name);
+  op_halo_shm_create();
 }
 
 void op_move_to_device() {}
@@ -38,6 +38,7 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <limits.h>
 
 MPI_Comm OP_MPI_IO_WORLD;
 
@@ -56,23 +57,6 @@ void _mpi_allgather(double *l, double *g, int size, int *recevcnts, int *displs,
   MPI_Allgatherv(l, size, MPI_DOUBLE, g, recevcnts, displs, MPI_DOUBLE, comm);
 }
 
-void _mpi_gather(int *l, int *g, int size, int *recevcnts, int *displs,
-                 MPI_Comm comm) {
-  MPI_Gatherv(l, size, MPI_INT, g, recevcnts, displs, MPI_INT, MPI_ROOT, comm);
-}
-
-void _mpi_gather(float *l, float *g, int size, int *recevcnts, int *displs,
-                 MPI_Comm comm) {
-  MPI_Gatherv(l, size, MPI_FLOAT, g, recevcnts, displs, MPI_FLOAT, MPI_ROOT,
-              comm);
-}
-
-void _mpi_gather(double *l, double *g, int size, int *recevcnts, int *displs,
-                 MPI_Comm comm) {
-  MPI_Gatherv(l, size, MPI_DOUBLE, g, recevcnts, displs, MPI_DOUBLE, MPI_ROOT,
-              comm);
-}
-
 template <typename T>
 void gather_data_hdf5(op_dat dat, char *usr_ptr, int low, int high) {
   // create new communicator
@@ -134,85 +118,211 @@ void checked_write(int v, const char *file_name) {
   }
 }
 
-template <typename T>
-void write_bin(FILE *fp, int g_size, int elem_size, T *g_array,
-               const char *file_name) {
-  checked_write(fwrite(&g_size, sizeof(int), 1, fp) < 1, file_name);
-  checked_write(fwrite(&elem_size, sizeof(int), 1, fp) < 1, file_name);
-
-  for (int i = 0; i < g_size; i++)
-    checked_write(fwrite(&g_array[i * elem_size], sizeof(T), elem_size, fp) <
-                      (size_t)elem_size,
-                  file_name);
-}
-
-template <typename T, const char *fmt>
-void write_txt(FILE *fp, int g_size, int elem_size, T *g_array,
-               const char *file_name) {
-  checked_write(fprintf(fp, "%d %d\n", g_size, elem_size) < 0, file_name);
-
-  for (int i = 0; i < g_size; i++) {
-    for (int j = 0; j < elem_size; j++)
-      checked_write(fprintf(fp, fmt, g_array[i * elem_size + j]) < 0,
-                    file_name);
-    fprintf(fp, "\n");
+/*
+ * open file_name for writing by all ranks of OP_MPI_IO_WORLD, discarding any
+ * previous contents
+ */
+static MPI_File open_file_mpi(const char *file_name) {
+  MPI_File fh;
+  if (MPI_File_open(OP_MPI_IO_WORLD, file_name,
+                    MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                    &fh) != MPI_SUCCESS) {
+    printf("can't open file %s\n", file_name);
+    MPI_Abort(OP_MPI_IO_WORLD, -1);
   }
+  checked_write(MPI_File_set_size(fh, 0) != MPI_SUCCESS, file_name);
+  return fh;
 }
 
-template <typename T, void (*F)(FILE *, int, int, T *, const char *)>
-void write_file(op_dat dat, const char *file_name) {
-  // create new communicator for output
-  int rank, comm_size;
-  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_IO_WORLD);
+/*
+ * binary file: the global number of elements and the dim as ints, then the
+ * elements in their original order. Each rank holds its original block of
+ * the dat (see op_mpi_get_data) and writes it at its offset with one
+ * collective write
+ */
+static void write_bin(op_dat dat, const char *file_name) {
+  int rank;
   MPI_Comm_rank(OP_MPI_IO_WORLD, &rank);
-  MPI_Comm_size(OP_MPI_IO_WORLD, &comm_size);
 
-  // compute local number of elements in dat
-  int count = dat->set->size;
+  long long l_size = dat->set->size, offset = 0;
+  int g_size = 0;
+  MPI_Exscan(&l_size, &offset, 1, MPI_LONG_LONG, MPI_SUM, OP_MPI_IO_WORLD);
+  MPI_Allreduce(&dat->set->size, &g_size, 1, MPI_INT, MPI_SUM,
+                OP_MPI_IO_WORLD);
+  if (rank == 0)
+    offset = 0; // MPI_Exscan leaves the result on rank 0 undefined
 
-  T *l_array = (T *)xmalloc(dat->dim * (count) * sizeof(T));
-  memcpy(l_array, (void *)&(dat->data[0]), (size_t)dat->size * count);
+  MPI_File fh = open_file_mpi(file_name);
+  if (rank == MPI_ROOT) {
+    int header[2] = {g_size, dat->dim};
+    checked_write(MPI_File_write_at(fh, 0, header, 2, MPI_INT,
+                                    MPI_STATUS_IGNORE) != MPI_SUCCESS,
+                  file_name);
+  }
 
-  int l_size = count;
-  int elem_size = dat->dim;
-  int *recevcnts = (int *)xmalloc(comm_size * sizeof(int));
-  int *displs = (int *)xmalloc(comm_size * sizeof(int));
-  int disp = 0;
-  T *g_array = 0;
+  MPI_Datatype elem;
+  MPI_Type_contiguous(dat->size, MPI_BYTE, &elem);
+  MPI_Type_commit(&elem);
+  checked_write(MPI_File_write_at_all(fh, 2 * sizeof(int) + offset * dat->size,
+                                      dat->data, dat->set->size, elem,
+                                      MPI_STATUS_IGNORE) != MPI_SUCCESS,
+                file_name);
+  MPI_Type_free(&elem);
+  MPI_File_close(&fh);
+}
 
-  MPI_Allgather(&l_size, 1, MPI_INT, recevcnts, 1, MPI_INT, OP_MPI_IO_WORLD);
+/*
+ * streaming binary write straight from the partitioned dat: each rank sorts
+ * its elements by their original global index and writes them in rounds of
+ * at most OP_io_stream MiB, each round a collective write through a file
+ * view made of the runs of consecutive indices. Neither the whole dat nor a
+ * reordered copy of the local part is ever held in memory
+ */
+static void write_bin_stream(op_dat dat, const char *file_name) {
+  int rank;
+  MPI_Comm_rank(OP_MPI_IO_WORLD, &rank);
 
-  int g_size = 0;
-  for (int i = 0; i < comm_size; i++) {
-    g_size += recevcnts[i];
-    recevcnts[i] = elem_size * recevcnts[i];
-  }
-  for (int i = 0; i < comm_size; i++) {
-    displs[i] = disp;
-    disp = disp + recevcnts[i];
+  int size = dat->set->size, g_size = 0;
+  MPI_Allreduce(&size, &g_size, 1, MPI_INT, MPI_SUM, OP_MPI_IO_WORLD);
+
+  // local elements sorted by their original global index
+  int *g_index = (int *)xmalloc(size * sizeof(int));
+  int *order = (int *)xmalloc(size * sizeof(int));
+  for (int i = 0; i < size; i++) {
+    g_index[i] = OP_part_list[dat->set->index]->g_index[i];
+    order[i] = i;
   }
-  if (rank == MPI_ROOT)
-    g_array = (T *)xmalloc(elem_size * g_size * sizeof(T));
-  _mpi_gather(l_array, g_array, l_size * elem_size, recevcnts, displs,
-              OP_MPI_IO_WORLD);
+  quickSort_2(g_index, order, 0, size - 1);
+
+  int per_round = (int)MIN(((size_t)OP_io_stream << 20) / dat->size,
+                           (size_t)INT_MAX);
+  per_round = MAX(per_round, 1);
+  int rounds = (size + per_round - 1) / per_round, max_rounds = 0;
+  MPI_Allreduce(&rounds, &max_rounds, 1, MPI_INT, MPI_MAX, OP_MPI_IO_WORLD);
 
+  MPI_File fh = open_file_mpi(file_name);
   if (rank == MPI_ROOT) {
-    FILE *fp;
-    if ((fp = fopen(file_name, "w")) == NULL) {
-      printf("can't open file %s\n", file_name);
-      MPI_Abort(OP_MPI_IO_WORLD, -1);
+    int header[2] = {g_size, dat->dim};
+    checked_write(MPI_File_write_at(fh, 0, header, 2, MPI_INT,
+                                    MPI_STATUS_IGNORE) != MPI_SUCCESS,
+                  file_name);
+  }
+
+  MPI_Datatype elem;
+  MPI_Type_contiguous(dat->size, MPI_BYTE, &elem);
+  MPI_Type_commit(&elem);
+
+  char *buf = (char *)xmalloc((size_t)MIN(per_round, MAX(size, 1)) * dat->size);
+  int *run_len = (int *)xmalloc(MIN(per_round, MAX(size, 1)) * sizeof(int));
+  int *run_start = (int *)xmalloc(MIN(per_round, MAX(size, 1)) * sizeof(int));
+
+  for (int r = 0; r < max_rounds; r++) {
+    int first = MIN(r * per_round, size);
+    int n = MIN(per_round, size - first);
+    int runs = 0;
+    for (int i = 0; i < n; i++) {
+      memcpy(&buf[(size_t)i * dat->size],
+             &dat->data[(size_t)order[first + i] * dat->size], dat->size);
+      if (runs > 0 && run_start[runs - 1] + run_len[runs - 1] ==
+                          g_index[first + i]) {
+        run_len[runs - 1]++;
+      } else {
+        run_start[runs] = g_index[first + i];
+        run_len[runs++] = 1;
+      }
     }
 
-    // Write binary or text as requested by the caller
-    F(fp, g_size, elem_size, g_array, file_name);
+    // ranks with nothing left to write still take part in the collective
+    MPI_Datatype view = elem;
+    if (runs > 0) {
+      MPI_Type_indexed(runs, run_len, run_start, elem, &view);
+      MPI_Type_commit(&view);
+    }
+    MPI_File_set_view(fh, 2 * sizeof(int), elem, view, "native",
+                      MPI_INFO_NULL);
+    checked_write(MPI_File_write_all(fh, buf, n, elem, MPI_STATUS_IGNORE) !=
+                      MPI_SUCCESS,
+                  file_name);
+    if (runs > 0)
+      MPI_Type_free(&view);
+  }
+
+  MPI_Type_free(&elem);
+  MPI_File_close(&fh);
+  free(buf);
+  free(run_len);
+  free(run_start);
+  free(g_index);
+  free(order);
+}
+
+/*
+ * text file: the same layout as the binary file, one element per line. The
+ * lines differ in length, so each rank first counts the bytes of its
+ * original block to find its offset, then formats and writes it through a
+ * buffer of at most OP_io_stream MiB (the whole block if streaming is off)
+ */
+template <typename T, const char *fmt>
+void write_txt(op_dat dat, const char *file_name) {
+  int rank;
+  MPI_Comm_rank(OP_MPI_IO_WORLD, &rank);
 
-    fclose(fp);
-    free(g_array);
+  int size = dat->set->size, dim = dat->dim, g_size = 0;
+  MPI_Allreduce(&size, &g_size, 1, MPI_INT, MPI_SUM, OP_MPI_IO_WORLD);
+  T *data = (T *)dat->data;
+
+  char header[32];
+  int header_len =
+      rank == MPI_ROOT ? snprintf(header, 32, "%d %d\n", g_size, dim) : 0;
+  long long l_bytes = header_len, offset = 0;
+  for (size_t i = 0; i < (size_t)size * dim; i++)
+    l_bytes += snprintf(NULL, 0, fmt, data[i]);
+  l_bytes += size; // newlines
+  MPI_Exscan(&l_bytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, OP_MPI_IO_WORLD);
+  if (rank == 0)
+    offset = 0;
+
+  size_t cap =
+      OP_io_stream ? (size_t)OP_io_stream << 20 : (size_t)l_bytes + 512;
+  cap = MAX(cap, (size_t)4096);
+  char *buf = (char *)xmalloc(cap);
+  size_t len = 0;
+
+  MPI_File fh = open_file_mpi(file_name);
+  memcpy(buf, header, header_len);
+  len = header_len;
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j <= dim; j++) {
+      // a formatted value is at most a few hundred characters
+      if (cap - len < 512) {
+        checked_write(MPI_File_write_at(fh, offset, buf, len, MPI_CHAR,
+                                        MPI_STATUS_IGNORE) != MPI_SUCCESS,
+                      file_name);
+        offset += len;
+        len = 0;
+      }
+      if (j < dim)
+        len += snprintf(&buf[len], cap - len, fmt, data[(size_t)i * dim + j]);
+      else
+        buf[len++] = '\n';
+    }
   }
+  if (len > 0)
+    checked_write(MPI_File_write_at(fh, offset, buf, len, MPI_CHAR,
+                                    MPI_STATUS_IGNORE) != MPI_SUCCESS,
+                  file_name);
+  MPI_File_close(&fh);
+  free(buf);
+}
+
+template <void (*F)(op_dat, const char *)>
+void write_file(op_dat dat, const char *file_name) {
+  // create new communicator for output
+  MPI_Comm_dup(OP_MPI_WORLD, &OP_MPI_IO_WORLD);
+
+  // Write binary or text as requested by the caller
+  F(dat, file_name);
 
-  free(l_array);
-  free(recevcnts);
-  free(displs);
   MPI_Comm_free(&OP_MPI_IO_WORLD);
 }
 
@@ -242,11 +352,11 @@ extern const char fmt_int[] = "%d ";
 
 void print_dat_to_txtfile_mpi(op_dat dat, const char *file_name) {
   if (strcmp(dat->type, "double") == 0)
-    write_file<double, write_txt<double, fmt_double> >(dat, file_name);
+    write_file<write_txt<double, fmt_double> >(dat, file_name);
   else if (strcmp(dat->type, "float") == 0)
-    write_file<float, write_txt<float, fmt_float> >(dat, file_name);
+    write_file<write_txt<float, fmt_float> >(dat, file_name);
   else if (strcmp(dat->type, "int") == 0)
-    write_file<int, write_txt<int, fmt_int> >(dat, file_name);
+    write_file<write_txt<int, fmt_int> >(dat, file_name);
   else
     printf("Unknown type %s, cannot be written to file %s\n", dat->type,
            file_name);
@@ -257,12 +367,22 @@ void print_dat_to_txtfile_mpi(op_dat dat, const char *file_name) {
  *******************************************************************************/
 
 void print_dat_to_binfile_mpi(op_dat dat, const char *file_name) {
-  if (strcmp(dat->type, "double") == 0)
-    write_file<double, write_bin<double> >(dat, file_name);
-  else if (strcmp(dat->type, "float") == 0)
-    write_file<float, write_bin<float> >(dat, file_name);
-  else if (strcmp(dat->type, "int") == 0)
-    write_file<int, write_bin<int> >(dat, file_name);
+  if (strcmp(dat->type, "double") == 0 || strcmp(dat->type, "float") == 0 ||
+      strcmp(dat->type, "int") == 0)
+    write_file<write_bin>(dat, file_name);
+  else
+    printf("Unknown type %s, cannot be written to file %s\n", dat->type,
+           file_name);
+}
+
+/*******************************************************************************
+ * Write a distributed op_dat to a named Binary file without reordering it
+ *******************************************************************************/
+
+void print_dat_to_binfile_mpi_stream(op_dat dat, const char *file_name) {
+  if (strcmp(dat->type, "double") == 0 || strcmp(dat->type, "float") == 0 ||
+      strcmp(dat->type, "int") == 0)
+    write_file<write_bin_stream>(dat, file_name);
   else
     printf("Unknown type %s, cannot be written to file %s\n", dat->type,
            file_name);
@@ -38,6 +38,10 @@
 #include <op_lib_c.h>
 #include <op_rt_support.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*
  * Routines called by user code and kernels
  * these wrappers are used by non-CUDA versions
@@ -71,9 +75,45 @@ void op_mpi_init_soa(int argc, char **argv, int diags, int global, int local,
 }
 #endif
 
+/*
+ * Copy the user data into the OP2 copy of a dat, with each thread touching
+ * the block of elements it gets in a direct loop (start = (size * thr) /
+ * nthreads), so that pages are first placed on that thread's NUMA node
+ */
+static void op_first_touch_copy(char *dst, const char *src, size_t elem_size,
+                                int nelems) {
+#ifdef _OPENMP
+#pragma omp parallel
+  {
+    int nthreads = omp_get_num_threads();
+    int thr = omp_get_thread_num();
+    size_t start = ((size_t)nelems * thr) / nthreads;
+    size_t finish = ((size_t)nelems * (thr + 1)) / nthreads;
+    memcpy(dst + start * elem_size, src + start * elem_size,
+           (finish - start) * elem_size);
+  }
+#else
+  memcpy(dst, src, (size_t)nelems * elem_size);
+#endif
+}
+
 op_dat op_decl_dat_char(op_set set, int dim, char const *type, int size,
                         char *data, char const *name) {
-  return op_decl_dat_core(set, dim, type, size, data, name);
+  if (!OP_realloc || data == NULL)
+    return op_decl_dat_core(set, dim, type, size, data, name);
+
+  // let the core allocate without copying, then place pages in parallel
+  op_dat dat = op_decl_dat_core(set, dim, type, size, NULL, name);
+  op_first_touch_copy(dat->data, data, dat->size, set->size);
+
+  op_dat_entry *item;
+  TAILQ_FOREACH(item, &OP_dat_list, entries) {
+    if (item->dat == dat) {
+      item->orig_ptr = data;
+      break;
+    }
+  }
+  return dat;
 }
 
 op_dat op_decl_dat_temp_char(op_set set, int dim, char const *type, int size,
@@ -107,6 +147,14 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
          (high + 1) * dat->size);
 }
 
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  return op_fetch_data_owned_core(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  op_fetch_data_range_core(dat, usr_ptr, low, high);
+}
+
 /*
  * No specific action is required for constants in OpenMP
  */
@@ -151,6 +199,7 @@ void op_printf(const char *format, ...) {
 void op_print(const char *line) { printf("%s\n", line); }
 
 void op_exit() {
+  op_exit_hooks_core();
   op_rt_exit();
   op_exit_core();
 }
@@ -173,6 +173,7 @@ void op_renumber(op_map base) { (void)base; }
 int getHybridGPU() { return OP_hybrid_gpu; }
 
 void op_exit() {
+  op_exit_hooks_core(); // finishes I/O in flight
   op_cuda_exit(); // frees dat_d memory
   op_rt_exit();   // frees plan memory
   op_exit_core(); // frees lib core variables
@@ -277,6 +278,16 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
          (high + 1) * dat->size);
 }
 
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  op_cuda_get_data(dat);
+  return op_fetch_data_owned_core(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  op_cuda_get_data(dat);
+  op_fetch_data_range_core(dat, usr_ptr, low, high);
+}
+
 // Dummy for OpenMP compile
 
 typedef struct {
@@ -165,6 +165,14 @@ void op_fetch_data_idx_char(op_dat dat, char *usr_ptr, int low, int high) {
          (high + 1) * dat->size);
 }
 
+int op_fetch_data_owned_char(op_dat dat, char *usr_ptr, int *g_index) {
+  return op_fetch_data_owned_core(dat, usr_ptr, g_index);
+}
+
+void op_fetch_data_range_char(op_dat dat, char *usr_ptr, int low, int high) {
+  op_fetch_data_range_core(dat, usr_ptr, low, high);
+}
+
 int op_get_size(op_set set) { return set->size; }
 
 void op_printf(const char *format, ...) {
@@ -178,7 +186,10 @@ void op_print(const char *line) { printf("%s\n", line); }
 
 void op_timers(double *cpu, double *et) { op_timers_core(cpu, et); }
 
-void op_exit() { op_exit_core(); }
+void op_exit() {
+  op_exit_hooks_core();
+  op_exit_core();
+}
 
 void op_timing_output() { op_timing_output_core(); }
 
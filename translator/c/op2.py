@@ -917,7 +917,7 @@ def main(srcFilesAndDirs=sys.argv[1:]):
   #
   #  finally, generate target-specific kernel files
   #
-  masterFile = str(srcFilesAndDirs[0])
+  masterFile = str(src_files[0])
 
   op2_gen_seq(masterFile, date, consts, kernels) # MPI+GENSEQ version - initial version, no vectorisation
   # Vec translator is not yet ready for release, eg it cannot translate the 'aero' app.
@@ -299,6 +299,160 @@ def evaluate_macro_defs_in_string(macro_defs, string):
 
   return resolved_string
 
+def gbl_halo_scratch(dim, acc):
+    """Code for <ARG>_halo, the scratch copy of a global reduction that the
+    exec halo loop of the MPI sequential code writes to. It starts at zero
+    for OP_INC and at the current value otherwise, since OP_MIN, OP_MAX and
+    OP_RW kernels read it first. If the dim is only known at run time the
+    storage is kept from one call to the next and only grows."""
+    OP_INC = 4
+    if str(dim).isdigit():
+      decl = ['<TYP> <ARG>_halo[<DIM>];']
+      size = '<DIM>'
+    else:
+      decl = ['static <TYP> *<ARG>_halo = NULL;',
+              'static int <ARG>_halo_size = 0;',
+              'if (<ARG>.dim > <ARG>_halo_size) {',
+              '  <ARG>_halo = (<TYP> *)op_realloc(<ARG>_halo, <ARG>.dim * sizeof(<TYP>));',
+              '  <ARG>_halo_size = <ARG>.dim;',
+              '}']
+      size = '<ARG>.dim'
+    decl = decl + ['for (int d = 0; d < '+size+'; d++)']
+    if acc == OP_INC:
+      decl = decl + ['  <ARG>_halo[d] = ZERO_<TYP>;']
+    else:
+      decl = decl + ['  <ARG>_halo[d] = ((<TYP> *)<ARG>.data)[d];']
+    return decl
+
+def gen_seq_indirect_loops(depth, name, nargs, nmaps, dims, maps, typs, accs,
+                           idxs, inds, optflags, invinds, invmapinds, mapinds,
+                           unique_args, vectorised, test_all, wait_all):
+    """Code for an indirect loop of the MPI sequential generators. The core,
+    owned non-core and exec halo elements each get their own loop, with the
+    halo wait in between. test_all and wait_all are the lines testing and
+    completing the halo exchanges. Returns the lines, indented relative to
+    depth, the indentation of the caller."""
+    OP_ID   = 1;  OP_GBL   = 2;  OP_MAP = 3;
+    OP_READ = 1;
+
+    lines = []
+    ind = [0]
+
+    def code(line, m=None):
+      if m is not None:
+        line = re.sub('<DIM>',str(dims[m]),line)
+        line = re.sub('<ARG>','arg'+str(m),line)
+        line = re.sub('<TYP>',typs[m],line)
+      if line == '':
+        lines.append('')
+      else:
+        lines.append(' '*ind[0]+line)
+
+    def block(line):
+      code(line)
+      ind[0] += 2
+
+    def end():
+      ind[0] -= 2
+      code('}')
+
+    def indirect_kernel_call(halo):
+      if nmaps > 0:
+        k = []
+        for g_m in range(0,nargs):
+          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k):
+            k = k + [mapinds[g_m]]
+            code('int map'+str(mapinds[g_m])+'idx;')
+      #do non-optional ones
+      if nmaps > 0:
+        k = []
+        for g_m in range(0,nargs):
+          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k) and (not optflags[g_m]):
+            k = k + [mapinds[g_m]]
+            code('map'+str(mapinds[g_m])+'idx = arg'+str(invmapinds[inds[g_m]-1])+'.map_data[n * arg'+str(invmapinds[inds[g_m]-1])+'.map->dim + '+str(idxs[g_m])+'];')
+      #do optional ones
+      if nmaps > 0:
+        for g_m in range(0,nargs):
+          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k):
+            if optflags[g_m]:
+              if vectorised[g_m]:
+                index = vectorised.index(vectorised[g_m])
+              else:
+                index = g_m
+              block('if (arg'+str(index)+'.opt) {')
+            else:
+              k = k + [mapinds[g_m]]
+            code('map'+str(mapinds[g_m])+'idx = arg'+str(invmapinds[inds[g_m]-1])+'.map_data[n * arg'+str(invmapinds[inds[g_m]-1])+'.map->dim + '+str(idxs[g_m])+'];')
+            if optflags[g_m]:
+              end()
+
+      code('')
+      for g_m in range (0,nargs):
+        u = [i for i in range(0,len(unique_args)) if unique_args[i]-1 == g_m]
+        if len(u) > 0 and vectorised[g_m] > 0:
+          if accs[g_m] == OP_READ:
+            line = 'const <TYP>* <ARG>_vec[] = {\n'
+          else:
+            line = '<TYP>* <ARG>_vec[] = {\n'
+
+          v = [int(vectorised[i] == vectorised[g_m]) for i in range(0,len(vectorised))]
+          first = [i for i in range(0,len(v)) if v[i] == 1]
+          first = first[0]
+
+          indent = ' '*(depth+ind[0]+2)
+          for k in range(0,sum(v)):
+            line = line + indent + ' &((<TYP>*)arg'+str(first)+'.data)[<DIM> * map'+str(mapinds[g_m+k])+'idx],\n'
+          line = line[:-2]+'};'
+          code(line, g_m)
+      code('')
+
+      line = name+'('
+      indent = '\n'+' '*(depth+ind[0]+2)
+      for g_m in range(0,nargs):
+        if maps[g_m] == OP_ID:
+          line = line + indent + '&(('+typs[g_m]+'*)arg'+str(g_m)+'.data)['+str(dims[g_m])+' * n]'
+        if maps[g_m] == OP_MAP:
+          if vectorised[g_m]:
+            if g_m+1 in unique_args:
+                line = line + indent + 'arg'+str(g_m)+'_vec'
+          else:
+            line = line + indent + '&(('+typs[g_m]+'*)arg'+str(invinds[inds[g_m]-1])+'.data)['+str(dims[g_m])+' * map'+str(mapinds[g_m])+'idx]'
+        if maps[g_m] == OP_GBL:
+          if halo and accs[g_m] != OP_READ:
+            line = line + indent + 'arg'+str(g_m)+'_halo'
+          else:
+            line = line + indent +'('+typs[g_m]+'*)arg'+str(g_m)+'.data'
+        if g_m < nargs-1:
+          if g_m+1 in unique_args and not g_m+1 == unique_args[-1]:
+            line = line +','
+        else:
+           line = line +');'
+      code(line)
+
+    #reductions over the exec halo go to a scratch copy to avoid double counting
+    gbl_halo = [m for m in range(0,nargs) if maps[m] == OP_GBL and accs[m] != OP_READ]
+    for g_m in gbl_halo:
+      for line in gbl_halo_scratch(dims[g_m], accs[g_m]):
+        code(line, g_m)
+    if len(gbl_halo) > 0:
+      code('')
+    block('for ( int n=0; n<set->core_size; n++ ){')
+    for line in test_all:
+      code(line)
+    indirect_kernel_call(0)
+    end()
+    code('')
+    code(wait_all)
+    code('')
+    block('for ( int n=set->core_size; n<set->size; n++ ){')
+    indirect_kernel_call(0)
+    end()
+    code('')
+    block('for ( int n=set->size; n<set_size; n++ ){')
+    indirect_kernel_call(1)
+    end()
+    return lines
+
 def create_kernel_info(kernel, inc_stage = 0):
     OP_ID   = 1;  OP_GBL   = 2;  OP_MAP = 3;
 
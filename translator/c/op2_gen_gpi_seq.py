@@ -234,96 +234,29 @@ def op2_gen_gpi_seq(master, date, consts, kernels):
       code('int set_size = op_gpi_halo_exchanges_grouped(set, nargs, args, 1);')
     else:
       code('int set_size = op_gpi_halo_exchanges(set, nargs, args);')
-
-    code('')
-    IF('set_size > 0')
     code('')
 
 #
-# kernel call for indirect version
+# kernel call for indirect version: the core, owned non-core and exec halo
+# elements each get their own loop, with the halo wait in between
 #
     if ninds>0:
-      FOR('n','0','set_size')
-      IF('n==set->core_size')
       if grouped:
-        code('op_gpi_waitall_grouped(nargs, args, 1);')
+        wait_all = 'op_gpi_waitall_grouped(nargs, args, 1);'
       else:
-        code('op_gpi_waitall_args(nargs, args);')
-      ENDIF()
-      if nmaps > 0:
-        k = []
-        for g_m in range(0,nargs):
-          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k):
-            k = k + [mapinds[g_m]]
-            code('int map'+str(mapinds[g_m])+'idx;')
-      #do non-optional ones
-      if nmaps > 0:
-        k = []
-        for g_m in range(0,nargs):
-          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k) and (not optflags[g_m]):
-            k = k + [mapinds[g_m]]
-            code('map'+str(mapinds[g_m])+'idx = arg'+str(invmapinds[inds[g_m]-1])+'.map_data[n * arg'+str(invmapinds[inds[g_m]-1])+'.map->dim + '+str(idxs[g_m])+'];')
-      #do optional ones
-      if nmaps > 0:
-        for g_m in range(0,nargs):
-          if maps[g_m] == OP_MAP and (not mapinds[g_m] in k):
-            if optflags[g_m]:
-              if vectorised[g_m]:
-                index = vectorised.index(vectorised[g_m])
-              else:
-                index = g_m
-              IF('arg'+str(index)+'.opt')
-            else:
-              k = k + [mapinds[g_m]]
-            code('map'+str(mapinds[g_m])+'idx = arg'+str(invmapinds[inds[g_m]-1])+'.map_data[n * arg'+str(invmapinds[inds[g_m]-1])+'.map->dim + '+str(idxs[g_m])+'];')
-            if optflags[g_m]:
-              ENDIF()
-
-      code('')
-      for g_m in range (0,nargs):
-        u = [i for i in range(0,len(unique_args)) if unique_args[i]-1 == g_m]
-        if len(u) > 0 and vectorised[g_m] > 0:
-          if accs[g_m] == OP_READ:
-            line = 'const <TYP>* <ARG>_vec[] = {\n'
-          else:
-            line = '<TYP>* <ARG>_vec[] = {\n'
-
-          v = [int(vectorised[i] == vectorised[g_m]) for i in range(0,len(vectorised))]
-          first = [i for i in range(0,len(v)) if v[i] == 1]
-          first = first[0]
-        
-          indent = ' '*(depth+2)
-          for k in range(0,sum(v)):
-            line = line + indent + ' &((<TYP>*)arg'+str(first)+'.data)[<DIM> * map'+str(mapinds[g_m+k])+'idx],\n'
-          line = line[:-2]+'};'
-          code(line)
-      code('')
-
-      line = name+'('
-      indent = '\n'+' '*(depth+2)
-      for g_m in range(0,nargs):
-        if maps[g_m] == OP_ID:
-          line = line + indent + '&(('+typs[g_m]+'*)arg'+str(g_m)+'.data)['+str(dims[g_m])+' * n]'
-        if maps[g_m] == OP_MAP: 
-          if vectorised[g_m]:
-            if g_m+1 in unique_args:
-                line = line + indent + 'arg'+str(g_m)+'_vec'
-          else:
-            line = line + indent + '&(('+typs[g_m]+'*)arg'+str(invinds[inds[g_m]-1])+'.data)['+str(dims[g_m])+' * map'+str(mapinds[g_m])+'idx]'
-        if maps[g_m] == OP_GBL:
-          line = line + indent +'('+typs[g_m]+'*)arg'+str(g_m)+'.data'
-        if g_m < nargs-1: 
-          if g_m+1 in unique_args and not g_m+1 == unique_args[-1]:
-            line = line +','
-        else:
-           line = line +');'
-      code(line)
-      ENDFOR()
+        wait_all = 'op_gpi_waitall_args(nargs, args);'
+      for line in op2_gen_common.gen_seq_indirect_loops(depth, name, nargs,
+          nmaps, dims, maps, typs, accs, idxs, inds, optflags, invinds,
+          invmapinds, mapinds, unique_args, vectorised,
+          [], wait_all):
+        code(line)
 
 #
 # kernel call for direct version
 #
     else:
+      IF('set_size > 0')
+      code('')
       FOR('n','0','set_size')
       line = name+'('
       indent = '\n'+' '*(depth+2)
@@ -338,15 +271,8 @@ def op2_gen_gpi_seq(master, date, consts, kernels):
            line = line +');'
       code(line)
       ENDFOR()
-
-    ENDIF()
-    code('')
-
-    #zero set size issues
-    if ninds>0:
-      IF('set_size == 0 || set_size == set->core_size')
-      code('op_gpi_waitall_args(nargs, args);')
       ENDIF()
+    code('')
 
 #
 # combine reduction data from multiple OpenMP threads